@@ -0,0 +1,107 @@
+#pragma once
+
+# include <stdio.h>
+# include <stdint.h>
+# include <stdlib.h>
+# include <time.h>
+# include <libcerr.h>
+
+// ╔════════════════════════════════[ HARNESS ]═══════════════════════════════╗
+
+# ifndef BENCH_ITERS
+#  define BENCH_ITERS	10000000
+# endif
+
+// The iterations are timed in this many batches, the percentiles are the ones
+// of the batch costs
+# ifndef BENCH_SAMPLES
+#  define BENCH_SAMPLES	100
+# endif
+
+typedef struct s_bench {
+	const char		*name;
+	uint64_t		i;
+	uint64_t		batch;
+	uint32_t		s;
+	uint64_t		last;
+	double			samples[BENCH_SAMPLES];
+}	t_bench;
+
+// Run the following statement N times and report its cost in ns/op
+# define BENCH(NAME, N)                                                        \
+	for (t_bench __b = __bench_begin(NAME, N); __bench_next(&__b); )
+
+// Prevent the compiler from optimizing away a value
+# define BENCH_KEEP(X) __asm__ volatile("" : : "g"(X) : "memory")
+
+static inline uint64_t __bench_ns(struct timespec t) {
+	return (uint64_t)t.tv_sec * 1000000000ull + (uint64_t)t.tv_nsec;
+}
+
+static inline uint64_t __bench_now(void) {
+	struct timespec	t;
+
+	clock_gettime(CLOCK_MONOTONIC, &t);
+	return __bench_ns(t);
+}
+
+static int __bench_cmp(const void *a, const void *b) {
+	double	x = *(const double *)a;
+	double	y = *(const double *)b;
+
+	return (x > y) - (x < y);
+}
+
+// Prints a result, and appends it as name,iters,mean,p50,p90,p99 to the CSV
+// file named by $BENCH_OUTPUT
+static void __bench_report(const char *name, double *samples, uint32_t n,
+	uint64_t iters) {
+	static FILE	*csv = NULL;
+	const char	*path = getenv("BENCH_OUTPUT");
+	double		mean = 0;
+
+	for (uint32_t i = 0; i < n; ++i)
+		mean += samples[i];
+	mean /= n;
+	qsort(samples, n, sizeof(double), __bench_cmp);
+# define __BENCH_P(P) samples[(n - 1) * (P) / 100]
+	printf("%-40s %10.2f ns/op  p50 %9.2f  p90 %9.2f  p99 %9.2f\n", name,
+		mean, __BENCH_P(50), __BENCH_P(90), __BENCH_P(99));
+	if (!csv && path && *path)
+		csv = fopen(path, "a");
+	if (csv)
+		fprintf(csv, "%s,%llu,%.2f,%.2f,%.2f,%.2f\n", name,
+			(unsigned long long)iters, mean, __BENCH_P(50), __BENCH_P(90),
+			__BENCH_P(99));
+# undef __BENCH_P
+	fflush(NULL);
+}
+
+static inline t_bench __bench_begin(const char *name, uint64_t n) {
+	t_bench	b = {.name = name, .i = 0, .s = 0};
+
+	b.batch = n / BENCH_SAMPLES ? n / BENCH_SAMPLES : 1;
+	b.last = __bench_now();
+	return b;
+}
+
+// Closes a batch, the current iteration is the first of the next one
+__attribute__((noinline))
+static int __bench_batch(t_bench *b) {
+	uint64_t	now = __bench_now();
+
+	b->samples[b->s++] = (double)(now - b->last) / (double)b->batch;
+	if (b->s == BENCH_SAMPLES) {
+		__bench_report(b->name, b->samples, b->s, b->batch * b->s);
+		return 0;
+	}
+	b->i = 1;
+	b->last = __bench_now();
+	return 1;
+}
+
+static inline int __bench_next(t_bench *b) {
+	if (__builtin_expect(b->i++ < b->batch, 1))
+		return 1;
+	return __bench_batch(b);
+}
@@ -0,0 +1,54 @@
+#define _GNU_SOURCE
+#define CERR_IMPLEMENTATION
+#include "bench.h"
+
+// Built once per cache mode, see BENCH_MODES in the Makefile
+#ifndef BENCH_MODE
+# define BENCH_MODE "hash"
+#endif
+
+#define LIVE	0x4000
+#define LOADS	3
+
+// Live blocks of the load benches: the hash table doubles at half load and
+// has 64k slots past 16k blocks, these fill it to 26%, 37% and 49%
+static const uint32_t g_loads[LOADS] = {17000, 24000, 32000};
+
+int main(void) {
+	static void *ptrs[32000];
+	uint32_t k = 1;
+	uint32_t live = 0;
+	char name[64];
+
+	BENCH("cache/" BENCH_MODE "/malloc_free", BENCH_ITERS) {
+		void *p = MALLOC(32);
+		BENCH_KEEP(p);
+		FREE(p);
+	}
+	for (int l = 0; l < LOADS; ++l) {
+		for (; live < g_loads[l]; ++live)
+			ptrs[live] = MALLOC(16 + live % 64);
+		snprintf(name, sizeof(name), "cache/" BENCH_MODE "/malloc_free_%uk_live",
+			g_loads[l] / 1000);
+		BENCH(name, BENCH_ITERS) {
+			void *p = MALLOC(32);
+			BENCH_KEEP(p);
+			FREE(p);
+		}
+	}
+	// Keeps the first blocks for the churn
+	for (; live > LIVE; --live)
+		FREE(ptrs[live - 1]);
+	BENCH("cache/" BENCH_MODE "/churn_16k_live", BENCH_ITERS) {
+		k = k * 1103515245u + 12345u;
+		FREE(ptrs[(k >> 8) % LIVE]);
+		ptrs[(k >> 8) % LIVE] = MALLOC(16 + k % 64);
+	}
+	BENCH("cache/" BENCH_MODE "/realloc_16k_live", BENCH_ITERS) {
+		k = k * 1103515245u + 12345u;
+		ptrs[(k >> 8) % LIVE] = REALLOC(ptrs[(k >> 8) % LIVE], 16 + k % 256);
+	}
+	for (int i = 0; i < LIVE; ++i)
+		FREE(ptrs[i]);
+	return 0;
+}
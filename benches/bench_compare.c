@@ -0,0 +1,88 @@
+// Compares two BENCH_OUTPUT files on the median cost, and fails when a bench
+// got slower than the baseline by more than the threshold percent (default 10)
+// usage: bench_compare baseline.csv results.csv [threshold]
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+typedef struct s_row {
+	char	name[64];
+	double	p50;
+}	t_row;
+
+// Rows of a name,iters,mean,p50,p90,p99 file, NULL when it cannot be read
+static t_row *read_rows(const char *path, size_t *len) {
+	FILE	*in = fopen(path, "r");
+	size_t	cap = 64;
+	t_row	*rows = malloc(cap * sizeof(t_row));
+	t_row	*grown;
+	char	line[256];
+
+	*len = 0;
+	if (!in || !rows) {
+		perror(path);
+		free(rows);
+		if (in)
+			fclose(in);
+		return NULL;
+	}
+	while (rows && fgets(line, sizeof(line), in)) {
+		if (sscanf(line, "%63[^,],%*u,%*f,%lf", rows[*len].name,
+			&rows[*len].p50) != 2 || ++*len < cap)
+			continue;
+		if (!(grown = realloc(rows, cap * 2 * sizeof(t_row))))
+			free(rows);
+		rows = grown;
+		cap *= 2;
+	}
+	fclose(in);
+	return rows;
+}
+
+static const t_row *find(const t_row *rows, size_t len, const char *name) {
+	for (size_t i = 0; i < len; ++i)
+		if (!strcmp(rows[i].name, name))
+			return &rows[i];
+	return NULL;
+}
+
+int main(int ac, char **av) {
+	double		threshold = ac > 3 ? atof(av[3]) : 10;
+	t_row		*base;
+	t_row		*cur;
+	size_t		base_len;
+	size_t		cur_len;
+	int			slower = 0;
+
+	if (ac < 3 || ac > 4) {
+		fprintf(stderr, "usage: %s baseline.csv results.csv [threshold]\n",
+			av[0]);
+		return 2;
+	}
+	if (!(base = read_rows(av[1], &base_len))
+		|| !(cur = read_rows(av[2], &cur_len))) {
+		free(base);
+		return 2;
+	}
+	printf("%-40s %10s %10s %8s\n", "p50 ns/op", "baseline", "current",
+		"delta");
+	for (size_t i = 0; i < cur_len; ++i) {
+		const t_row	*b = find(base, base_len, cur[i].name);
+		double		delta;
+
+		if (!b || b->p50 <= 0) {
+			printf("%-40s %10s %10.2f %8s\n", cur[i].name, "-", cur[i].p50,
+				"new");
+			continue;
+		}
+		delta = (cur[i].p50 - b->p50) * 100 / b->p50;
+		printf("%-40s %10.2f %10.2f %+7.1f%%%s\n", cur[i].name, b->p50,
+			cur[i].p50, delta, delta > threshold ? "  REGRESSION" : "");
+		slower += delta > threshold;
+	}
+	if (slower)
+		printf("%d regression(s) above %.1f%%\n", slower, threshold);
+	free(base);
+	free(cur);
+	return slower != 0;
+}
@@ -0,0 +1,71 @@
+#define _GNU_SOURCE
+#define CERR_IMPLEMENTATION
+#include <stdio.h>
+
+static FILE *g_null = NULL;
+
+#define LOG_FDOUT g_null
+#include "bench.h"
+#include <pthread.h>
+
+// Built once per logging mode, see LOG_MODES in the Makefile
+#ifndef BENCH_MODE
+# define BENCH_MODE "sync"
+#endif
+
+#define THREADS	4
+#define LINES	(BENCH_ITERS / 10)
+
+static void *storm(void *arg) {
+	(void)arg;
+	for (int i = 0; i < LINES / THREADS; ++i)
+		LOG_WARN("request %d of worker %p timed out", i, arg);
+	return NULL;
+}
+
+int main(void) {
+	pthread_t		threads[THREADS];
+	uint64_t		start;
+	double			cost;
+
+	// Unbuffered like stderr, every synchronous line is a write
+	g_null = fopen("/dev/null", "w");
+	setvbuf(g_null, NULL, _IONBF, 0);
+	BENCH("log/" BENCH_MODE "/warn", LINES) {
+		LOG_WARN("request %d of worker %p timed out", 42, (void *)g_null);
+	}
+	LOG_FLUSH();
+	// A real file, through the page cache
+	g_null = tmpfile();
+	setvbuf(g_null, NULL, _IONBF, 0);
+	BENCH("log/" BENCH_MODE "/warn_file", LINES) {
+		LOG_WARN("request %d of worker %p timed out", 42, (void *)g_null);
+	}
+	LOG_FLUSH();
+	fclose(g_null);
+	g_null = fopen("/dev/null", "w");
+	setvbuf(g_null, NULL, _IONBF, 0);
+	// Compiled in, disabled at runtime: a load and a branch
+	LOG_SET_LEVEL(NULL, 3);
+	BENCH("log/" BENCH_MODE "/debug_off", BENCH_ITERS) {
+		LOG_DEBUG("request %d of worker %p timed out", 42, (void *)g_null);
+	}
+	LOG_SET_LEVEL(NULL, 4);
+	// Suppressed call sites: a counter, or the coarse clock and a counter
+	BENCH("log/" BENCH_MODE "/warn_every_n", BENCH_ITERS) {
+		LOG_WARN_EVERY_N(BENCH_ITERS, "request %d timed out", 42);
+	}
+	BENCH("log/" BENCH_MODE "/warn_ratelimit", BENCH_ITERS) {
+		LOG_WARN_RATELIMIT(1, "request %d timed out", 42);
+	}
+	// One sample per run, the percentiles are the mean
+	start = __bench_now();
+	for (int t = 0; t < THREADS; ++t)
+		pthread_create(&threads[t], NULL, storm, (void *)(uintptr_t)(t + 1));
+	for (int t = 0; t < THREADS; ++t)
+		pthread_join(threads[t], NULL);
+	cost = (double)(__bench_now() - start) / (double)LINES;
+	__bench_report("log/" BENCH_MODE "/warn_4_threads", &cost, 1, LINES);
+	LOG_FLUSH();
+	return 0;
+}
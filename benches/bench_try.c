@@ -0,0 +1,246 @@
+#define _GNU_SOURCE
+#define CERR_IMPLEMENTATION
+#include "bench.h"
+
+// ═══════════════════════════════[ LEGACY TRY ]═════════════════════════════════
+// Reproduces the previous TRY entry: the whole context, message buffer
+// included, was zero-initialized and returned by value on every TRY.
+
+typedef struct s_legacy_ctx t_legacy_ctx;
+struct s_legacy_ctx {
+	t_legacy_ctx	*prev;
+	jmp_buf			frame;
+	CERR_TYPE		thrown;
+	char			msg[CERR_MSG_SIZE];
+};
+
+static CERR_TLS t_legacy_ctx *g_legacy_ctx = NULL;
+
+static inline void legacy_cleanup(t_legacy_ctx *err) {
+	if (err) g_legacy_ctx = err->prev;
+}
+
+# define LEGACY_INIT ({                                                        \
+	__err = (t_legacy_ctx){0};                                                 \
+	__err.prev = g_legacy_ctx;                                                 \
+	g_legacy_ctx = &__err;                                                     \
+	__err;                                                                     \
+})
+
+# define LEGACY_TRY                                                            \
+	for (t_legacy_ctx __err __attribute__((cleanup(legacy_cleanup)))           \
+		=LEGACY_INIT, *__p=&__err; __p; __p=0)                                 \
+		if ((__err.thrown=setjmp(__err.frame)) == CERR_E_NONE)
+
+// Previous CATCH test, a linear scan of the listed codes
+# define LEGACY_CATCH(...) else if (({                                         \
+	CERR_TYPE __errs[] = {__VA_ARGS__};                                        \
+	const size_t len = sizeof(__errs)/sizeof(CERR_TYPE);                       \
+	int __catched = 0;                                                         \
+	for (size_t __i=0; __i < len && !__catched; ++__i)                         \
+		__catched = (__err.thrown == __errs[__i]);                             \
+	__catched;                                                                 \
+}))
+
+# define IO_ERROR	CERR_CATEGORY(CERR_E_ALL, 1, 8)
+
+// Throws from another frame, like most real throws
+__attribute__((noinline))
+static void thrower(int code) {
+	THROW(code);
+}
+
+// Throws code from depth calls below the TRY
+__attribute__((noinline))
+static void deep(int depth, int code) {
+	if (depth)
+		deep(depth - 1, code);
+	else if (code)
+		thrower(code);
+	__asm__ volatile("");
+}
+
+// Depth nested TRY blocks of one kind, the innermost one catches the throw
+__attribute__((noinline))
+static void nested(int depth) {
+	if (!depth)
+		thrower(1);
+	TRY { nested(depth - 1); }
+}
+
+__attribute__((noinline))
+static void nested_fast(int depth) {
+	if (!depth)
+		thrower(1);
+	TRY_FAST { nested_fast(depth - 1); }
+}
+
+static void release(void *p) {
+	BENCH_KEEP(p);
+}
+
+// Two resources guarded the old way, a TRY each rethrowing after its cleanup
+__attribute__((noinline))
+static void guarded_nested(int code) {
+	volatile CERR_TYPE	outer = 0;
+	volatile CERR_TYPE	inner = 0;
+
+	TRY {
+		TRY {
+			if (code)
+				thrower(code);
+		} CATCH_ALL() { inner = __err.thrown; }
+		release(NULL);
+		if (inner)
+			THROW(inner);
+	} CATCH_ALL() { outer = __err.thrown; }
+	release(NULL);
+	if (outer)
+		THROW(outer);
+}
+
+__attribute__((noinline))
+static void guarded_defer(int code) {
+	DEFER(release, NULL);
+	DEFER(release, NULL);
+	if (code)
+		thrower(code);
+}
+
+typedef CERR_RESULT(int) t_int_result;
+
+// Fails one call out of code, like thrower does every time
+__attribute__((noinline))
+static t_int_result checked(int i, int code) {
+	if (code && i % code == 0)
+		return CERR_FAIL(t_int_result, code, "bad input %d", i);
+	return CERR_OK(t_int_result, i);
+}
+
+__attribute__((noinline))
+static t_int_result checked_twice(int i, int code) {
+	int	v = PROPAGATE(t_int_result, checked(i, code));
+
+	return CERR_OK(t_int_result, v + PROPAGATE(t_int_result, checked(v, 0)));
+}
+
+// ═══════════════════════════════[ BENCHMARKS ]═════════════════════════════════
+
+// A throw from depth calls down, then from depth nested TRY blocks
+__attribute__((noinline))
+static void bench_depth(int depth, volatile int *count) {
+	char	name[3][64];
+
+	snprintf(name[0], 64, "try/deep_%d_throw", depth);
+	snprintf(name[1], 64, "try/nested_%d_throw", depth);
+	snprintf(name[2], 64, "try/nested_%d_throw/fast", depth);
+	BENCH(name[0], BENCH_ITERS / depth) {
+		TRY { deep(depth, 1); } CATCH_ALL() { (*count)++; }
+	}
+	BENCH(name[1], BENCH_ITERS / depth) {
+		TRY { nested(depth); } CATCH_ALL() { (*count)++; }
+	}
+	BENCH(name[2], BENCH_ITERS / depth) {
+		TRY_FAST { nested_fast(depth); } CATCH_ALL() { (*count)++; }
+	}
+}
+
+int main(void) {
+	volatile int count = 0;
+
+	BENCH("try/enter_exit/legacy", BENCH_ITERS) {
+		LEGACY_TRY { count++; } else { count--; }
+	}
+	BENCH("try/enter_exit", BENCH_ITERS) {
+		TRY { count++; } CATCH_ALL() { count--; }
+	}
+	BENCH("try/enter_exit/fast", BENCH_ITERS) {
+		TRY_FAST { count++; } CATCH_ALL() { count--; }
+	}
+	BENCH("try/throw_catch", BENCH_ITERS) {
+		TRY { THROW(1); } CATCH_ALL() { count++; }
+	}
+	BENCH("try/throw_catch/fast", BENCH_ITERS) {
+		TRY_FAST { THROW(1); } CATCH_ALL() { count++; }
+	}
+	BENCH("try/throw_call_catch", BENCH_ITERS) {
+		TRY { thrower(1); } CATCH_ALL() { count++; }
+	}
+	BENCH("try/throw_call_catch/fast", BENCH_ITERS) {
+		TRY_FAST { thrower(1); } CATCH_ALL() { count++; }
+	}
+	for (int depth = 1; depth <= 16; depth *= 4)
+		bench_depth(depth, &count);
+	BENCH("try/cleanup_2/nested", BENCH_ITERS) {
+		TRY { guarded_nested(0); } CATCH_ALL() { count++; }
+	}
+	BENCH("try/cleanup_2/defer", BENCH_ITERS) {
+		TRY { guarded_defer(0); } CATCH_ALL() { count++; }
+	}
+	BENCH("try/cleanup_2_throw/nested", BENCH_ITERS) {
+		TRY { guarded_nested(1); } CATCH_ALL() { count++; }
+	}
+	BENCH("try/cleanup_2_throw/defer", BENCH_ITERS) {
+		TRY { guarded_defer(1); } CATCH_ALL() { count++; }
+	}
+	BENCH("try/result_ok", BENCH_ITERS) {
+		t_int_result	r = checked_twice(count, 0);
+		count += r.err ? -1 : 1;
+	}
+	BENCH("try/result_fail", BENCH_ITERS) {
+		t_int_result	r = checked_twice(count, 1);
+		count += r.err ? -1 : 1;
+	}
+	BENCH("setjmp/setjmp", BENCH_ITERS) {
+		jmp_buf	buf;
+		if (!setjmp(buf)) count++;
+	}
+	BENCH("setjmp/sigsetjmp_mask", BENCH_ITERS) {
+		sigjmp_buf	buf;
+		if (!sigsetjmp(buf, 1)) count++;
+	}
+	BENCH("setjmp/builtin", BENCH_ITERS) {
+		void	*buf[5];
+		if (!__builtin_setjmp(buf)) count++;
+	}
+	BENCH("try/catch_list/legacy", BENCH_ITERS) {
+		TRY { THROW(1 + count % 8); }
+		LEGACY_CATCH(20, 21, 22, 23) { count--; }
+		LEGACY_CATCH(1, 2, 3, 4, 5, 6, 7, 8) { count++; }
+	}
+	BENCH("try/catch_list", BENCH_ITERS) {
+		TRY { THROW(1 + count % 8); }
+		CATCH(20, 21, 22, 23) { count--; }
+		CATCH(1, 2, 3, 4, 5, 6, 7, 8) { count++; }
+	}
+	BENCH("try/catch_category", BENCH_ITERS) {
+		TRY { THROW(CERR_CODE(IO_ERROR, 0) + count % 8); }
+		CATCH(20, 21, 22, 23) { count--; }
+		CATCH(IO_ERROR) { count++; }
+	}
+	BENCH("try/throw_msg_catch", BENCH_ITERS) {
+		TRY { THROW_MSG(1, "bad input %d at %s", count, "header"); }
+		CATCH_ALL() { count++; }
+	}
+	BENCH("try/throw_msg_catch_why", BENCH_ITERS) {
+		TRY { THROW_MSG(1, "bad input %d at %s", count, "header"); }
+		CATCH_ALL() { BENCH_KEEP(CERR_WHY()); }
+	}
+	BENCH("try/malloc_free_4", BENCH_ITERS) {
+		TRY {
+			void *p[4];
+			for (int i = 0; i < 4; ++i)
+				BENCH_KEEP(p[i] = MALLOC(64));
+			for (int i = 0; i < 4; ++i)
+				FREE(p[i]);
+		} CATCH_ALL() { count++; }
+	}
+	BENCH("try/arena_4", BENCH_ITERS) {
+		TRY_ARENA {
+			for (int i = 0; i < 4; ++i)
+				BENCH_KEEP(ARENA_MALLOC(64));
+		} CATCH_ALL() { count++; }
+	}
+	BENCH_KEEP(count);
+	return 0;
+}
@@ -0,0 +1,180 @@
+#pragma once
+
+// GNU extensions of the implementation, see libcerr-log.h
+# if defined(CERR_IMPLEMENTATION) && !defined(_GNU_SOURCE)
+#  define _GNU_SOURCE
+# endif
+
+# include <stddef.h>
+# include <stdint.h>
+# include <stdlib.h>
+# include <string.h>
+
+# include <libcerr-assert.h>
+
+// ╔═══════════════════════════════[ DEFINITION ]══════════════════════════════╗
+
+// Size of the first region of each thread and minimal size of the next ones
+# ifndef CERR_ARENA_SIZE
+#  define CERR_ARENA_SIZE	0x10000
+# endif
+
+// Alignment of every arena allocation
+# define __CERR_ARENA_ALIGN	16
+
+// Regions are chained in the order the arena bumps through them, the ones
+// after the current region stay allocated for the next TRY_ARENA.
+typedef struct s_cerr_region t_cerr_region;
+struct s_cerr_region {
+	t_cerr_region	*next;
+	char			*end;
+	char			data[] __attribute__((aligned(__CERR_ARENA_ALIGN)));
+};
+
+// Bump allocator of a thread, depth counts the TRY_ARENA blocks entered
+typedef struct s_cerr_arena {
+	t_cerr_region	*head;
+	t_cerr_region	*region;
+	char			*top;
+	char			*end;
+	uint32_t		depth;
+}	t_cerr_arena;
+
+// Arena position saved by a TRY_ARENA, top stays NULL for a plain TRY
+typedef struct s_cerr_mark {
+	t_cerr_region	*region;
+	char			*top;
+}	t_cerr_mark;
+
+extern CERR_TLS t_cerr_arena g__cerr_arena;
+
+void	__cerr_arena_attach(t_cerr_arena *a);
+void	*__cerr_arena_grow(t_cerr_arena *a, size_t size);
+
+// ╔═════════════════════════════════[ MACROS ]════════════════════════════════╗
+
+// Allocate from the innermost TRY_ARENA, released with it, never FREE() it
+# define ARENA_MALLOC(S) ({                                                    \
+	void *__res = __cerr_arena_alloc(&g__cerr_arena, S);                       \
+	ASSERT(__res, __CERR_M_ARENA);                                             \
+	__res;                                                                     \
+})
+
+# define ARENA_CALLOC(N, S) ({                                                 \
+	size_t	__s = 0;                                                           \
+	void	*__res = __builtin_mul_overflow(N, S, &__s) ? NULL                 \
+		: __cerr_arena_alloc(&g__cerr_arena, __s);                             \
+	ASSERT(__res, __CERR_M_ARENA);                                             \
+	if (__res) memset(__res, 0, __s);                                          \
+	__res;                                                                     \
+})
+
+// ╔══════════════════════════════════[ UTILS ]════════════════════════════════╗
+
+# define __CERR_M_ARENA "libcerr: arena, alloc failed or outside of TRY_ARENA."
+
+// Bump the top of the arena, NULL outside of any TRY_ARENA
+static inline void *__cerr_arena_alloc(t_cerr_arena *a, size_t size) {
+	size_t	round = (size + __CERR_ARENA_ALIGN - 1)
+		& ~(size_t)(__CERR_ARENA_ALIGN - 1);
+	char	*res = a->top;
+
+	if (__builtin_expect(!a->depth || round < size, 0))
+		return NULL;
+	if (__builtin_expect((size_t)(a->end - res) < round, 0))
+		return __cerr_arena_grow(a, round);
+	a->top = res + round;
+	return res;
+}
+
+// Save the position of the thread arena in m and enter a new scope
+static inline void __cerr_arena_mark(t_cerr_mark *m) {
+	t_cerr_arena	*a = &g__cerr_arena;
+
+	if (__builtin_expect(!a->head, 0))
+		__cerr_arena_attach(a);
+	m->region = a->region;
+	m->top = a->top;
+	++a->depth;
+}
+
+// Drop everything allocated since m was saved, whatever its size
+static inline void __cerr_arena_reset(const t_cerr_mark *m) {
+	t_cerr_arena	*a = &g__cerr_arena;
+
+	a->region = m->region;
+	a->top = m->top;
+	a->end = m->region->end;
+	--a->depth;
+}
+
+// ╔══════════════════════════════[ IMPLEMENTATION ]═══════════════════════════╗
+
+# ifdef CERR_IMPLEMENTATION
+#  include <pthread.h>
+
+CERR_TLS t_cerr_arena g__cerr_arena = {0};
+
+static pthread_key_t g__cerr_arena_key;
+static pthread_once_t g__cerr_arena_once = PTHREAD_ONCE_INIT;
+
+static t_cerr_region *__cerr_region_new(size_t size) {
+	t_cerr_region	*r = malloc(sizeof(t_cerr_region) + size);
+
+	if (!r)
+		return NULL;
+	r->next = NULL;
+	r->end = r->data + size;
+	return r;
+}
+
+// Thread exit: every region of the arena goes back to malloc
+static void __cerr_arena_release(void *arena) {
+	t_cerr_arena	*a = arena;
+	t_cerr_region	*next;
+
+	for (t_cerr_region *r = a->head; r; r = next) {
+		next = r->next;
+		free(r);
+	}
+	*a = (t_cerr_arena){0};
+}
+
+static void __cerr_arena_key(void) {
+	pthread_key_create(&g__cerr_arena_key, __cerr_arena_release);
+}
+
+void __cerr_arena_attach(t_cerr_arena *a) {
+	t_cerr_region	*r = __cerr_region_new(CERR_ARENA_SIZE);
+
+	ASSERT(r, __CERR_M_ARENA);
+	pthread_once(&g__cerr_arena_once, __cerr_arena_key);
+	pthread_setspecific(g__cerr_arena_key, a);
+	a->head = a->region = r;
+	a->top = r->data;
+	a->end = r->end;
+}
+
+// Move to the next region, a new one is linked in if it is too small
+void *__cerr_arena_grow(t_cerr_arena *a, size_t size) {
+	t_cerr_region	*r = a->region->next;
+
+	if (!r || (size_t)(r->end - r->data) < size) {
+		r = __cerr_region_new(size > CERR_ARENA_SIZE ? size : CERR_ARENA_SIZE);
+		if (!r)
+			return NULL;
+		r->next = a->region->next;
+		a->region->next = r;
+	}
+	a->region = r;
+	a->top = r->data + size;
+	a->end = r->end;
+	return r->data;
+}
+
+// Key destructors do not run for the main thread
+__attribute__((destructor))
+static void __cerr_arena_clear(void) {
+	__cerr_arena_release(&g__cerr_arena);
+}
+# endif
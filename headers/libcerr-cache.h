@@ -1,59 +1,340 @@
 #pragma once
 
+// GNU extensions of the implementation, see libcerr-log.h
+# if defined(CERR_IMPLEMENTATION) && !defined(_GNU_SOURCE)
+#  define _GNU_SOURCE
+# endif
+
+# include <sched.h>
 # include <stdint.h>
 # include <stdlib.h>
+# include <string.h>
+# include <sys/mman.h>
+# include <time.h>
+# include <unistd.h>
 
 # include <libcerr-assert.h>
+# include <libcerr-stats.h>
+# include <libcerr-exception.h>
+
+// Checkpoint of the cache, the blocks allocated after it are its young ones
+typedef uint32_t t_cerr_checkpoint;
+
+// Young block listed by cerr_cache_diff, file is NULL for an unknown site
+typedef struct s_cerr_block {
+	void		*ptr;
+	size_t		size;
+	const char	*file;
+	uint32_t	line;
+}	t_cerr_block;
+
+// Classes of the size histogram, class k counts the allocations of 2^(k-1)
+// to 2^k - 1 bytes, class 0 the empty ones
+# define CERR_CACHE_CLASSES	41
+
+// Bytes of the blocks tracked by the process, the most there ever were, and
+// the number of allocations in each size class since the start
+typedef struct s_cerr_mem {
+	uint64_t	live;
+	uint64_t	peak;
+	uint64_t	blocks;
+	uint64_t	sizes[CERR_CACHE_CLASSES];
+}	t_cerr_mem;
+
+t_cerr_checkpoint	cerr_cache_checkpoint(void);
+size_t				cerr_cache_diff(t_cerr_checkpoint cp, t_cerr_block *out,
+						size_t cap);
+void				cerr_cache_mem(t_cerr_mem *out);
+void				cerr_cache_budget(uint64_t bytes);
+void				cerr_cache_trace_end(void);
 
 # ifdef CERR_NCACHE
 // No cache
 
+# define CERR_CACHE_REPORT()	((void)0)
+# define CERR_CACHE_DIFF_REPORT(CP)	((void)(CP))
+
 # define MALLOC(S)			malloc(S)
 # define CALLOC(N, S)		calloc(N, S)
 # define REALLOC(P, S)		realloc(P, S)
 # define FREE(P)			free(P)
 
+#  ifdef CERR_IMPLEMENTATION
+void __cerr_cache_usage(uint64_t *len, uint64_t *cap) {
+	*len = 0;
+	*cap = 0;
+}
+
+t_cerr_checkpoint cerr_cache_checkpoint(void) {
+	return 0;
+}
+
+size_t cerr_cache_diff(t_cerr_checkpoint cp, t_cerr_block *out, size_t cap) {
+	(void)cp;
+	(void)out;
+	(void)cap;
+	return 0;
+}
+
+void cerr_cache_mem(t_cerr_mem *out) {
+	*out = (t_cerr_mem){0};
+}
+
+void cerr_cache_budget(uint64_t bytes) {
+	(void)bytes;
+}
+
+void cerr_cache_trace_end(void) {
+}
+#  endif
+
 # else
 // ╔═══════════════════════════════[ DEFINITION ]══════════════════════════════╗
 
-// IMPORTANT: CERR_CACHE_SIZE MUST BE A POWER OF TWO
+// Initial number of slots, the table doubles whenever it gets half full.
+// IMPORTANT: CERR_CACHE_SIZE MUST BE A POWER OF TWO, of at least 64 slots as
+// the occupancy bitmap is walked a word at a time
 # ifndef CERR_CACHE_SIZE
-# define CERR_CACHE_SIZE	0x10000
+# define CERR_CACHE_SIZE	0x400
 # endif
 
-typedef struct s_cerr_cache {
-	void		*allocs[CERR_CACHE_SIZE];
-	uint32_t	len;
-}	t_cerr_cache;
+_Static_assert(CERR_CACHE_SIZE >= 64
+	&& (CERR_CACHE_SIZE & (CERR_CACHE_SIZE - 1)) == 0, "CERR_CACHE_SIZE");
+
+// Slots moved from the previous table on every insert while growing, a
+// resize is spread over many calls instead of a single pause. A remove looks
+// in both tables and moves nothing.
+# ifndef CERR_CACHE_STEP
+# define CERR_CACHE_STEP	16
+# endif
+
+// Number of allocation sites given their own id, the next ones share one.
+# ifndef CERR_CACHE_SITES
+# define CERR_CACHE_SITES	0x1000
+# endif
+
+// Bytes a shard allocates or frees before adding them to the process total,
+// the budget and the peak are exact to within this much per thread.
+# ifndef CERR_CACHE_GRAIN
+# define CERR_CACHE_GRAIN	0x10000
+# endif
+
+// Intrusive mode tracks blocks through their header, one shard per thread
+# if defined(CERR_CACHE_SHARDED) || defined(CERR_CACHE_INTRUSIVE)
+#  define __CERR_SHARDS
+# endif
+
+// Static descriptor of a MALLOC, CALLOC or REALLOC call, id is given on the
+// first call and then stored with every block allocated there.
+typedef struct s_cerr_site {
+	const char	*file;
+	uint32_t	line;
+	uint32_t	id;
+}	t_cerr_site;
+
+extern t_cerr_site *g__cerr_sites[CERR_CACHE_SITES];
+extern uint32_t g__cerr_sites_len;
+
+// Bumped by each checkpoint, 0 until the first one. Every block records the
+// epoch of its allocation, kept when it is reallocated: in its header in the
+// sharded modes, next to its slot in the hash modes. Once there is a
+// checkpoint, the hash modes also journal each allocation in epoch order.
+extern uint32_t g__cerr_epoch;
+
+// Most bytes the tracked blocks may hold, 0 for no limit
+extern uint64_t g__cerr_budget;
+
+typedef struct s_cerr_young {
+	void		*ptr;
+	uint32_t	epoch;
+}	t_cerr_young;
+
+uint32_t	__cerr_site_register(t_cerr_site *site);
+void		__cerr_cache_report(void);
+
+// allocs is the live table, old the one being migrated (NULL when idle),
+// its slots below cursor are already moved. len counts both tables, bytes
+// their blocks and sizes their allocations by size class.
+// Each table is followed by the meta and the epoch of its slots and a bitmap
+// of the occupied ones.
+// In intrusive mode the table is replaced by the list of live blocks.
+typedef struct s_cerr_cache t_cerr_cache;
+struct s_cerr_cache {
+# ifndef CERR_CACHE_INTRUSIVE
+	void			**allocs;
+	void			**old;
+	uint32_t		cap;
+	uint32_t		old_cap;
+	uint32_t		cursor;
+	t_cerr_young	*young;
+	uint32_t		young_len;
+	uint32_t		young_cap;
+# else
+	struct s_cerr_hdr	*live;
+# endif
+	uint32_t		len;
+	uint64_t		bytes;
+	uint64_t		sizes[CERR_CACHE_CLASSES];
+# ifdef __CERR_SHARDS
+	int64_t			unsent;
+	t_cerr_cache	*link;
+	uint32_t		state;
+	// Raised by the owner while it changes its blocks, by a diff or a report
+	// while it reads them, see __cerr_shard_lock
+	uint32_t		busy;
+	uint32_t		held;
+	// Written by other threads, kept away from the owner's cache lines
+	struct s_cerr_hdr	*remote __attribute__((aligned(64)));
+# endif
+};
+
+# ifdef __CERR_SHARDS
+// Sharded mode: every thread tracks its blocks in its own cache (shard).
+// Blocks start with a header naming their shard, a free from another thread
+// pushes the block on the owner's remote list, drained by the owner.
+// Intrusive mode also links the header in the list of its shard, a free is
+// then a tag check and an unlink, without any table.
+typedef struct s_cerr_hdr t_cerr_hdr;
+// Once a block is claimed, its tag links it in the remote list.
+struct s_cerr_hdr {
+	t_cerr_cache	*owner;
+	uint64_t		epoch;
+	uint64_t		meta;
+	uintptr_t		tag;
+#  ifdef CERR_CACHE_INTRUSIVE
+	t_cerr_hdr		*lprev;
+	t_cerr_hdr		*lnext;
+#  endif
+};
+
+extern CERR_TLS t_cerr_cache *g__cerr_shard;
+extern t_cerr_cache *g__cerr_shards;
 
+// Bytes of the process as published by the shards, and the most seen
+extern uint64_t g__cerr_live;
+extern uint64_t g__cerr_peak;
+
+// Whether the owners of the shards need a full fence, when the readers cannot
+// make every thread run one
+extern uint32_t g__cerr_shard_fence;
+
+t_cerr_cache	*__cerr_shard_attach(void);
+void			__cerr_shard_wait(t_cerr_cache *c);
+void			__cerr_shard_drain(t_cerr_cache *c);
+void			__cerr_shard_reclaim(t_cerr_cache *c);
+void			__cerr_mem_publish(t_cerr_cache *c);
+# else
 extern t_cerr_cache g__cerr_cache;
+extern uint64_t g__cerr_peak;
+# endif
+
+# ifndef CERR_CACHE_INTRUSIVE
+void		__cerr_cache_grow(t_cerr_cache *c);
+void		__cerr_cache_migrate(t_cerr_cache *c);
+void		__cerr_young_add(t_cerr_cache *c, void *ptr, uint32_t epoch);
+# endif
+void		__cerr_cache_diff_report(t_cerr_checkpoint cp);
+void		__cerr_cache_clear(void);
+uint32_t	__cerr_cache_live(void);
+
+// With CERR_CACHE_TRACE, every tracked allocation and free appends an event
+// to the trace file. Each thread writes straight into its own chunk of the
+// file mapped in memory and maps the next chunk once it is full.
+// tools/cerr-heap rebuilds the heap over time from the file.
+typedef struct s_cerr_event {
+	uint64_t	time;
+	uint64_t	ptr;
+	uint64_t	meta;
+	uint32_t	op;
+	uint32_t	tid;
+}	t_cerr_event;
+
+# define __CERR_T_ALLOC	1
+# define __CERR_T_FREE	2
+
+// Head of the trace file. The chunks of events start at events, the unused
+// end of a chunk is zeroed. cerr_cache_trace_end() sets sites, the offset of
+// the site records after the last chunk, and the second clock pair: ticks
+// are then converted to nanoseconds.
+typedef struct s_cerr_trace {
+	char		magic[8];
+	uint32_t	version;
+	uint32_t	event;
+	uint64_t	events;
+	uint64_t	sites;
+	uint64_t	tick0;
+	uint64_t	ns0;
+	uint64_t	tick1;
+	uint64_t	ns1;
+}	t_cerr_trace;
+
+// Site record of the trace, followed by the len bytes of its file name
+typedef struct s_cerr_tsite {
+	uint32_t	id;
+	uint32_t	line;
+	uint32_t	len;
+}	t_cerr_tsite;
+
+# define __CERR_TRACE_MAGIC		"CERRHEAP"
+# define __CERR_TRACE_VERSION	1
+
+int		__cerr_trace_analyze(FILE *out, const char *data, size_t len,
+			uint32_t rows);
+
+# ifdef CERR_CACHE_TRACE
+extern CERR_TLS t_cerr_event *g__cerr_trace_cur;
+extern CERR_TLS t_cerr_event *g__cerr_trace_lim;
+extern CERR_TLS uint32_t g__cerr_trace_tid;
+
+int		__cerr_trace_chunk(void);
+# endif
 
 // ╔═════════════════════════════════[ MACROS ]════════════════════════════════╗
 
+// Log the live blocks grouped by allocation site, largest first.
+// In the sharded modes other threads may allocate meanwhile.
+# define CERR_CACHE_REPORT()	__cerr_cache_report()
+
+// Log the blocks allocated since the checkpoint CP and still live, grouped by
+// site. Only inspects the blocks allocated since then, same as above.
+# define CERR_CACHE_DIFF_REPORT(CP)	__cerr_cache_diff_report(CP)
+
+# ifndef __CERR_SHARDS
 # define MALLOC(S) ({                                                          \
-	ASSERT(g__cerr_cache.len < CERR_CACHE_SIZE, __CERR_M_FULL)                 \
-	void *__res = malloc(S);                                                   \
+	size_t	__s = S;                                                           \
+	__CERR_BUDGET(__s, NULL);                                                  \
+	void	*__res = malloc(__s);                                              \
 	ASSERT(__res, __CERR_M_AFAIL);                                             \
-	__CERR_CACHE_INSERT(__res);                                                \
+	__CERR_CACHE_INSERT(__res, __CERR_META(__s, __CERR_SITE()),                \
+		__CERR_EPOCH());                                                       \
 	__res;                                                                     \
 })
 
 # define CALLOC(N, S) ({                                                       \
-	ASSERT(g__cerr_cache.len < CERR_CACHE_SIZE, __CERR_M_FULL)                 \
-	void *__res = calloc(N, S);                                                \
+	size_t	__n = N;                                                           \
+	size_t	__z = S;                                                           \
+	size_t	__s = 0;                                                           \
+	int		__o = __builtin_mul_overflow(__n, __z, &__s);                      \
+	__CERR_BUDGET(__o ? SIZE_MAX : __s, NULL);                                 \
+	void	*__res = calloc(__n, __z);                                         \
 	ASSERT(__res, __CERR_M_AFAIL);                                             \
-	__CERR_CACHE_INSERT(__res);                                                \
+	__CERR_CACHE_INSERT(__res, __CERR_META(__s, __CERR_SITE()),                \
+		__CERR_EPOCH());                                                       \
 	__res;                                                                     \
 })
 
 # define REALLOC(P, S) ({                                                      \
 	void	*__res = NULL;                                                     \
 	void	*__prev = P;                                                       \
-	uint32_t __rm = !__prev || __CERR_CACHE_REMOVE(__prev);                    \
+	size_t	__s = S;                                                           \
+	uint32_t __ep = __CERR_EPOCH();                                            \
+	__CERR_BUDGET(__s, __prev);                                                \
+	uint32_t __rm = !__prev || __CERR_CACHE_REMOVE(__prev, &__ep);             \
 	ASSERT(__rm, __CERR_M_RFAIL, __prev);                                      \
-	__res = realloc(__prev, S);                                                \
+	(void)__rm;                                                                \
+	__res = realloc(__prev, __s);                                              \
 	ASSERT(__res, __CERR_M_AFAIL);                                             \
-	__CERR_CACHE_INSERT(__res);                                                \
+	__CERR_CACHE_INSERT(__res, __CERR_META(__s, __CERR_SITE()), __ep);         \
 	__res;                                                                     \
 })
 
@@ -61,61 +342,1751 @@ extern t_cerr_cache g__cerr_cache;
 	void	*__f = P;                                                          \
 	uint32_t __rm = 0;                                                         \
 	if (__builtin_expect(!__f, 0)) break;                                      \
-	__rm = __CERR_CACHE_REMOVE(__f);                                           \
+	__rm = __CERR_CACHE_REMOVE(__f, NULL);                                     \
 	if (__builtin_expect(__rm, 1))                                             \
 		free(__f);                                                             \
-	else LOG_WARN(__CERR_M_FFAIL, __f);                                        \
+	else LOG_WARN_RATELIMIT(__CERR_FFAIL_RATE, __CERR_M_FFAIL, __f);           \
 } while (0)
 
+# else
+# define MALLOC(S) ({                                                          \
+	size_t	__s = S;                                                           \
+	__CERR_BUDGET(__s, NULL);                                                  \
+	void	*__res = __cerr_shard_track(__cerr_shard_malloc(__s),              \
+		__CERR_META(__s, __CERR_SITE()), __CERR_EPOCH());                      \
+	ASSERT(__res, __CERR_M_AFAIL);                                             \
+	__res;                                                                     \
+})
+
+# define CALLOC(N, S) ({                                                       \
+	size_t	__s = 0;                                                           \
+	int		__o = __builtin_mul_overflow(N, S, &__s);                          \
+	__CERR_BUDGET(__o ? SIZE_MAX : __s, NULL);                                 \
+	void	*__res = __o ? NULL                                                \
+		: __cerr_shard_track(__cerr_shard_calloc(__s),                         \
+		__CERR_META(__s, __CERR_SITE()), __CERR_EPOCH());                      \
+	ASSERT(__res, __CERR_M_AFAIL);                                             \
+	__res;                                                                     \
+})
+
+# define REALLOC(P, S) ({                                                      \
+	void	*__res = NULL;                                                     \
+	void	*__prev = P;                                                       \
+	size_t	__s = S;                                                           \
+	uint32_t __rm = !__prev || __cerr_shard_owns(__prev);                      \
+	ASSERT(__rm, __CERR_M_RFAIL, __prev);                                      \
+	(void)__rm;                                                                \
+	__CERR_BUDGET(__s, __prev);                                                \
+	__res = __cerr_shard_realloc(__prev, __s, __CERR_SITE());                  \
+	ASSERT(__res, __CERR_M_AFAIL);                                             \
+	__res;                                                                     \
+})
+
+# define FREE(P) do {                                                          \
+	void	*__f = P;                                                          \
+	uint32_t __rm = 0;                                                         \
+	if (__builtin_expect(!__f, 0)) break;                                      \
+	__rm = __cerr_shard_free(__f);                                             \
+	if (__builtin_expect(!__rm, 0))                                            \
+		LOG_WARN_RATELIMIT(__CERR_FFAIL_RATE, __CERR_M_FFAIL, __f);            \
+} while (0)
+# endif
+
 // ╔══════════════════════════════════[ UTILS ]════════════════════════════════╗
 
-# define __CERR_M_FULL "libcerr: cache, limit reached, possible memory leak."
+# define __CERR_M_GFAIL "libcerr: cache, table growth failed, exiting safely."
 # define __CERR_M_AFAIL "libcerr: cache, alloc failed, exiting safely."
 # define __CERR_M_FFAIL "libcerr: cache, ignoring free on untracked pointer %p"
+# define __CERR_FFAIL_RATE	10
 # define __CERR_M_RFAIL "libcerr: cache, realloc on untracked pointer %p"
 # define __CERR_M_WEXIT "libcerr: cache exit, freed %u possible memory leak."
+# define __CERR_M_LEXIT "libcerr: cache exit, %u possible memory leak."
+# define __CERR_M_SITE "libcerr: cache, %s:%u holds %u blocks, %llu bytes."
+# define __CERR_M_YOUNG "libcerr: cache, %s:%u has %u new blocks, %llu bytes."
+# define __CERR_M_BUDGET "Allocation of %llu bytes over the budget of %llu"
+# define __CERR_M_TFAIL "libcerr: cache, cannot write the trace file %s."
 
-# define __CERR_MOD(X) ((X) & (CERR_CACHE_SIZE - 1))
+// Site ids 0 and __CERR_SITE_OTHER group unknown and unregistered sites
+# define __CERR_SITE_OTHER	((1u << 24) - 1)
 
-# define __CERR_CACHE_CLEAR() do {                                             \
-	for (uint32_t i = 0; i < CERR_CACHE_SIZE; ++i)                             \
-		free(g__cerr_cache.allocs[i]);                                         \
-	if (g__cerr_cache.len)                                                     \
-		LOG_WARN(__CERR_M_WEXIT, g__cerr_cache.len);                           \
-	g__cerr_cache = (t_cerr_cache){0};                                         \
-} while (0)
+_Static_assert(CERR_CACHE_SITES <= __CERR_SITE_OTHER, "CERR_CACHE_SITES");
 
-# define __CERR_CACHE_SEARCH(X, START) ({                                      \
-	void	*__x = X;                                                          \
-	uint32_t __i = START;                                                      \
-	uint32_t __c = 0;                                                          \
-	for (;g__cerr_cache.allocs[__i] != __x && __c < CERR_CACHE_SIZE; ++__c)    \
-		__i = __CERR_MOD(__i + 1);                                             \
-	__c < CERR_CACHE_SIZE ? __i : __c;                                         \
+// Id of the calling site, a single load once registered
+# define __CERR_SITE() ({                                                      \
+	static t_cerr_site __site = {__FILE__, __LINE__, 0};                       \
+	uint32_t __id = __atomic_load_n(&__site.id, __ATOMIC_RELAXED);             \
+	__builtin_expect(__id != 0, 1) ? __id : __cerr_site_register(&__site);     \
 })
 
-# define __CERR_CACHE_INSERT(P) ({                                             \
-	void	*__ptr = P;                                                        \
-	uint32_t __i = __CERR_CACHE_SEARCH(NULL, __CERR_MOD((uintptr_t)__ptr));    \
-	g__cerr_cache.allocs[__i] = __ptr;                                         \
-	++g__cerr_cache.len;                                                       \
-})
+// Throw CERR_E_NOMEM when SIZE more bytes, the block PREV given back, would
+// go over the budget
+# define __CERR_BUDGET(SIZE, PREV) do {                                        \
+	if (__builtin_expect(__cerr_over_budget((SIZE), (PREV)), 0))               \
+		THROW_MSG(CERR_E_NOMEM, __CERR_M_BUDGET, (unsigned long long)(SIZE),   \
+			(unsigned long long)g__cerr_budget);                               \
+} while (0)
 
-# define __CERR_CACHE_REMOVE(P) ({                                             \
-	void	*__ptr = P;                                                        \
-	uint32_t __i = __CERR_CACHE_SEARCH(__ptr, __CERR_MOD((uintptr_t)__ptr));   \
-	uint32_t __bool = __i < CERR_CACHE_SIZE;                                   \
-	if (__builtin_expect(__bool, 1)) {                                         \
-		g__cerr_cache.allocs[__i] = NULL;                                      \
-		--g__cerr_cache.len;                                                   \
-	} __bool;                                                                  \
-})
+// Size class of an allocation in the histogram
+# define __CERR_CLASS(SIZE)	((SIZE) ? 64 - __builtin_clzll(SIZE) : 0)
+
+// Size of a block and id of its site, packed in the word stored with it
+# define __CERR_META_BITS	40
+# define __CERR_META(SIZE, SITE)                                               \
+	(((uint64_t)(SIZE) & (((uint64_t)1 << __CERR_META_BITS) - 1))              \
+	| (uint64_t)(SITE) << __CERR_META_BITS)
+# define __CERR_META_SIZE(M)	((M) & (((uint64_t)1 << __CERR_META_BITS) - 1))
+# define __CERR_META_SITE(M)	((uint32_t)((M) >> __CERR_META_BITS))
+
+# define __CERR_MOD(X, CAP) ((X) & ((CAP) - 1))
+
+// Marks a slot of the migrating table that was moved or freed
+# define __CERR_TOMB ((void *)1)
+
+// Metas, epochs and occupancy bitmap stored after the CAP slots of table T
+# define __CERR_METAS(T, CAP)	((uint64_t *)((T) + (CAP)))
+# define __CERR_EPOCHS(T, CAP)	((uint32_t *)(__CERR_METAS(T, CAP) + (CAP)))
+# define __CERR_BITS(T, CAP)	((uint64_t *)(__CERR_EPOCHS(T, CAP) + (CAP)))
+# define __CERR_BIT_SET(T, CAP, I)                                             \
+	(__CERR_BITS(T, CAP)[(I) >> 6] |= (uint64_t)1 << ((I) & 63))
+# define __CERR_BIT_CLR(T, CAP, I)                                             \
+	(__CERR_BITS(T, CAP)[(I) >> 6] &= ~((uint64_t)1 << ((I) & 63)))
+
+// Tables of at least this size are aligned and backed by huge pages
+# define __CERR_HUGE_PAGE (2u << 20)
+
+// Block handed to free() for a tracked pointer
+# ifdef __CERR_SHARDS
+#  define __CERR_BLOCK(P)	((t_cerr_hdr *)(P) - 1)
+# else
+#  define __CERR_BLOCK(P)	(P)
+# endif
+
+// Fibonacci hashing, the high half of the product mixes every address bit,
+// so 16-byte or page aligned pointers still spread over all the slots.
+# define __CERR_HASH(P)                                                        \
+	((uint32_t)(((uint64_t)(uintptr_t)(P) * 0x9E3779B97F4A7C15ull) >> 32))
+
+// Distance of the pointer stored at slot I from its home slot
+# define __CERR_DIST(P, I, CAP) __CERR_MOD((I) - __CERR_HASH(P), CAP)
+
+// Cache of the calling thread, the only one outside of sharded mode
+# ifdef __CERR_SHARDS
+#  define __CERR_CACHE_SELF()	__cerr_shard()
+# else
+#  define __CERR_CACHE_SELF()	(&g__cerr_cache)
+# endif
+
+# define __CERR_CACHE_CLEAR()	__cerr_cache_clear()
+
+// Epoch a block allocated now records
+# define __CERR_EPOCH()	__atomic_load_n(&g__cerr_epoch, __ATOMIC_RELAXED)
+
+// ---- BYTES
+
+// A shard only touches the process total once its drift reaches the grain
+static inline void __cerr_mem_alloc(t_cerr_cache *c, uint64_t size) {
+	c->bytes += size;
+	++c->sizes[__CERR_CLASS(size)];
+# ifdef __CERR_SHARDS
+	if (__builtin_expect((c->unsent += size) >= CERR_CACHE_GRAIN, 0))
+		__cerr_mem_publish(c);
+# else
+	if (c->bytes > g__cerr_peak)
+		g__cerr_peak = c->bytes;
+# endif
+}
+
+static inline void __cerr_mem_free(t_cerr_cache *c, uint64_t size) {
+	c->bytes -= size;
+# ifdef __CERR_SHARDS
+	if (__builtin_expect((c->unsent -= size) <= -CERR_CACHE_GRAIN, 0))
+		__cerr_mem_publish(c);
+# endif
+}
+
+// ---- TRACE
+
+// Hooks of the entry points, the table of a shard is traced by the shard
+# ifdef CERR_CACHE_TRACE
+#  define __CERR_TRACE(OP, PTR, META)	__cerr_trace_event(OP, PTR, META)
+# else
+#  define __CERR_TRACE(OP, PTR, META)	((void)0)
+# endif
+# ifndef __CERR_SHARDS
+#  define __CERR_TRACE_TABLE(OP, PTR, META)	__CERR_TRACE(OP, PTR, META)
+# else
+#  define __CERR_TRACE_TABLE(OP, PTR, META)	((void)0)
+# endif
+
+// Time stamp counter where there is one, monotonic nanoseconds otherwise
+static inline uint64_t __cerr_trace_now(void) {
+# if defined(__x86_64__) || defined(__i386__)
+	return __builtin_ia32_rdtsc();
+# else
+	struct timespec	ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec * 1000000000ull + (uint64_t)ts.tv_nsec;
+# endif
+}
+
+# ifdef CERR_CACHE_TRACE
+static inline void __cerr_trace_event(uint32_t op, const void *ptr,
+	uint64_t meta) {
+	if (__builtin_expect(g__cerr_trace_cur == g__cerr_trace_lim, 0)
+		&& !__cerr_trace_chunk())
+		return;
+	*g__cerr_trace_cur++ = (t_cerr_event){__cerr_trace_now(),
+		(uintptr_t)ptr, meta, op, g__cerr_trace_tid};
+}
+# endif
+
+# ifndef CERR_CACHE_INTRUSIVE
+# define __CERR_CACHE_FIND(P)	__cerr_cache_find(__CERR_CACHE_SELF(), P)
+# define __CERR_CACHE_INSERT(P, META, EPOCH)                                   \
+	__cerr_cache_insert(__CERR_CACHE_SELF(), P, META, EPOCH)
+# define __CERR_CACHE_REMOVE(P, EPOCH)                                         \
+	__cerr_cache_remove(__CERR_CACHE_SELF(), P, EPOCH)
+
+// Robin Hood linear probing: an insert takes the slot of any resident closer
+// to its home, which keeps probe lengths short and lets a lookup stop at the
+// first empty slot or at the first resident closer to home than itself.
+static inline void **__cerr_table_find(void **t, uint32_t cap,
+	const void *ptr) {
+	uint32_t	i = __CERR_MOD(__CERR_HASH(ptr), cap);
+	void		*cur;
+
+	for (uint32_t d = 0; d < cap; ++d, i = __CERR_MOD(i + 1, cap)) {
+		cur = t[i];
+		if (cur == ptr)
+			return t + i;
+		if (!cur || (cur != __CERR_TOMB && __CERR_DIST(cur, i, cap) < d))
+			break;
+	}
+	return NULL;
+}
+
+// Returns the number of occupied slots it went through
+static inline uint32_t __cerr_table_insert(void **t, uint32_t cap, void *ptr,
+	uint64_t meta, uint32_t epoch) {
+	uint64_t	*metas = __CERR_METAS(t, cap);
+	uint32_t	*epochs = __CERR_EPOCHS(t, cap);
+	uint32_t	i = __CERR_MOD(__CERR_HASH(ptr), cap);
+	uint32_t	d = 0;
+	uint32_t	probes = 0;
+	uint32_t	cd;
+	uint64_t	cm;
+	uint32_t	ce;
+	void		*cur;
+
+	while ((cur = t[i])) {
+		cd = __CERR_DIST(cur, i, cap);
+		if (cd < d) {
+			t[i] = ptr;
+			ptr = cur;
+			cm = metas[i];
+			metas[i] = meta;
+			meta = cm;
+			ce = epochs[i];
+			epochs[i] = epoch;
+			epoch = ce;
+			d = cd;
+		}
+		i = __CERR_MOD(i + 1, cap);
+		++d;
+		++probes;
+	}
+	t[i] = ptr;
+	metas[i] = meta;
+	epochs[i] = epoch;
+	__CERR_BIT_SET(t, cap, i);
+	return probes;
+}
+
+// Backward shift deletion: no tombstones, the following displaced entries
+// move one slot closer to home so lookups can keep stopping early.
+static inline void __cerr_table_erase(void **t, uint32_t cap, uint32_t i) {
+	uint64_t	*metas = __CERR_METAS(t, cap);
+	uint32_t	*epochs = __CERR_EPOCHS(t, cap);
+	uint32_t	j;
+	void		*cur;
+
+	for (j = __CERR_MOD(i + 1, cap); (cur = t[j])
+		&& __CERR_DIST(cur, j, cap); j = __CERR_MOD(j + 1, cap)) {
+		t[i] = cur;
+		metas[i] = metas[j];
+		epochs[i] = epochs[j];
+		i = j;
+	}
+	t[i] = NULL;
+	__CERR_BIT_CLR(t, cap, i);
+}
+
+// Slot holding ptr in the live or the migrating table, NULL if untracked
+static inline void **__cerr_cache_find(t_cerr_cache *c, const void *ptr) {
+	void	**slot = __cerr_table_find(c->allocs, c->cap, ptr);
+
+	if (!slot && c->old)
+		slot = __cerr_table_find(c->old, c->old_cap, ptr);
+	return slot;
+}
+
+// A block of epoch 0 is older than any checkpoint and is not journaled. The
+// others are, under the current epoch so the journal stays in order: a diff
+// reads from its checkpoint on, then filters on the epoch of the slot.
+static inline void __cerr_cache_insert(t_cerr_cache *c, void *ptr,
+	uint64_t meta, uint32_t epoch) {
+	if (__builtin_expect(c->old != NULL, 0))
+		__cerr_cache_migrate(c);
+	if (__builtin_expect(c->len >= c->cap / 2, 0))
+		__cerr_cache_grow(c);
+	__CERR_STAT_PROBE(__cerr_table_insert(c->allocs, c->cap, ptr, meta, epoch));
+	__CERR_STAT_ALLOC(__CERR_META_SIZE(meta));
+	__cerr_mem_alloc(c, __CERR_META_SIZE(meta));
+	__CERR_TRACE_TABLE(__CERR_T_ALLOC, ptr, meta);
+	++c->len;
+	if (__builtin_expect(epoch != 0, 0))
+		__cerr_young_add(c, ptr, __CERR_EPOCH());
+}
+
+// Meta of the block at slot, in the live or the migrating table
+static inline uint64_t __cerr_cache_meta(t_cerr_cache *c, void **slot) {
+	if (__builtin_expect(slot >= c->allocs && slot < c->allocs + c->cap, 1))
+		return __CERR_METAS(c->allocs, c->cap)[slot - c->allocs];
+	return __CERR_METAS(c->old, c->old_cap)[slot - c->old];
+}
+
+// Epoch of the block at slot, in the live or the migrating table
+static inline uint32_t __cerr_cache_epoch(t_cerr_cache *c, void **slot) {
+	if (__builtin_expect(slot >= c->allocs && slot < c->allocs + c->cap, 1))
+		return __CERR_EPOCHS(c->allocs, c->cap)[slot - c->allocs];
+	return __CERR_EPOCHS(c->old, c->old_cap)[slot - c->old];
+}
+
+// The migrating table is frozen: entries found there only become tombstones
+static inline void __cerr_cache_erase(t_cerr_cache *c, void **slot) {
+	uint64_t	size = __CERR_META_SIZE(__cerr_cache_meta(c, slot));
+
+	__CERR_STAT_FREE(size);
+	__cerr_mem_free(c, size);
+	if (__builtin_expect(slot >= c->allocs && slot < c->allocs + c->cap, 1)) {
+		__cerr_table_erase(c->allocs, c->cap, slot - c->allocs);
+	} else {
+		*slot = __CERR_TOMB;
+		__CERR_BIT_CLR(c->old, c->old_cap, slot - c->old);
+	}
+	--c->len;
+}
+
+// The epoch of the block goes to epoch unless it is NULL
+static inline uint32_t __cerr_cache_remove(t_cerr_cache *c, const void *ptr,
+	uint32_t *epoch) {
+	void	**slot = __cerr_cache_find(c, ptr);
+
+	if (__builtin_expect(!slot, 0))
+		return 0;
+	if (epoch)
+		*epoch = __cerr_cache_epoch(c, slot);
+	__CERR_TRACE_TABLE(__CERR_T_FREE, ptr, __cerr_cache_meta(c, slot));
+	__cerr_cache_erase(c, slot);
+	return 1;
+}
+# endif
+
+# ifdef __CERR_SHARDS
+// ---- SHARDS
+
+# define __CERR_S_USED	1
+# define __CERR_S_FREE	2
+
+// Header tag, cleared by whoever wins the right to release the block. Its
+// high bits are set, a user space pointer is never taken for one.
+# define __CERR_TAG(H)	((uintptr_t)(H) ^ (uintptr_t)0x6c69626365727221ull)
+
+// Smallest page size. The header of a tracked block never crosses a multiple
+// of it, so checking a pointer only reads the page the pointer is in.
+# define __CERR_PAGE_MIN	4096
+# define __CERR_HDR_CROSSES(P)                                                 \
+	((uintptr_t)(P) % __CERR_PAGE_MIN < sizeof(t_cerr_hdr))
+
+// A header at the start of a 64-byte line ends in that line
+_Static_assert(sizeof(t_cerr_hdr) < 64, "t_cerr_hdr");
+
+t_cerr_hdr	*__cerr_shard_move(t_cerr_hdr *hdr, size_t size);
+
+// Shard of the calling thread, attached on first use, remote frees drained
+static inline t_cerr_cache *__cerr_shard(void) {
+	t_cerr_cache	*c = g__cerr_shard;
+
+	if (__builtin_expect(!c, 0))
+		c = __cerr_shard_attach();
+	if (__builtin_expect(__atomic_load_n(&c->remote, __ATOMIC_RELAXED) != 0, 0))
+		__cerr_shard_drain(c);
+	return c;
+}
+
+// Whether ptr is a block tracked by a shard. A misaligned pointer or one
+// whose header would cross a page is rejected unread, only the tag of the
+// others is loaded. Stack or foreign heap pointers are read on purpose, out
+// of reach of the address sanitizer.
+__attribute__((no_sanitize_address))
+static inline int __cerr_shard_owns(void *ptr) {
+	t_cerr_hdr	*hdr = (t_cerr_hdr *)ptr - 1;
+
+	if ((uintptr_t)ptr % _Alignof(t_cerr_hdr) || __CERR_HDR_CROSSES(ptr))
+		return 0;
+	return __atomic_load_n(&hdr->tag, __ATOMIC_ACQUIRE) == __CERR_TAG(hdr);
+}
+
+// Win the right to release a tracked block, the tag is only written once it
+// matched, never for an untracked or already released pointer
+static inline int __cerr_shard_claim(void *ptr) {
+	t_cerr_hdr	*hdr = (t_cerr_hdr *)ptr - 1;
+	uintptr_t	tag = __CERR_TAG(hdr);
+
+	return __cerr_shard_owns(ptr) && __atomic_compare_exchange_n(&hdr->tag,
+		&tag, 0, 0, __ATOMIC_ACQ_REL, __ATOMIC_RELAXED);
+}
+
+// Orders the busy flag of the owner before its check of held
+static inline void __cerr_shard_raise(t_cerr_cache *c) {
+	__atomic_store_n(&c->busy, 1, __ATOMIC_RELAXED);
+	if (__builtin_expect(g__cerr_shard_fence, 0))
+		__atomic_thread_fence(__ATOMIC_SEQ_CST);
+	else
+		__atomic_signal_fence(__ATOMIC_SEQ_CST);
+}
+
+// Taken by the owner around every change to its blocks. Only a diff or a
+// report ever holds a shard from another thread, so the owner raises busy
+// then checks held without any atomic instruction, and the reader raises held
+// then makes every thread run a full barrier before it checks busy.
+static inline void __cerr_shard_lock(t_cerr_cache *c) {
+	__cerr_shard_raise(c);
+	if (__builtin_expect(__atomic_load_n(&c->held, __ATOMIC_ACQUIRE), 0))
+		__cerr_shard_wait(c);
+}
+
+static inline void __cerr_shard_unlock(t_cerr_cache *c) {
+	__atomic_store_n(&c->busy, 0, __ATOMIC_RELEASE);
+}
+
+// Start tracking a block in the shard c. The intrusive list stays newest
+// first: the search starts after prev, from the head when it is NULL, where
+// a fresh block goes right away.
+static inline void __cerr_shard_link(t_cerr_cache *c, t_cerr_hdr *hdr,
+	t_cerr_hdr *prev) {
+#  ifdef CERR_CACHE_INTRUSIVE
+	t_cerr_hdr	*next = prev ? prev->lnext : c->live;
+
+	while (__builtin_expect(next && next->epoch > hdr->epoch, 0)) {
+		prev = next;
+		next = next->lnext;
+	}
+	hdr->lprev = prev;
+	hdr->lnext = next;
+	if (prev)
+		prev->lnext = hdr;
+	else
+		c->live = hdr;
+	if (next)
+		next->lprev = hdr;
+	++c->len;
+	__CERR_STAT_ALLOC(__CERR_META_SIZE(hdr->meta));
+	__cerr_mem_alloc(c, __CERR_META_SIZE(hdr->meta));
+#  else
+	(void)prev;
+	__cerr_cache_insert(c, hdr + 1, hdr->meta, (uint32_t)hdr->epoch);
+#  endif
+}
+
+// Stop tracking a block if the shard c owns it, 0 when it belongs elsewhere
+static inline uint32_t __cerr_shard_unlink(t_cerr_cache *c, t_cerr_hdr *hdr) {
+#  ifdef CERR_CACHE_INTRUSIVE
+	if (__builtin_expect(hdr->owner != c, 0))
+		return 0;
+	if (hdr->lprev)
+		hdr->lprev->lnext = hdr->lnext;
+	else
+		c->live = hdr->lnext;
+	if (hdr->lnext)
+		hdr->lnext->lprev = hdr->lprev;
+	--c->len;
+	__CERR_STAT_FREE(__CERR_META_SIZE(hdr->meta));
+	__cerr_mem_free(c, __CERR_META_SIZE(hdr->meta));
+	return 1;
+#  else
+	return __cerr_cache_remove(c, hdr + 1, NULL);
+#  endif
+}
+
+// Track a block in the shard c, held by the caller. A header crossing a page
+// is moved first.
+static inline void *__cerr_shard_put(t_cerr_cache *c, t_cerr_hdr *hdr,
+	uint64_t meta, uint32_t epoch, t_cerr_hdr *prev) {
+	if (__builtin_expect(__CERR_HDR_CROSSES(hdr + 1), 0)
+		&& !(hdr = __cerr_shard_move(hdr, __CERR_META_SIZE(meta))))
+		return NULL;
+	hdr->owner = c;
+	hdr->epoch = epoch;
+	hdr->meta = meta;
+	__atomic_store_n(&hdr->tag, __CERR_TAG(hdr), __ATOMIC_RELEASE);
+	__cerr_shard_link(c, hdr, prev);
+	__CERR_TRACE(__CERR_T_ALLOC, hdr + 1, meta);
+	return hdr + 1;
+}
+
+// Size of a block and its header in len, ENOMEM like malloc when it overflows
+static inline int __cerr_hdr_len(size_t size, size_t *len) {
+	if (__builtin_expect(!__builtin_add_overflow(size, sizeof(t_cerr_hdr), len),
+		1))
+		return 1;
+	errno = ENOMEM;
+	return 0;
+}
+
+static inline t_cerr_hdr *__cerr_shard_malloc(size_t size) {
+	size_t	len;
+
+	return __cerr_hdr_len(size, &len) ? malloc(len) : NULL;
+}
+
+static inline t_cerr_hdr *__cerr_shard_calloc(size_t size) {
+	size_t	len;
+
+	return __cerr_hdr_len(size, &len) ? calloc(1, len) : NULL;
+}
+
+static inline void *__cerr_shard_track(t_cerr_hdr *hdr, uint64_t meta,
+	uint32_t epoch) {
+	t_cerr_cache	*c;
+	void			*res;
+
+	if (__builtin_expect(!hdr, 0))
+		return NULL;
+	c = __cerr_shard();
+	__cerr_shard_lock(c);
+	res = __cerr_shard_put(c, hdr, meta, epoch, NULL);
+	__cerr_shard_unlock(c);
+	return res;
+}
+
+// Hand a claimed block of another shard over to its owner, or release it
+// right away when the owner has exited
+static inline void __cerr_shard_remote(t_cerr_hdr *hdr) {
+	t_cerr_cache	*owner = hdr->owner;
+	t_cerr_hdr		*head = __atomic_load_n(&owner->remote, __ATOMIC_RELAXED);
+
+	do {
+		__atomic_store_n(&hdr->tag, (uintptr_t)head, __ATOMIC_RELAXED);
+	} while (!__atomic_compare_exchange_n(&owner->remote, &head, hdr, 1,
+		__ATOMIC_SEQ_CST, __ATOMIC_RELAXED));
+	if (__builtin_expect(__atomic_load_n(&owner->state, __ATOMIC_SEQ_CST)
+		== __CERR_S_FREE, 0))
+		__cerr_shard_reclaim(owner);
+}
+
+static inline uint32_t __cerr_shard_free(void *ptr) {
+	t_cerr_cache	*c = __cerr_shard();
+	t_cerr_hdr		*hdr = (t_cerr_hdr *)ptr - 1;
+	uint32_t		own;
+
+	if (!__cerr_shard_claim(ptr))
+		return 0;
+	__CERR_TRACE(__CERR_T_FREE, ptr, hdr->meta);
+	__cerr_shard_lock(c);
+	own = __cerr_shard_unlink(c, hdr);
+	__cerr_shard_unlock(c);
+	if (__builtin_expect(own, 1))
+		free(hdr);
+	else
+		__cerr_shard_remote(hdr);
+	return 1;
+}
+
+// The block keeps its epoch, and its place in the intrusive list. A block
+// owned by another shard is copied, its owner releases the original.
+static inline void *__cerr_shard_realloc(void *ptr, size_t size,
+	uint32_t site) {
+	t_cerr_cache	*c = __cerr_shard();
+	t_cerr_hdr		*hdr = (t_cerr_hdr *)ptr - 1;
+	t_cerr_hdr		*prev = NULL;
+	uint64_t		meta = __CERR_META(size, site);
+	uint64_t		old;
+	uint32_t		epoch;
+	t_cerr_hdr		*blk;
+	void			*res;
+	size_t			len;
+
+	if (!ptr)
+		return __cerr_shard_track(__cerr_shard_malloc(size), meta,
+			__CERR_EPOCH());
+	if (!__cerr_hdr_len(size, &len) || !__cerr_shard_claim(ptr))
+		return NULL;
+	old = hdr->meta;
+	epoch = (uint32_t)hdr->epoch;
+	__CERR_TRACE(__CERR_T_FREE, ptr, old);
+	__cerr_shard_lock(c);
+#  ifdef CERR_CACHE_INTRUSIVE
+	if (hdr->owner == c)
+		prev = hdr->lprev;
+#  endif
+	if (__builtin_expect(__cerr_shard_unlink(c, hdr), 1)) {
+		// On failure the original is tracked again, untouched
+		blk = realloc(hdr, len);
+		res = __cerr_shard_put(c, blk ? blk : hdr, blk ? meta : old, epoch,
+			prev);
+		__cerr_shard_unlock(c);
+		return blk ? res : NULL;
+	}
+	__cerr_shard_unlock(c);
+	res = __cerr_shard_track(malloc(len), meta, epoch);
+	if (__builtin_expect(!res, 0)) {
+		// The original was never unlinked, its owner gets it back untouched
+		__CERR_TRACE(__CERR_T_ALLOC, ptr, old);
+		__atomic_store_n(&hdr->tag, __CERR_TAG(hdr), __ATOMIC_RELEASE);
+		return NULL;
+	}
+	old = __CERR_META_SIZE(old);
+	memcpy(res, ptr, old < size ? old : size);
+	__cerr_shard_remote(hdr);
+	return res;
+}
+# endif
+
+// ---- BUDGET
+
+// Bytes of the process seen from the calling thread, the other shards may
+// each hold up to a grain more or less
+static inline uint64_t __cerr_mem_live(t_cerr_cache *c) {
+# ifdef __CERR_SHARDS
+	return __atomic_load_n(&g__cerr_live, __ATOMIC_RELAXED) + c->unsent;
+# else
+	return c->bytes;
+# endif
+}
+
+// Size of a tracked block, 0 for NULL or an untracked pointer
+static inline uint64_t __cerr_block_size(t_cerr_cache *c, void *ptr) {
+# ifdef __CERR_SHARDS
+	(void)c;
+	if (!ptr || !__cerr_shard_owns(ptr))
+		return 0;
+	return __CERR_META_SIZE(((t_cerr_hdr *)ptr - 1)->meta);
+# else
+	void	**slot = ptr ? __cerr_cache_find(c, ptr) : NULL;
+
+	return slot ? __CERR_META_SIZE(__cerr_cache_meta(c, slot)) : 0;
+# endif
+}
+
+// Whether size more bytes, prev given back, would go over the budget.
+// A single load while there is none. A size too large to be added is over.
+static inline int __cerr_over_budget(uint64_t size, void *prev) {
+	uint64_t		budget = __atomic_load_n(&g__cerr_budget, __ATOMIC_RELAXED);
+	t_cerr_cache	*c;
+	uint64_t		need;
+	uint64_t		room;
+
+	if (__builtin_expect(!budget, 1))
+		return 0;
+	c = __CERR_CACHE_SELF();
+	if (__builtin_add_overflow(__cerr_mem_live(c), size, &need))
+		return 1;
+	return !__builtin_add_overflow(budget, __cerr_block_size(c, prev), &room)
+		&& need > room;
+}
 
 # ifdef CERR_IMPLEMENTATION
-t_cerr_cache g__cerr_cache = {.allocs={0}, .len=0};
+#  ifdef __CERR_SHARDS
+#   include <pthread.h>
+#   if defined(__linux__) && __has_include(<linux/membarrier.h>)
+#    include <linux/membarrier.h>
+#    include <sys/syscall.h>
+#    define __CERR_MEMBARRIER(CMD)	syscall(SYS_membarrier, CMD, 0)
+#   else
+#    define __CERR_MEMBARRIER(CMD)	-1
+#   endif
+
+CERR_TLS t_cerr_cache *g__cerr_shard = NULL;
+t_cerr_cache *g__cerr_shards = NULL;
+
+uint64_t g__cerr_live = 0;
+uint64_t g__cerr_peak = 0;
+
+static pthread_key_t g__cerr_shard_key;
+static pthread_once_t g__cerr_shard_once = PTHREAD_ONCE_INIT;
+
+uint32_t g__cerr_shard_fence = 1;
+
+// The owner steps aside while a reader holds its shard
+void __cerr_shard_wait(t_cerr_cache *c) {
+	do {
+		__atomic_store_n(&c->busy, 0, __ATOMIC_RELEASE);
+		while (__atomic_load_n(&c->held, __ATOMIC_RELAXED))
+			sched_yield();
+		__cerr_shard_raise(c);
+	} while (__atomic_load_n(&c->held, __ATOMIC_ACQUIRE));
+}
+
+// Read a shard from any thread: once every thread ran a barrier, either the
+// owner sees held or its busy is visible here
+static void __cerr_shard_hold(t_cerr_cache *c) {
+	while (__atomic_exchange_n(&c->held, 1, __ATOMIC_ACQUIRE))
+		sched_yield();
+	if (g__cerr_shard_fence
+		|| __CERR_MEMBARRIER(MEMBARRIER_CMD_PRIVATE_EXPEDITED) != 0)
+		__atomic_thread_fence(__ATOMIC_SEQ_CST);
+	while (__atomic_load_n(&c->busy, __ATOMIC_ACQUIRE))
+		sched_yield();
+}
+
+static void __cerr_shard_release(t_cerr_cache *c) {
+	__atomic_store_n(&c->held, 0, __ATOMIC_RELEASE);
+}
+#  else
+t_cerr_cache g__cerr_cache = {0};
+uint64_t g__cerr_peak = 0;
+#  endif
+
+// Budget until cerr_cache_budget() changes it, 0 for no limit
+#  ifndef CERR_CACHE_BUDGET
+#   define CERR_CACHE_BUDGET 0
+#  endif
+
+t_cerr_site *g__cerr_sites[CERR_CACHE_SITES] = {0};
+uint32_t g__cerr_sites_len = 0;
+uint32_t g__cerr_epoch = 0;
+uint64_t g__cerr_budget = CERR_CACHE_BUDGET;
+
+// Racing threads may both register a site, only the id kept is ever used
+uint32_t __cerr_site_register(t_cerr_site *site) {
+	uint32_t	id = __atomic_add_fetch(&g__cerr_sites_len, 1,
+		__ATOMIC_RELAXED);
+	uint32_t	cur = 0;
+
+	if (id < CERR_CACHE_SITES)
+		__atomic_store_n(&g__cerr_sites[id], site, __ATOMIC_RELEASE);
+	else
+		id = __CERR_SITE_OTHER;
+	if (!__atomic_compare_exchange_n(&site->id, &cur, id, 0,
+		__ATOMIC_RELAXED, __ATOMIC_RELAXED))
+		return cur;
+	return id;
+}
+
+#  ifndef CERR_CACHE_INTRUSIVE
+// Slots, metas, epochs and bitmap, rounded to whole pages so the tail can be
+// unmapped
+static inline size_t __cerr_table_size(uint32_t cap) {
+	size_t	page = (size_t)sysconf(_SC_PAGESIZE);
+
+	return ((size_t)cap * (sizeof(void *) + sizeof(uint64_t)
+		+ sizeof(uint32_t)) + cap / 8
+		+ page - 1) & ~(page - 1);
+}
+
+// Anonymous mappings come zeroed, large ones are aligned on a huge page
+static void **__cerr_table_alloc(uint32_t cap) {
+	size_t		size = __cerr_table_size(cap);
+	uintptr_t	map;
+	uintptr_t	aligned;
+	void		*t;
+
+	if (size < __CERR_HUGE_PAGE) {
+		t = mmap(NULL, size, PROT_READ | PROT_WRITE,
+			MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+		return t == MAP_FAILED ? NULL : t;
+	}
+	t = mmap(NULL, size + __CERR_HUGE_PAGE, PROT_READ | PROT_WRITE,
+		MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+	if (t == MAP_FAILED)
+		return NULL;
+	map = (uintptr_t)t;
+	aligned = (map + __CERR_HUGE_PAGE - 1) & ~(uintptr_t)(__CERR_HUGE_PAGE - 1);
+	if (aligned != map)
+		munmap(t, aligned - map);
+	if (aligned + size != map + size + __CERR_HUGE_PAGE)
+		munmap((void *)(aligned + size), map + __CERR_HUGE_PAGE - aligned);
+#  ifdef MADV_HUGEPAGE
+	madvise((void *)aligned, size, MADV_HUGEPAGE);
+#  endif
+	return (void **)aligned;
+}
+
+static void __cerr_table_free(void **t, uint32_t cap) {
+	if (t)
+		munmap(t, __cerr_table_size(cap));
+}
+
+// Move the next CERR_CACHE_STEP slots of the old table to the live one
+void __cerr_cache_migrate(t_cerr_cache *c) {
+	uint32_t		end = c->old_cap - c->cursor > CERR_CACHE_STEP
+		? c->cursor + CERR_CACHE_STEP : c->old_cap;
+	void			*cur;
+
+	for (; c->cursor < end; ++c->cursor) {
+		cur = c->old[c->cursor];
+		if (!cur || cur == __CERR_TOMB)
+			continue;
+		__cerr_table_insert(c->allocs, c->cap, cur,
+			__CERR_METAS(c->old, c->old_cap)[c->cursor],
+			__CERR_EPOCHS(c->old, c->old_cap)[c->cursor]);
+		c->old[c->cursor] = __CERR_TOMB;
+		__CERR_BIT_CLR(c->old, c->old_cap, c->cursor);
+	}
+	if (c->cursor == c->old_cap) {
+		__cerr_table_free(c->old, c->old_cap);
+		c->old = NULL;
+		c->old_cap = 0;
+		c->cursor = 0;
+	}
+}
+
+// Start a new table twice as large, the current one becomes the old table
+void __cerr_cache_grow(t_cerr_cache *c) {
+	uint32_t		cap = c->cap ? c->cap * 2 : CERR_CACHE_SIZE;
+	void			**t;
+
+	while (c->old)
+		__cerr_cache_migrate(c);
+	t = __cerr_table_alloc(cap);
+	ASSERT(t, __CERR_M_GFAIL);
+	c->old = c->allocs;
+	c->old_cap = c->cap;
+	c->cursor = 0;
+	c->allocs = t;
+	c->cap = cap;
+}
+
+// Free the blocks of a table through its bitmap, stopping after the last one
+static uint32_t __cerr_table_release(void **t, uint32_t cap, uint32_t len) {
+	uint64_t	*bits = __CERR_BITS(t, cap);
+	uint32_t	freed = 0;
+
+	for (uint32_t w = 0; freed < len && w < cap / 64; ++w)
+		for (uint64_t b = bits[w]; b; b &= b - 1, ++freed)
+			free(__CERR_BLOCK(t[w * 64 + __builtin_ctzll(b)]));
+	return freed;
+}
+
+// Free every block still tracked by c and release its tables
+static uint32_t __cerr_cache_release(t_cerr_cache *c) {
+	uint32_t	len = c->len;
+	uint32_t	left = len;
+
+	if (left && c->old)
+		left -= __cerr_table_release(c->old, c->old_cap, left);
+	if (left)
+		__cerr_table_release(c->allocs, c->cap, left);
+	__cerr_table_free(c->allocs, c->cap);
+	__cerr_table_free(c->old, c->old_cap);
+	free(c->young);
+	c->allocs = c->old = NULL;
+	c->young = NULL;
+	c->cap = c->old_cap = c->cursor = c->len = 0;
+	c->young_len = c->young_cap = 0;
+	return len;
+}
+
+// ---- YOUNG JOURNAL
+
+// Adds ptr to the set of size cap, 0 if it was already there
+static int __cerr_seen_add(void **set, uint32_t cap, void *ptr) {
+	uint32_t	i = __CERR_MOD(__CERR_HASH(ptr), cap);
+
+	for (; set[i]; i = __CERR_MOD(i + 1, cap))
+		if (set[i] == ptr)
+			return 0;
+	set[i] = ptr;
+	return 1;
+}
+
+// Keep the records from the index from whose block is still tracked, only
+// the newest one of each address, in their order. The older records of a
+// reused address are the blocks freed before it came back.
+static void __cerr_young_compact(t_cerr_cache *c, uint32_t from) {
+	uint32_t		cap = 16;
+	uint32_t		keep = c->young_len;
+	t_cerr_young	*y = c->young;
+	void			**seen;
+
+	while (cap < 2 * (c->young_len - from))
+		cap *= 2;
+	if (!(seen = calloc(cap, sizeof(void *))))
+		return;
+	for (uint32_t i = c->young_len; i-- > from; )
+		if (__cerr_cache_find(c, y[i].ptr)
+			&& __cerr_seen_add(seen, cap, y[i].ptr))
+			y[--keep] = y[i];
+	memmove(y + from, y + keep, (c->young_len - keep) * sizeof(t_cerr_young));
+	c->young_len = from + (c->young_len - keep);
+	free(seen);
+}
+
+// A full journal is compacted first, and only doubles if it stays half full.
+// A record that cannot be kept is dropped, its block then never shows up.
+void __cerr_young_add(t_cerr_cache *c, void *ptr, uint32_t epoch) {
+	uint32_t		cap = c->young_cap ? c->young_cap * 2 : CERR_CACHE_SIZE;
+	t_cerr_young	*y;
+
+	if (c->young_len == c->young_cap) {
+		__cerr_young_compact(c, 0);
+		if (c->young_len >= c->young_cap / 2) {
+			if (!(y = realloc(c->young, cap * sizeof(t_cerr_young))))
+				return;
+			c->young = y;
+			c->young_cap = cap;
+		}
+	}
+	c->young[c->young_len++] = (t_cerr_young){ptr, epoch};
+}
+
+// First record of the epoch or a later one, the journal is in epoch order
+static uint32_t __cerr_young_from(t_cerr_cache *c, uint32_t epoch) {
+	uint32_t	lo = 0;
+	uint32_t	hi = c->young_len;
+	uint32_t	mid;
+
+	while (lo < hi) {
+		mid = lo + (hi - lo) / 2;
+		if (c->young[mid].epoch < epoch)
+			lo = mid + 1;
+		else
+			hi = mid;
+	}
+	return lo;
+}
+#  else
+// Free every block still linked in c, only live blocks are visited
+static uint32_t __cerr_cache_release(t_cerr_cache *c) {
+	uint32_t	len = c->len;
+	t_cerr_hdr	*next;
+
+	for (t_cerr_hdr *hdr = c->live; hdr; hdr = next) {
+		next = hdr->lnext;
+		free(hdr);
+	}
+	c->live = NULL;
+	c->len = 0;
+	return len;
+}
+#  endif
+
+// ---- SITE REPORT
+
+typedef struct s_cerr_usage {
+	uint64_t	bytes;
+	uint32_t	blocks;
+	uint32_t	site;
+}	t_cerr_usage;
+
+static inline void __cerr_usage_add(t_cerr_usage *u, uint32_t n,
+	uint64_t meta) {
+	uint32_t	site = __CERR_META_SITE(meta);
+
+	u += site < n - 1 ? site : n - 1;
+	u->bytes += __CERR_META_SIZE(meta);
+	++u->blocks;
+}
+
+#  ifndef CERR_CACHE_INTRUSIVE
+static void __cerr_usage_table(t_cerr_usage *u, uint32_t n, void **t,
+	uint32_t cap) {
+	uint64_t	*bits;
+
+	if (!t)
+		return;
+	bits = __CERR_BITS(t, cap);
+	for (uint32_t w = 0; w < cap / 64; ++w)
+		for (uint64_t b = bits[w]; b; b &= b - 1)
+			__cerr_usage_add(u, n,
+				__CERR_METAS(t, cap)[w * 64 + __builtin_ctzll(b)]);
+}
+
+static void __cerr_usage_cache(t_cerr_usage *u, uint32_t n, t_cerr_cache *c) {
+	if (!c->len)
+		return;
+	__cerr_usage_table(u, n, c->allocs, c->cap);
+	__cerr_usage_table(u, n, c->old, c->old_cap);
+}
+#  else
+static void __cerr_usage_cache(t_cerr_usage *u, uint32_t n, t_cerr_cache *c) {
+	for (t_cerr_hdr *hdr = c->live; hdr; hdr = hdr->lnext)
+		__cerr_usage_add(u, n, hdr->meta);
+}
+#  endif
+
+static int __cerr_usage_cmp(const void *a, const void *b) {
+	const t_cerr_usage	*x = a;
+	const t_cerr_usage	*y = b;
+
+	return (x->bytes < y->bytes) - (x->bytes > y->bytes);
+}
+
+// One entry per registered site plus a last one for the other sites
+static t_cerr_usage *__cerr_usage_new(uint32_t *n) {
+	uint32_t		len = __atomic_load_n(&g__cerr_sites_len, __ATOMIC_ACQUIRE);
+	t_cerr_usage	*u;
+
+	*n = (len < CERR_CACHE_SITES ? len + 1 : CERR_CACHE_SITES) + 1;
+	if (!(u = calloc(*n, sizeof(t_cerr_usage))))
+		return NULL;
+	for (uint32_t i = 0; i < *n; ++i)
+		u[i].site = i;
+	return u;
+}
+
+// Log the sites holding blocks, largest first, young ones since a checkpoint
+static void __cerr_usage_log(t_cerr_usage *u, uint32_t n, int young) {
+	t_cerr_site		*site __attribute__((unused));
+
+	qsort(u, n, sizeof(t_cerr_usage), __cerr_usage_cmp);
+	for (uint32_t i = 0; i < n && u[i].blocks; ++i) {
+		site = u[i].site < n - 1 ? g__cerr_sites[u[i].site] : NULL;
+		if (young)
+			LOG_WARN(__CERR_M_YOUNG, site ? site->file : u[i].site ? "other"
+				: "?", site ? site->line : 0, u[i].blocks,
+				(unsigned long long)u[i].bytes);
+		else
+			LOG_WARN(__CERR_M_SITE, site ? site->file : u[i].site ? "other"
+				: "?", site ? site->line : 0, u[i].blocks,
+				(unsigned long long)u[i].bytes);
+	}
+}
+
+void __cerr_cache_report(void) {
+	uint32_t		n;
+	t_cerr_usage	*u = __cerr_usage_new(&n);
+
+	if (!u)
+		return;
+#  ifdef __CERR_SHARDS
+	for (t_cerr_cache *c = __atomic_load_n(&g__cerr_shards, __ATOMIC_ACQUIRE);
+		c; c = c->link) {
+		__cerr_shard_hold(c);
+		__cerr_usage_cache(u, n, c);
+		__cerr_shard_release(c);
+	}
+#  else
+	__cerr_usage_cache(u, n, &g__cerr_cache);
+#  endif
+	__cerr_usage_log(u, n, 0);
+	free(u);
+}
+
+// ---- CHECKPOINTS
+
+// Young blocks found by a diff: the first cap go to out, all of them to u
+typedef struct s_cerr_diff {
+	t_cerr_block	*out;
+	size_t			cap;
+	size_t			len;
+	t_cerr_usage	*u;
+	uint32_t		n;
+}	t_cerr_diff;
+
+// A block freed by another thread waits in the remote list of its shard,
+// already claimed: it is no longer live
+#  ifdef __CERR_SHARDS
+#   define __CERR_DIFF_LIVE(P)	__cerr_shard_owns(P)
+#  else
+#   define __CERR_DIFF_LIVE(P)	1
+#  endif
+
+static void __cerr_diff_add(t_cerr_diff *d, void *ptr, uint64_t meta) {
+	uint32_t	id = __CERR_META_SITE(meta);
+	t_cerr_site	*site = id < CERR_CACHE_SITES ? g__cerr_sites[id] : NULL;
+
+	if (d->len < d->cap)
+		d->out[d->len] = (t_cerr_block){ptr, __CERR_META_SIZE(meta),
+			site ? site->file : NULL, site ? site->line : 0};
+	++d->len;
+	if (d->u)
+		__cerr_usage_add(d->u, d->n, meta);
+}
+
+#  ifndef CERR_CACHE_INTRUSIVE
+// Only the records since the checkpoint are read, compacted on the way. A
+// reallocated block is journaled again but keeps the epoch of its slot.
+static void __cerr_diff_cache(t_cerr_diff *d, t_cerr_cache *c, uint32_t cp) {
+	uint32_t	from = __cerr_young_from(c, cp);
+	void		*ptr;
+	void		**slot;
+
+	if (from == c->young_len)
+		return;
+	__cerr_young_compact(c, from);
+	for (uint32_t i = from; i < c->young_len; ++i) {
+		ptr = c->young[i].ptr;
+		if ((slot = __cerr_cache_find(c, ptr))
+			&& __cerr_cache_epoch(c, slot) >= cp && __CERR_DIFF_LIVE(ptr))
+			__cerr_diff_add(d, ptr, __cerr_cache_meta(c, slot));
+	}
+}
+#  else
+// The newest blocks are linked first, the walk stops at the first older one
+static void __cerr_diff_cache(t_cerr_diff *d, t_cerr_cache *c, uint32_t cp) {
+	for (t_cerr_hdr *hdr = c->live; hdr && hdr->epoch >= cp; hdr = hdr->lnext)
+		if (__CERR_DIFF_LIVE(hdr + 1))
+			__cerr_diff_add(d, hdr + 1, hdr->meta);
+}
+#  endif
+
+// Each shard is read while held, its remote frees are left to its owner
+static size_t __cerr_cache_diff(t_cerr_diff *d, t_cerr_checkpoint cp) {
+#  ifdef __CERR_SHARDS
+	for (t_cerr_cache *c = __atomic_load_n(&g__cerr_shards, __ATOMIC_ACQUIRE);
+		c; c = c->link) {
+		__cerr_shard_hold(c);
+		__cerr_diff_cache(d, c, cp);
+		__cerr_shard_release(c);
+	}
+#  else
+	__cerr_diff_cache(d, &g__cerr_cache, cp);
+#  endif
+	return d->len;
+}
+
+// Blocks allocated from now on are young for the returned checkpoint
+t_cerr_checkpoint cerr_cache_checkpoint(void) {
+	return __atomic_add_fetch(&g__cerr_epoch, 1, __ATOMIC_RELAXED);
+}
+
+// Number of blocks allocated since cp and still live, the first cap listed
+// in out. In the sharded modes other threads may allocate meanwhile.
+size_t cerr_cache_diff(t_cerr_checkpoint cp, t_cerr_block *out, size_t cap) {
+	t_cerr_diff	d = {.out = out, .cap = out ? cap : 0};
 
+	return __cerr_cache_diff(&d, cp);
+}
+
+void __cerr_cache_diff_report(t_cerr_checkpoint cp) {
+	t_cerr_diff	d = {0};
+
+	if (!(d.u = __cerr_usage_new(&d.n)))
+		return;
+	__cerr_cache_diff(&d, cp);
+	__cerr_usage_log(d.u, d.n, 1);
+	free(d.u);
+}
+
+// ---- BYTES
+
+static void __cerr_mem_add(t_cerr_mem *m, t_cerr_cache *c) {
+	m->live += __atomic_load_n(&c->bytes, __ATOMIC_RELAXED);
+	m->blocks += __atomic_load_n(&c->len, __ATOMIC_RELAXED);
+	for (uint32_t k = 0; k < CERR_CACHE_CLASSES; ++k)
+		m->sizes[k] += __atomic_load_n(&c->sizes[k], __ATOMIC_RELAXED);
+}
+
+#  ifdef __CERR_SHARDS
+// Add the drift of c to the process total and raise the peak it reaches
+void __cerr_mem_publish(t_cerr_cache *c) {
+	uint64_t	live = __atomic_add_fetch(&g__cerr_live, (uint64_t)c->unsent,
+		__ATOMIC_RELAXED);
+	uint64_t	peak = __atomic_load_n(&g__cerr_peak, __ATOMIC_RELAXED);
+
+	c->unsent = 0;
+	while (live > peak && !__atomic_compare_exchange_n(&g__cerr_peak, &peak,
+		live, 1, __ATOMIC_RELAXED, __ATOMIC_RELAXED))
+		;
+}
+
+// Every block of c was just freed
+static void __cerr_mem_clear(t_cerr_cache *c) {
+	c->unsent -= (int64_t)c->bytes;
+	c->bytes = 0;
+	__cerr_mem_publish(c);
+}
+
+// Sums of every shard read without draining, the peak is the most published
+void cerr_cache_mem(t_cerr_mem *out) {
+	t_cerr_cache	*c = __atomic_load_n(&g__cerr_shards, __ATOMIC_ACQUIRE);
+	uint64_t		peak = __atomic_load_n(&g__cerr_peak, __ATOMIC_RELAXED);
+
+	*out = (t_cerr_mem){0};
+	for (; c; c = c->link)
+		__cerr_mem_add(out, c);
+	out->peak = out->live > peak ? out->live : peak;
+}
+#  else
+static void __cerr_mem_clear(t_cerr_cache *c) {
+	c->bytes = 0;
+}
+
+void cerr_cache_mem(t_cerr_mem *out) {
+	*out = (t_cerr_mem){0};
+	__cerr_mem_add(out, &g__cerr_cache);
+	out->peak = g__cerr_peak;
+}
+#  endif
+
+// Allocations that would take the tracked bytes over it throw CERR_E_NOMEM
+void cerr_cache_budget(uint64_t bytes) {
+	__atomic_store_n(&g__cerr_budget, bytes, __ATOMIC_RELAXED);
+}
+
+// ---- TRACE
+
+#  ifdef CERR_CACHE_TRACE
+#   include <fcntl.h>
+#   include <pthread.h>
+
+// Path of the trace file, opened by the first traced call
+#   ifndef CERR_CACHE_TRACE_FILE
+#    define CERR_CACHE_TRACE_FILE	"cerr-heap.trace"
+#   endif
+
+// Events of a chunk, rounded up to whole pages
+#   ifndef CERR_CACHE_TRACE_CHUNK
+#    define CERR_CACHE_TRACE_CHUNK	0x1000
+#   endif
+
+CERR_TLS t_cerr_event *g__cerr_trace_cur = NULL;
+CERR_TLS t_cerr_event *g__cerr_trace_lim = NULL;
+CERR_TLS uint32_t g__cerr_trace_tid = 0;
+
+// Header kept until the end, fd and end are guarded by the lock
+static t_cerr_trace g__cerr_trace;
+static int g__cerr_trace_fd = -1;
+static uint64_t g__cerr_trace_end = 0;
+static uint32_t g__cerr_trace_tids = 0;
+static pthread_mutex_t g__cerr_trace_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_once_t g__cerr_trace_once = PTHREAD_ONCE_INIT;
+static pthread_key_t g__cerr_trace_key;
+
+static size_t __cerr_trace_size(void) {
+	size_t	page = (size_t)sysconf(_SC_PAGESIZE);
+
+	return (CERR_CACHE_TRACE_CHUNK * sizeof(t_cerr_event) + page - 1)
+		& ~(page - 1);
+}
+
+static void __cerr_trace_clock(uint64_t *tick, uint64_t *ns) {
+	struct timespec	ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	*tick = __cerr_trace_now();
+	*ns = (uint64_t)ts.tv_sec * 1000000000ull + (uint64_t)ts.tv_nsec;
+}
+
+// Thread exit: its chunk is complete as it is, a later call maps another
+static void __cerr_trace_unmap(void *chunk) {
+	munmap(chunk, __cerr_trace_size());
+	g__cerr_trace_cur = g__cerr_trace_lim = NULL;
+}
+
+// The first page holds the header, written again at the end of the trace
+static void __cerr_trace_open(void) {
+	int	fd = open(CERR_CACHE_TRACE_FILE, O_RDWR | O_CREAT | O_TRUNC
+		| O_CLOEXEC, 0644);
+
+	pthread_key_create(&g__cerr_trace_key, __cerr_trace_unmap);
+	if (fd < 0) {
+		LOG_WARN(__CERR_M_TFAIL, CERR_CACHE_TRACE_FILE);
+		return;
+	}
+	memcpy(g__cerr_trace.magic, __CERR_TRACE_MAGIC, 8);
+	g__cerr_trace.version = __CERR_TRACE_VERSION;
+	g__cerr_trace.event = sizeof(t_cerr_event);
+	g__cerr_trace.events = (uint64_t)sysconf(_SC_PAGESIZE);
+	__cerr_trace_clock(&g__cerr_trace.tick0, &g__cerr_trace.ns0);
+	if (pwrite(fd, &g__cerr_trace, sizeof(g__cerr_trace), 0)
+		!= sizeof(g__cerr_trace)) {
+		LOG_WARN(__CERR_M_TFAIL, CERR_CACHE_TRACE_FILE);
+		close(fd);
+		return;
+	}
+	g__cerr_trace_end = g__cerr_trace.events;
+	g__cerr_trace_fd = fd;
+}
+
+// Map the next chunk of the file for the calling thread, 0 once the trace
+// is ended or could not be written
+int __cerr_trace_chunk(void) {
+	size_t			size = __cerr_trace_size();
+	t_cerr_event	*map = MAP_FAILED;
+
+	pthread_once(&g__cerr_trace_once, __cerr_trace_open);
+	if (g__cerr_trace_lim) {
+		munmap((char *)g__cerr_trace_lim - size, size);
+		g__cerr_trace_cur = g__cerr_trace_lim = NULL;
+		pthread_setspecific(g__cerr_trace_key, NULL);
+	}
+	if (__atomic_load_n(&g__cerr_trace_fd, __ATOMIC_RELAXED) < 0)
+		return 0;
+	pthread_mutex_lock(&g__cerr_trace_lock);
+	if (g__cerr_trace_fd >= 0
+		&& !ftruncate(g__cerr_trace_fd, g__cerr_trace_end + size)) {
+		map = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED,
+			g__cerr_trace_fd, g__cerr_trace_end);
+		g__cerr_trace_end += size;
+	}
+	pthread_mutex_unlock(&g__cerr_trace_lock);
+	pthread_setspecific(g__cerr_trace_key, map == MAP_FAILED ? NULL : map);
+	if (map == MAP_FAILED)
+		return 0;
+	if (!g__cerr_trace_tid)
+		g__cerr_trace_tid = __atomic_add_fetch(&g__cerr_trace_tids, 1,
+			__ATOMIC_RELAXED);
+	g__cerr_trace_cur = map;
+	g__cerr_trace_lim = (t_cerr_event *)((char *)map + size);
+	return 1;
+}
+
+static int __cerr_trace_write(int fd, const void *data, size_t len,
+	uint64_t *off) {
+	ssize_t	n = pwrite(fd, data, len, (off_t)*off);
+
+	*off += len;
+	return n == (ssize_t)len;
+}
+
+// Site records after the last chunk, then the final header. The chunks still
+// mapped keep taking events, the analysis ignores those after the end.
+void cerr_cache_trace_end(void) {
+	uint32_t		len = __atomic_load_n(&g__cerr_sites_len, __ATOMIC_ACQUIRE);
+	uint64_t		off;
+	uint64_t		head = 0;
+	t_cerr_site		*site;
+	t_cerr_tsite	rec;
+	int				ok = 1;
+
+	pthread_mutex_lock(&g__cerr_trace_lock);
+	if (g__cerr_trace_fd < 0) {
+		pthread_mutex_unlock(&g__cerr_trace_lock);
+		return;
+	}
+	off = g__cerr_trace.sites = g__cerr_trace_end;
+	__cerr_trace_clock(&g__cerr_trace.tick1, &g__cerr_trace.ns1);
+	for (uint32_t id = 1; id <= len && id < CERR_CACHE_SITES; ++id) {
+		if (!(site = __atomic_load_n(&g__cerr_sites[id], __ATOMIC_ACQUIRE)))
+			continue;
+		rec = (t_cerr_tsite){id, site->line, (uint32_t)strlen(site->file)};
+		ok &= __cerr_trace_write(g__cerr_trace_fd, &rec, sizeof(rec), &off);
+		ok &= __cerr_trace_write(g__cerr_trace_fd, site->file, rec.len, &off);
+	}
+	ok &= __cerr_trace_write(g__cerr_trace_fd, &g__cerr_trace,
+		sizeof(g__cerr_trace), &head);
+	close(g__cerr_trace_fd);
+	__atomic_store_n(&g__cerr_trace_fd, -1, __ATOMIC_RELAXED);
+	pthread_mutex_unlock(&g__cerr_trace_lock);
+	if (!ok)
+		LOG_WARN(__CERR_M_TFAIL, CERR_CACHE_TRACE_FILE);
+}
+#  else
+void cerr_cache_trace_end(void) {
+}
+#  endif
+
+// ---- TRACE ANALYSIS
+
+// Event of a trace being analyzed, seq is its order in the file
+typedef struct s_cerr_tev {
+	uint64_t	time;
+	uint64_t	ptr;
+	uint64_t	size;
+	uint32_t	site;
+	uint32_t	op;
+	uint32_t	seq;
+	uint32_t	tid;
+}	t_cerr_tev;
+
+// Leaked bytes of a site
+typedef struct s_cerr_tleak {
+	uint64_t	bytes;
+	uint64_t	blocks;
+	uint32_t	site;
+}	t_cerr_tleak;
+
+// Events of a thread are in file order, seq breaks the ties between them
+static int __cerr_tev_time(const void *a, const void *b) {
+	const t_cerr_tev	*x = a;
+	const t_cerr_tev	*y = b;
+
+	if (x->time != y->time)
+		return (x->time > y->time) - (x->time < y->time);
+	return (x->seq > y->seq) - (x->seq < y->seq);
+}
+
+static int __cerr_tev_ptr(const void *a, const void *b) {
+	const t_cerr_tev	*x = a;
+	const t_cerr_tev	*y = b;
+
+	if (x->ptr != y->ptr)
+		return (x->ptr > y->ptr) - (x->ptr < y->ptr);
+	return __cerr_tev_time(a, b);
+}
+
+static int __cerr_tleak_site(const void *a, const void *b) {
+	const t_cerr_tleak	*x = a;
+	const t_cerr_tleak	*y = b;
+
+	return (x->site > y->site) - (x->site < y->site);
+}
+
+static int __cerr_tleak_bytes(const void *a, const void *b) {
+	const t_cerr_tleak	*x = a;
+	const t_cerr_tleak	*y = b;
+
+	return (x->bytes < y->bytes) - (x->bytes > y->bytes);
+}
+
+// Events of the chunks, without the zeroed ends and what came after the end
+static t_cerr_tev *__cerr_trace_events(const t_cerr_trace *h,
+	const char *data, size_t len, size_t *n, uint32_t *tids) {
+	size_t			end = h->sites && h->sites <= len ? h->sites : len;
+	size_t			count = end > h->events
+		? (end - h->events) / sizeof(t_cerr_event) : 0;
+	t_cerr_tev		*ev = malloc((count ? count : 1) * sizeof(t_cerr_tev));
+	t_cerr_event	e;
+
+	*n = 0;
+	*tids = 0;
+	for (size_t i = 0; ev && i < count; ++i) {
+		memcpy(&e, data + h->events + i * sizeof(e), sizeof(e));
+		if ((e.op != __CERR_T_ALLOC && e.op != __CERR_T_FREE)
+			|| (h->sites && e.time > h->tick1))
+			continue;
+		ev[(*n)++] = (t_cerr_tev){e.time, e.ptr, __CERR_META_SIZE(e.meta),
+			__CERR_META_SITE(e.meta), e.op, (uint32_t)i, e.tid};
+		if (e.tid > *tids)
+			*tids = e.tid;
+	}
+	return ev;
+}
+
+// Site record of id in the trace, NULL when unknown
+static const t_cerr_tsite *__cerr_trace_site(const t_cerr_trace *h,
+	const char *data, size_t len, uint32_t id) {
+	size_t			off = h->sites;
+	t_cerr_tsite	rec;
+
+	while (h->sites && off + sizeof(rec) <= len) {
+		memcpy(&rec, data + off, sizeof(rec));
+		if (off + sizeof(rec) + rec.len > len)
+			break;
+		if (rec.id == id)
+			return (const t_cerr_tsite *)(data + off);
+		off += sizeof(rec) + rec.len;
+	}
+	return NULL;
+}
+
+// Milliseconds since the start of the trace, or millions of ticks when it
+// was never ended
+static double __cerr_trace_ms(const t_cerr_trace *h, uint64_t time) {
+	double	scale = 1e-6;
+
+	if (h->sites && h->tick1 > h->tick0)
+		scale *= (double)(h->ns1 - h->ns0) / (double)(h->tick1 - h->tick0);
+	return (double)(time - h->tick0) * scale;
+}
+
+// Live bytes over time, the most in each of rows slices of the trace
+static void __cerr_trace_timeline(FILE *out, const t_cerr_trace *h,
+	const t_cerr_tev *ev, size_t n, uint32_t rows, uint64_t peak) {
+	uint64_t	*most = calloc(rows, sizeof(uint64_t));
+	uint64_t	span = ev[n - 1].time - ev[0].time + 1;
+	uint64_t	live = 0;
+	size_t		i = 0;
+	int			bar;
+
+	if (!most)
+		return;
+	for (uint32_t r = 0; r < rows; ++r) {
+		most[r] = live;
+		for (; i < n && (ev[i].time - ev[0].time) * rows / span == r; ++i) {
+			live += ev[i].op == __CERR_T_ALLOC ? ev[i].size : -ev[i].size;
+			if (live > most[r])
+				most[r] = live;
+		}
+		bar = peak ? (int)(most[r] * 40 / peak) : 0;
+		fprintf(out, "  %12.3f %14llu %.*s\n", __cerr_trace_ms(h,
+			ev[0].time + span * r / rows), (unsigned long long)most[r], bar,
+			"########################################");
+	}
+	free(most);
+}
+
+// Blocks never freed, grouped by site, largest first
+static void __cerr_trace_leaks(FILE *out, const t_cerr_trace *h,
+	const char *data, size_t len, t_cerr_tev *ev, size_t n) {
+	t_cerr_tleak		*leak = malloc((n ? n : 1) * sizeof(t_cerr_tleak));
+	const t_cerr_tsite	*site;
+	size_t				count = 0;
+	size_t				groups = 0;
+	t_cerr_tleak		total = {0};
+
+	if (!leak)
+		return;
+	qsort(ev, n, sizeof(t_cerr_tev), __cerr_tev_ptr);
+	for (size_t i = 0; i < n; ++i)
+		if (ev[i].op == __CERR_T_ALLOC && (i + 1 == n
+			|| ev[i + 1].ptr != ev[i].ptr || ev[i + 1].op != __CERR_T_FREE))
+			leak[count++] = (t_cerr_tleak){ev[i].size, 1, ev[i].site};
+	qsort(leak, count, sizeof(t_cerr_tleak), __cerr_tleak_site);
+	for (size_t i = 0; i < count; ++i) {
+		total.bytes += leak[i].bytes;
+		if (groups && leak[groups - 1].site == leak[i].site) {
+			leak[groups - 1].bytes += leak[i].bytes;
+			++leak[groups - 1].blocks;
+		} else
+			leak[groups++] = leak[i];
+	}
+	qsort(leak, groups, sizeof(t_cerr_tleak), __cerr_tleak_bytes);
+	fprintf(out, "leaks: %zu blocks, %llu bytes\n", count,
+		(unsigned long long)total.bytes);
+	for (size_t i = 0; i < groups; ++i) {
+		if ((site = __cerr_trace_site(h, data, len, leak[i].site)))
+			fprintf(out, "  %.*s:%u", (int)site->len,
+				(const char *)(site + 1), site->line);
+		else
+			fprintf(out, "  site %u", leak[i].site);
+		fprintf(out, " holds %llu blocks, %llu bytes\n",
+			(unsigned long long)leak[i].blocks,
+			(unsigned long long)leak[i].bytes);
+	}
+	free(leak);
+}
+
+// Replay a trace: totals, peak, live bytes over time and leaks by site.
+// Returns -1 when data is not a trace.
+int __cerr_trace_analyze(FILE *out, const char *data, size_t len,
+	uint32_t rows) {
+	t_cerr_trace	h;
+	t_cerr_tev		*ev;
+	size_t			n;
+	uint32_t		tids;
+	uint64_t		live = 0;
+	uint64_t		blocks = 0;
+	uint64_t		totals[2][2] = {{0}};
+	t_cerr_tev		peak = {0};
+	uint64_t		peak_blocks = 0;
+
+	if (len < sizeof(h))
+		return -1;
+	memcpy(&h, data, sizeof(h));
+	if (memcmp(h.magic, __CERR_TRACE_MAGIC, 8)
+		|| h.version != __CERR_TRACE_VERSION
+		|| h.event != sizeof(t_cerr_event) || h.events > len)
+		return -1;
+	if (!(ev = __cerr_trace_events(&h, data, len, &n, &tids)))
+		return -1;
+	qsort(ev, n, sizeof(t_cerr_tev), __cerr_tev_time);
+	for (size_t i = 0; i < n; ++i) {
+		++totals[ev[i].op - 1][0];
+		totals[ev[i].op - 1][1] += ev[i].size;
+		if (ev[i].op == __CERR_T_ALLOC) {
+			live += ev[i].size;
+			++blocks;
+		} else {
+			live -= ev[i].size;
+			--blocks;
+		}
+		if (live > peak.size) {
+			peak = (t_cerr_tev){.time = ev[i].time, .size = live};
+			peak_blocks = blocks;
+		}
+	}
+	fprintf(out, "heap trace: %zu events from %u threads, %s\n", n, tids,
+		h.sites ? "times in ms" : "not ended, times in Mticks");
+	fprintf(out, "allocs: %llu, %llu bytes, frees: %llu, %llu bytes\n",
+		(unsigned long long)totals[0][0], (unsigned long long)totals[0][1],
+		(unsigned long long)totals[1][0], (unsigned long long)totals[1][1]);
+	fprintf(out, "peak: %llu bytes in %llu blocks at %.3f\n",
+		(unsigned long long)peak.size, (unsigned long long)peak_blocks,
+		n ? __cerr_trace_ms(&h, peak.time) : 0);
+	if (n && rows) {
+		fprintf(out, "live bytes:\n");
+		__cerr_trace_timeline(out, &h, ev, n, rows, peak.size);
+	}
+	__cerr_trace_leaks(out, &h, data, len, ev, n);
+	free(ev);
+	return 0;
+}
+
+#  ifdef __CERR_SHARDS
+// Copy of a block whose header crosses a page, the original is freed
+t_cerr_hdr *__cerr_shard_move(t_cerr_hdr *hdr, size_t size) {
+	size_t		len = sizeof(t_cerr_hdr) + size;
+	t_cerr_hdr	*res = aligned_alloc(64, (len + 63) & ~(size_t)63);
+
+	if (res)
+		memcpy(res, hdr, len);
+	free(hdr);
+	return res;
+}
+
+// Unlink the remote frees of a shard locked or held by the caller, they are
+// freed by __cerr_shard_free_list once it is let go
+static t_cerr_hdr *__cerr_shard_take(t_cerr_cache *c) {
+	t_cerr_hdr	*head = __atomic_exchange_n(&c->remote, NULL, __ATOMIC_ACQUIRE);
+
+	for (t_cerr_hdr *hdr = head; hdr; hdr = (t_cerr_hdr *)hdr->tag)
+		__cerr_shard_unlink(c, hdr);
+	return head;
+}
+
+static void __cerr_shard_free_list(t_cerr_hdr *head) {
+	t_cerr_hdr	*next;
+
+	for (t_cerr_hdr *hdr = head; hdr; hdr = next) {
+		next = (t_cerr_hdr *)hdr->tag;
+		free(hdr);
+	}
+}
+
+void __cerr_shard_drain(t_cerr_cache *c) {
+	t_cerr_hdr	*head;
+
+	__cerr_shard_lock(c);
+	head = __cerr_shard_take(c);
+	__cerr_shard_unlock(c);
+	__cerr_shard_free_list(head);
+}
+
+// Apply the remote frees of a shard no thread holds, holding it meanwhile.
+// A free pushed while it is held is seen by the next turn of the loop, one
+// pushed after it is let go finds it free and comes here too.
+void __cerr_shard_reclaim(t_cerr_cache *c) {
+	uint32_t	state = __CERR_S_FREE;
+
+	while (__atomic_load_n(&c->remote, __ATOMIC_SEQ_CST)
+		&& __atomic_compare_exchange_n(&c->state, &state, __CERR_S_USED, 0,
+			__ATOMIC_SEQ_CST, __ATOMIC_RELAXED)) {
+		__cerr_shard_drain(c);
+		__atomic_store_n(&c->state, __CERR_S_FREE, __ATOMIC_SEQ_CST);
+	}
+}
+
+// Thread exit: the shard and its blocks wait for the next thread to adopt it,
+// the frees other threads hand to it are applied as they come
+static void __cerr_shard_detach(void *c) {
+	g__cerr_shard = NULL;
+	__atomic_store_n(&((t_cerr_cache *)c)->state, __CERR_S_FREE,
+		__ATOMIC_SEQ_CST);
+	__cerr_shard_reclaim(c);
+}
+
+// Before any shard exists, the owners learn whether they need a fence
+static void __cerr_shard_key(void) {
+	pthread_key_create(&g__cerr_shard_key, __cerr_shard_detach);
+	g__cerr_shard_fence
+		= __CERR_MEMBARRIER(MEMBARRIER_CMD_REGISTER_PRIVATE_EXPEDITED) != 0;
+}
+
+t_cerr_cache *__cerr_shard_attach(void) {
+	t_cerr_cache	*c;
+	uint32_t		state;
+
+	pthread_once(&g__cerr_shard_once, __cerr_shard_key);
+	c = __atomic_load_n(&g__cerr_shards, __ATOMIC_ACQUIRE);
+	for (; c; c = c->link) {
+		state = __CERR_S_FREE;
+		if (__atomic_compare_exchange_n(&c->state, &state, __CERR_S_USED, 0,
+			__ATOMIC_ACQUIRE, __ATOMIC_RELAXED))
+			break;
+	}
+	if (!c) {
+		c = aligned_alloc(_Alignof(t_cerr_cache), sizeof(t_cerr_cache));
+		ASSERT(c, __CERR_M_AFAIL);
+		*c = (t_cerr_cache){.state = __CERR_S_USED};
+		c->link = __atomic_load_n(&g__cerr_shards, __ATOMIC_RELAXED);
+		while (!__atomic_compare_exchange_n(&g__cerr_shards, &c->link, c, 1,
+			__ATOMIC_RELEASE, __ATOMIC_RELAXED))
+			;
+	}
+	g__cerr_shard = c;
+	pthread_setspecific(g__cerr_shard_key, c);
+	return c;
+}
+
+// Each shard is emptied while held, as a report reads it, a running owner
+// waits for it on its next change
+void __cerr_cache_clear(void) {
+	uint32_t	len = 0;
+	t_cerr_cache	*c = __atomic_load_n(&g__cerr_shards, __ATOMIC_ACQUIRE);
+	t_cerr_hdr		*head;
+
+	for (; c; c = c->link) {
+		__cerr_shard_hold(c);
+		head = __cerr_shard_take(c);
+		len += __cerr_cache_release(c);
+		__cerr_mem_clear(c);
+		__cerr_shard_release(c);
+		__cerr_shard_free_list(head);
+	}
+	if (len)
+		LOG_WARN(__CERR_M_WEXIT, len);
+}
+
+// Blocks still tracked by every shard, pending remote frees are applied
+// while it is held
+uint32_t __cerr_cache_live(void) {
+	uint32_t	len = 0;
+	t_cerr_cache	*c = __atomic_load_n(&g__cerr_shards, __ATOMIC_ACQUIRE);
+	t_cerr_hdr		*head;
+
+	for (; c; c = c->link) {
+		__cerr_shard_hold(c);
+		head = __cerr_shard_take(c);
+		len += c->len;
+		__cerr_shard_release(c);
+		__cerr_shard_free_list(head);
+	}
+	return len;
+}
+
+// Tracked blocks and live table slots of every shard, read without draining
+void __cerr_cache_usage(uint64_t *len, uint64_t *cap) {
+	t_cerr_cache	*c = __atomic_load_n(&g__cerr_shards, __ATOMIC_ACQUIRE);
+
+	*len = 0;
+	*cap = 0;
+	for (; c; c = c->link) {
+		*len += __atomic_load_n(&c->len, __ATOMIC_RELAXED);
+#   ifndef CERR_CACHE_INTRUSIVE
+		*cap += __atomic_load_n(&c->cap, __ATOMIC_RELAXED);
+#   endif
+	}
+}
+#  else
+void __cerr_cache_clear(void) {
+	uint32_t	len = __cerr_cache_release(&g__cerr_cache);
+
+	__cerr_mem_clear(&g__cerr_cache);
+	if (len)
+		LOG_WARN(__CERR_M_WEXIT, len);
+}
+
+uint32_t __cerr_cache_live(void) {
+	return g__cerr_cache.len;
+}
+
+void __cerr_cache_usage(uint64_t *len, uint64_t *cap) {
+	*len = __atomic_load_n(&g__cerr_cache.len, __ATOMIC_RELAXED);
+	*cap = __atomic_load_n(&g__cerr_cache.cap, __ATOMIC_RELAXED);
+}
+#  endif
+
+// Process exit: report the leaks by site and free them, or with
+// CERR_CACHE_FAST_EXIT leave the memory to the system
 __attribute__((destructor))
-void __cerr_cache_clear(void) { __CERR_CACHE_CLEAR(); }
+static void __cerr_cache_exit(void) {
+	uint32_t	len = __cerr_cache_live();
+
+	cerr_cache_trace_end();
+	if (!len)
+		return;
+	__cerr_cache_report();
+#  ifdef CERR_CACHE_FAST_EXIT
+	LOG_WARN(__CERR_M_LEXIT, len);
+#  else
+	__cerr_cache_clear();
+#  endif
+}
 # endif
 
 # endif
@@ -1,83 +1,217 @@
 #pragma once
 
+// GNU extensions of the implementation, see libcerr-log.h
+#if defined(CERR_IMPLEMENTATION) && !defined(_GNU_SOURCE)
+# define _GNU_SOURCE
+#endif
+
 #include <stdlib.h>
 #include <setjmp.h>
 #include <stdint.h>
+#include <stddef.h>
+#include <string.h>
+#include <errno.h>
 
 #include <libcerr-log.h>
 #include <libcerr-assert.h>
-
-#if defined(__STDC_VERSION__) && __STDC_VERSION__ >= 201112L
-  #define CERR_TLS _Thread_local
-#else
-  #define CERR_TLS __thread
-#endif
+#include <libcerr-arena.h>
+#include <libcerr-stats.h>
 
 // ╔═══════════════════════════════[ DEFINITION ]══════════════════════════════╗
 
 #define		CERR_E_NONE		0
 #define		CERR_E_RUNTIME	1
 
+// Root category, every code below 2^26
+#define		CERR_E_ALL		(__CERR_GROUP | (CERR_TYPE)26 << __CERR_GROUP_SHIFT)
+
+// Codes thrown by libcerr itself, the last 2^16 of CERR_E_ALL from 0x3ff0000.
+// The program keeps the codes below for its own.
+#define		CERR_E_LIBCERR	CERR_CATEGORY(CERR_E_ALL, 0x3ff, 16)
+// Thrown by a cache allocation that would go over the memory budget
+#define		CERR_E_NOMEM	CERR_CODE(CERR_E_LIBCERR, 1)
+
 #ifndef		CERR_MSG_SIZE
 # define	CERR_MSG_SIZE 1024
 #endif
+#ifndef		CERR_BACKTRACE_DEPTH
+# define	CERR_BACKTRACE_DEPTH 16
+#endif
 #ifndef		CERR_TYPE
 # define	CERR_TYPE uint_fast32_t
 #endif
+#ifndef		CERR_DEFER_MAX
+# define	CERR_DEFER_MAX 32
+#endif
 
+// Only prev, thrown, msg, fast, defer and arena.top are set on entry, frame is
+// filled by setjmp. msg stays NULL until the reason is asked for, it then points to
+// the per-thread buffer g__cerr_msg, so a TRY costs no message storage.
+// A TRY entered by a CATCH body first gives the catching context its own copy,
+// freed when it is left, as the inner throws reuse the per-thread record.
+// A TRY_FAST only keeps the 5 words of __builtin_setjmp at the start of frame.
 typedef struct s_err_ctx t_err_ctx;
 struct s_err_ctx {
 	t_err_ctx	*prev;
-	jmp_buf		frame;
 	CERR_TYPE	thrown;
-	char		msg[CERR_MSG_SIZE];
+	const char	*msg;
+	int			fast;
+	uint32_t	defer;
+	t_cerr_mark	arena;
+	jmp_buf		frame;
 };
 
+// Last throw of the thread: format, site and arguments, formatted lazily.
+// With CERR_BACKTRACE, also the raw return addresses of the throw.
+typedef struct s_cerr_throw {
+	const char	*fmt;
+	const char	*file;
+	int			line;
+	int			err;
+	uint32_t	argc;
+	uint32_t	slen;
+	uint32_t	depth;
+	void		*frames[CERR_BACKTRACE_DEPTH];
+	t_cerr_arg	args[__CERR_ARGS_MAX];
+	char		strs[CERR_MSG_SIZE];
+}	t_cerr_throw;
+
+// Cleanups of the thread, each context owns the records above its defer
+typedef void (*t_cerr_defer_fn)(void *);
+typedef struct s_cerr_defer {
+	t_cerr_defer_fn	fn;
+	void			*arg;
+}	t_cerr_defer;
+
+// Exception kept out of its TRY with CERR_STORE, its code and its record,
+// to be thrown again later or from another thread
+typedef struct s_cerr_exception {
+	CERR_TYPE		code;
+	t_cerr_throw	at;
+}	t_cerr_exception;
+
 extern CERR_TLS t_err_ctx *g__cerr_ctx;
+extern CERR_TLS t_cerr_defer g__cerr_defers[CERR_DEFER_MAX];
+extern CERR_TLS uint32_t g__cerr_ndefers;
+extern CERR_TLS char g__cerr_msg[CERR_MSG_SIZE];
+extern CERR_TLS t_cerr_throw g__cerr_throw;
 
-#ifdef CERR_IMPLEMENTATION
-CERR_TLS t_err_ctx *g__cerr_ctx = NULL;
-#endif
+const char *__cerr_format(t_err_ctx *err, const t_cerr_throw *t);
+const char *__cerr_format_in(char *buf, const t_cerr_throw *t);
+void __cerr_fast_jump(t_err_ctx *err) __attribute__((noreturn));
+void __cerr_backtrace(t_cerr_throw *t);
+void __cerr_trace(void);
+void __cerr_defer_run(uint32_t base);
+void __cerr_defer_unwind(uint32_t base);
+void __cerr_set_str(t_cerr_throw *t, t_cerr_arg *a);
+void __cerr_keep(t_err_ctx *err);
 
 // ╔═════════════════════════════════[ MACROS ]════════════════════════════════╗
 // ---- TRY / CATCH
+// A TRY and its CATCH and FINALLY are one statement: a loop of two steps over
+// one if-else chain. The body (__s 0) or the catches (__s 1) take the first
+// step, FINALLY the second one, after the context is left. __s is only set
+// once setjmp returned, so it can stay in a register.
 // DEFAULT TRY STATEMENT
 # define TRY                                                                   \
-	for (t_err_ctx __err __CERR_CLEANUP=__CERR_INIT, *__p=&__err; __p; __p=0)  \
-		if ((__err.thrown=setjmp(__err.frame)) == CERR_E_NONE)
+	for (t_err_ctx __err __CERR_CLEANUP, *__p=__err_init(&__err); __p; __p=0)  \
+		for (int __s=(__err.thrown=setjmp(__err.frame)) != CERR_E_NONE;        \
+			__s < 4; __s+=2)                                                   \
+			if (__s == 0)
+
+// TRY releasing every ARENA_MALLOC of its body and catches when it is left
+# define TRY_ARENA                                                             \
+	for (t_err_ctx __err __CERR_CLEANUP, *__p=__err_arena_init(&__err); __p;   \
+		__p=0)                                                                 \
+		for (int __s=(__err.thrown=setjmp(__err.frame)) != CERR_E_NONE;        \
+			__s < 4; __s+=2)                                                   \
+			if (__s == 0)
+
+// TRY saving only the frame and stack pointers, the compiler spills the rest.
+// Same CATCH and THROW, cheaper to enter and to throw to.
+# define TRY_FAST                                                              \
+	for (t_err_ctx __err __CERR_CLEANUP, *__p=__err_fast_init(&__err); __p;    \
+		__p=0)                                                                 \
+		for (int __s=__builtin_setjmp((void **)__err.frame) != 0;              \
+			__s < 4; __s+=2)                                                   \
+			if (__s == 0)
 
 // DEFAULT CATCH STATEMENT
 # define CATCH(...)                                                            \
-	else if (__CERR_IS_CATCHED(__VA_ARGS__))
+	else if (__s == 1 && __CERR_IS_CATCHED(__VA_ARGS__))
 
 // Catches everything else not catched before
 # define CATCH_ALL()                                                           \
-	else
+	else if (__s == 1 && (__CERR_STAT_CATCH(__err.thrown), 1))
 
 // Catches exceptions and log the reason
 # define CATCH_LOG(...)                                                        \
 	CATCH(__VA_ARGS__)                                                         \
-	for (char __i=1; __i; __i=0, LOG_ERR(__CERR_M_CAUGHT, __FILE__, CERR_WHY()))
+	for (char __i=1; __i; __i=0, __CERR_LOG_CAUGHT())
 
 // Catches everything else and log the reason
 # define CATCH_ALL_LOG()                                                       \
 	CATCH_ALL()                                                                \
-	for (char __i=1; __i; __i=0, LOG_ERR(__CERR_M_CAUGHT, __FILE__, CERR_WHY()))
+	for (char __i=1; __i; __i=0, __CERR_LOG_CAUGHT())
+
+// Runs after the TRY and its catches, thrown or not, once its deferred
+// cleanups are done. A return out of the TRY skips it, DEFER does not.
+# define FINALLY                                                               \
+	else if (__s < 2) {}                                                       \
+	else for (char __f=(__err_leave(&__err), 1); __f; __f=0)
+
+// ---- DEFER
+// Call FN(ARG) when the innermost TRY is left: on a throw to it, before its
+// CATCH runs, otherwise when its statement ends. Last deferred, first called.
+# define DEFER(FN, ARG)                                                        \
+	__cerr_defer((FN), (ARG))
+
+// ---- CATEGORIES
+// Category of 2^BITS codes, the INDEX-th of that size inside PARENT.
+// Categories can only be caught, a CATCH of one matches all of its codes.
+# define CERR_CATEGORY(PARENT, INDEX, BITS) (__CERR_GROUP                      \
+	| (CERR_TYPE)(BITS) << __CERR_GROUP_SHIFT                                  \
+	| (__CERR_E_LO(PARENT) + ((CERR_TYPE)(INDEX) << (BITS))                    \
+	+ __CERR_CHECK(__CERR_IS_GROUP(PARENT) && (BITS) < __CERR_E_BITS(PARENT)   \
+		&& (CERR_TYPE)(INDEX) >> (__CERR_E_BITS(PARENT) - (BITS)) == 0)))
+
+// The INDEX-th code of CATEGORY, a throwable exception
+# define CERR_CODE(CATEGORY, INDEX)                                            \
+	(__CERR_E_LO(CATEGORY) + (CERR_TYPE)(INDEX) + __CERR_CHECK(                \
+		__CERR_IS_GROUP(CATEGORY)                                              \
+		&& (CERR_TYPE)(INDEX) >> __CERR_E_BITS(CATEGORY) == 0))
+
+// True if the exception CODE is EXCEPTION or one of the codes of a category
+# define CERR_IS(CODE, EXCEPTION)                                              \
+	((CERR_TYPE)(CODE) >> __CERR_E_BITS(EXCEPTION)                             \
+		== __CERR_E_LO(EXCEPTION) >> __CERR_E_BITS(EXCEPTION))
 
 
 // ---- THROW
 // DEFAULT THROW
 # define THROW(EXCEPTION) do {                                                 \
 	__CERR_IS_THROWABLE(EXCEPTION);                                            \
+	__CERR_STAT_THROW(EXCEPTION);                                              \
 	__CERR_SET("");                                                            \
-	longjmp(g__cerr_ctx->frame, (EXCEPTION));                                  \
+	__cerr_jump(g__cerr_ctx, (EXCEPTION));                                     \
 } while (0)
 
 // Throw exception and specify reason
 # define THROW_MSG(EXCEPTION, MSG, ...) do {                                   \
-	__CERR_IS_THROWABLE(EXCEPTION);\
+	__CERR_IS_THROWABLE(EXCEPTION);                                            \
+	__CERR_STAT_THROW(EXCEPTION);                                              \
 	__CERR_SET(MSG, ##__VA_ARGS__);                                            \
-	longjmp(g__cerr_ctx->frame, (EXCEPTION));                                  \
+	__cerr_jump(g__cerr_ctx, (EXCEPTION));                                     \
+} while (0)
+
+// Throw again an exception kept by CERR_STORE, with its reason and its site.
+// Nothing when none was kept.
+# define RETHROW(E) do {                                                       \
+	const t_cerr_exception *__e = (E);                                         \
+	if (__e->code != CERR_E_NONE) {                                            \
+		g__cerr_throw = __e->at;                                               \
+		__CERR_RAISE(__e->code);                                               \
+	}                                                                          \
 } while (0)
 
 // Throw only if condition is true
@@ -94,50 +228,371 @@ CERR_TLS t_err_ctx *g__cerr_ctx = NULL;
 
 // ---- OTHER
 
+// In a CATCH, keep the caught exception in E, a t_cerr_exception *
+#define CERR_STORE(E) __cerr_store((E), __err.thrown)
+
+// Reason of an exception kept by CERR_STORE, valid until the next reason is
+// formatted by the thread
+#define CERR_EXCEPTION_WHY(E)                                                  \
+	((E)->code != CERR_E_NONE ? __cerr_format(NULL, &(E)->at) : "")
+
 // Retreive the reason of the exception as a string of size CERR_MSG_SIZE
-#define CERR_WHY() (g__cerr_ctx ? g__cerr_ctx->msg : "")
+// Formatted on first call, in a per-thread buffer valid until the next throw
+#define CERR_WHY() (g__cerr_ctx ? __err_why(g__cerr_ctx) : "")
+
+// Log the frames of the last throw of the thread, only symbolized now.
+// Nothing without CERR_BACKTRACE in the file of the throw.
+#define CERR_TRACE() __cerr_trace()
 
 
 // ╔══════════════════════════════════[ UTILS ]════════════════════════════════╗
 
 #define		__CERR_M_CAUGHT		"Exception caught in %s, thrown %s"
 #define		__CERR_M_UNCAUGHT	"Uncaught exception[%d]"
+#define		__CERR_M_GROUP		"Category thrown[%d], throw one of its codes"
 #define		__CERR_M_FORMAT		"line %d in %s: "
+#define		__CERR_M_FRAME		"  #%u %s"
+#define		__CERR_M_FRAME_RAW	"  #%u %p"
+#define		__CERR_M_DEFER		"DEFER outside of TRY or over CERR_DEFER_MAX"
+
+#define __CERR_LOG_CAUGHT()                                                    \
+	(LOG_ERR(__CERR_M_CAUGHT, __FILE__, CERR_WHY()), CERR_TRACE())
+
+#ifdef CERR_BACKTRACE
+# define __CERR_BACKTRACE(T) __cerr_backtrace(T)
+#else
+# define __CERR_BACKTRACE(T) ((T)->depth = 0)
+#endif
+
+// A category is an aligned range of codes: the flag, its size as a power of 2
+// and its first code. A plain code is a range of size 1.
+#define __CERR_GROUP			((CERR_TYPE)1 << 31)
+#define __CERR_GROUP_SHIFT		26
+#define __CERR_IS_GROUP(X)		((CERR_TYPE)(X) >> 31 == 1)
+#define __CERR_E_BITS(X)                                                       \
+	(__CERR_IS_GROUP(X) ? (CERR_TYPE)(X) >> __CERR_GROUP_SHIFT & 0x1f : 0)
+#define __CERR_E_LO(X) ((CERR_TYPE)(X)                                         \
+	& (__CERR_IS_GROUP(X) ? ((CERR_TYPE)1 << __CERR_GROUP_SHIFT) - 1 : ~0ull))
+
+// Compile time check of a category, always 0
+#define __CERR_CHECK(COND)                                                     \
+	((CERR_TYPE)sizeof(struct { int __ok: (COND) ? 1 : -1; }) * 0)
+
+// Codes of X as bits of a mask of the codes below 64, 0 if X reaches above
+#define __CERR_IS_LOW(X) (__CERR_E_LO(X) < 64 && __CERR_E_BITS(X) <= 6         \
+	&& __CERR_E_LO(X) + ((CERR_TYPE)1 << __CERR_E_BITS(X)) <= 64)
+#define __CERR_LOW_MASK(X)                                                     \
+	| (__CERR_IS_LOW(X)                                                        \
+		? ~0ull >> (64 - (1u << __CERR_E_BITS(X))) << __CERR_E_LO(X) : 0)
+#define __CERR_HIGH_TEST(X)                                                    \
+	|| (!__CERR_IS_LOW(X) && CERR_IS(__t, X))
 
-// Check if exception was thrown
+// Check if exception was thrown. Codes and categories below 64 are merged in
+// one constant mask, each other one is a single shift and compare.
 #define __CERR_IS_CATCHED(...) ({                                              \
-	CERR_TYPE __errs[] = {__VA_ARGS__};                                        \
-	const size_t len = sizeof(__errs)/sizeof(CERR_TYPE);                       \
-	int __catched = 0;                                                         \
-	for (size_t __i=0; __i < len && !__catched; ++__i)                         \
-		__catched = (__err.thrown == __errs[__i]);                             \
-	__catched;                                                                 \
+	const CERR_TYPE __t = __err.thrown;                                        \
+	int __c = (__t < 64                                                        \
+		&& (0ull __CERR_MAP(__CERR_LOW_MASK, __VA_ARGS__)) >> __t & 1)         \
+		__CERR_MAP(__CERR_HIGH_TEST, __VA_ARGS__);                             \
+	if (__c) __CERR_STAT_CATCH(__t);                                           \
+	__c;                                                                       \
 })
 
 // Check if exception can be thrown
 #define __CERR_IS_THROWABLE(EXCEPTION)                                         \
 	ASSERT(g__cerr_ctx != NULL && g__cerr_ctx->thrown == CERR_E_NONE,          \
-		__CERR_M_UNCAUGHT, (EXCEPTION))
+		__CERR_M_UNCAUGHT, (int)(EXCEPTION));                                  \
+	ASSERT(!__CERR_IS_GROUP(EXCEPTION), __CERR_M_GROUP, (int)(EXCEPTION))
+
+// THROW keeping the reason already recorded
+#define __CERR_RAISE(EXCEPTION) do {                                           \
+	__CERR_IS_THROWABLE(EXCEPTION);                                            \
+	__CERR_STAT_THROW(EXCEPTION);                                              \
+	__cerr_jump(g__cerr_ctx, (EXCEPTION));                                     \
+} while (0)
 
 // Clear and restore to previous exception context
 #define __CERR_CLEANUP                                                         \
 	__attribute__((cleanup(__err_cleanup)))
 
-// Init the current exception context
-#define __CERR_INIT ({                                                         \
-	__err = (t_err_ctx){0};                                                    \
-	__err.prev = g__cerr_ctx;                                                  \
-	g__cerr_ctx = &__err;                                                      \
-	__err;                                                                     \
-})
+// Define the reason for the current exception context.
+// Only the format, the site and a copy of the arguments are recorded,
+// the string itself is built by __cerr_format when CERR_WHY() asks for it.
+#define __CERR_SET(MSG, ...) __CERR_SET_IN(&g__cerr_throw, MSG, ##__VA_ARGS__)
+
+// Same as __CERR_SET, in the record T
+#define __CERR_SET_IN(T, MSG, ...) do {                                        \
+	t_cerr_throw *__t = (T);                                                   \
+	if (0) __cerr_check_fmt(__CERR_M_FORMAT MSG, 0, "", ##__VA_ARGS__);        \
+	__t->fmt = MSG;                                                            \
+	__t->file = __FILE__;                                                      \
+	__t->line = __LINE__;                                                      \
+	__t->err = errno;                                                          \
+	__t->argc = 0;                                                             \
+	__t->slen = 0;                                                             \
+	__CERR_BACKTRACE(__t);                                                     \
+	__CERR_MAP(__CERR_SET_ARG, ##__VA_ARGS__)                                  \
+} while (0)
 
-// Define the reason for the current exception context
-#define __CERR_SET(MSG, ...)                                                   \
-	snprintf(g__cerr_ctx->msg, CERR_MSG_SIZE, __CERR_M_FORMAT MSG,             \
-		__LINE__, __FILE__, ##__VA_ARGS__)
+// Record one argument, arrays decay and keep their pointer type
+#define __CERR_SET_ARG(X) {                                                    \
+	__auto_type __v = ((void)0, (X));                                          \
+	__cerr_set_arg(__t, __CERR_ARG_KIND(__v), &__v, sizeof(__v));              \
+}
+
+// Record one argument, a char * is copied out of line by __cerr_set_str
+static inline void __cerr_set_arg(t_cerr_throw *t, uint8_t kind,
+	const void *v, size_t size) {
+	t_cerr_arg	*a;
+
+	if (__builtin_expect(t->argc >= __CERR_ARGS_MAX, 0))
+		return;
+	a = &t->args[t->argc++];
+	a->kind = kind;
+	a->size = size < sizeof(a->val) ? size : sizeof(a->val);
+	memcpy(&a->val, v, a->size);
+	if (kind == __CERR_A_STR && a->val.p)
+		__cerr_set_str(t, a);
+}
+
+// Reason of an exception context, formatting it on first access
+static inline const char *__err_why(t_err_ctx *err) {
+	if (err->msg || err->thrown == CERR_E_NONE)
+		return err->msg ? err->msg : "";
+	return __cerr_format(err, &g__cerr_throw);
+}
 
-// helper function for attribute cleanup
-static inline void __err_cleanup(t_err_ctx* err) {
-	if (err) g__cerr_ctx = err->prev;
+// Copy the code and the record of the last throw of the thread
+static inline void __cerr_store(t_cerr_exception *e, CERR_TYPE code) {
+	e->code = code;
+	e->at = g__cerr_throw;
 }
 
+// Push a cleanup of the innermost context, dropped if it cannot be kept
+static inline void __cerr_defer(t_cerr_defer_fn fn, void *arg) {
+	int	ok = g__cerr_ctx != NULL && g__cerr_ndefers < CERR_DEFER_MAX;
+
+	ASSERT(ok, __CERR_M_DEFER);
+	if (__builtin_expect(ok, 1))
+		g__cerr_defers[g__cerr_ndefers++] = (t_cerr_defer){fn, arg};
+}
+
+// Jump back to the context, a TRY_FAST gets its code before the jump.
+// 0 is thrown as 1, like longjmp does. The cleanups deferred since the
+// context was entered run first, while their frames are still there.
+__attribute__((noreturn))
+static inline void __cerr_jump(t_err_ctx *err, CERR_TYPE code) {
+	if (g__cerr_ndefers > err->defer)
+		__cerr_defer_unwind(err->defer);
+	if (err->fast) {
+		err->thrown = code ? code : 1;
+		__cerr_fast_jump(err);
+	}
+	longjmp(err->frame, (int)code);
+}
+
+// Init the current exception context, only the link and the code are written
+static inline t_err_ctx *__err_init(t_err_ctx *err) {
+	err->prev = g__cerr_ctx;
+	if (__builtin_expect(err->prev && err->prev->thrown != CERR_E_NONE, 0))
+		__cerr_keep(err->prev);
+	err->thrown = CERR_E_NONE;
+	err->msg = NULL;
+	err->fast = 0;
+	err->defer = g__cerr_ndefers;
+	err->arena.top = NULL;
+	g__cerr_ctx = err;
+	__CERR_STAT_TRY();
+	return err;
+}
+
+// Same as __err_init, the context also remembers the arena position
+static inline t_err_ctx *__err_arena_init(t_err_ctx *err) {
+	__err_init(err);
+	__cerr_arena_mark(&err->arena);
+	return err;
+}
+
+// Same as __err_init, throws to the context go through __builtin_longjmp
+static inline t_err_ctx *__err_fast_init(t_err_ctx *err) {
+	__err_init(err);
+	err->fast = 1;
+	return err;
+}
+
+// Leave the context, a TRY_ARENA rewinds the arena.
+// Deferred cleanups run once the context is left, a throw from one of them
+// goes to the enclosing TRY, which then runs the remaining ones. Everything
+// else is undone before them, the throw would skip it.
+static inline void __err_leave(t_err_ctx *err) {
+	g__cerr_ctx = err->prev;
+	__CERR_STAT_LEAVE();
+	if (__builtin_expect(err->msg && err->msg != g__cerr_msg, 0))
+		free((void *)err->msg);
+	if (err->arena.top)
+		__cerr_arena_reset(&err->arena);
+	if (g__cerr_ndefers > err->defer)
+		__cerr_defer_run(err->defer);
+}
+
+// helper function for attribute cleanup, the context may be left already by
+// its FINALLY
+static inline void __err_cleanup(t_err_ctx *err) {
+	if (err && g__cerr_ctx == err)
+		__err_leave(err);
+}
+
+
+// ╔══════════════════════════════[ IMPLEMENTATION ]═══════════════════════════╗
+
+#ifdef CERR_IMPLEMENTATION
+# include <execinfo.h>
+# include <pthread.h>
+
+CERR_TLS t_err_ctx *g__cerr_ctx = NULL;
+CERR_TLS char g__cerr_msg[CERR_MSG_SIZE];
+CERR_TLS t_cerr_throw g__cerr_throw;
+static CERR_TLS uintptr_t g__cerr_stack_top = 0;
+CERR_TLS t_cerr_defer g__cerr_defers[CERR_DEFER_MAX];
+CERR_TLS uint32_t g__cerr_ndefers = 0;
+
+// Build the reason of a throw from its recorded format and arguments in buf,
+// of size CERR_MSG_SIZE
+const char *__cerr_format_in(char *buf, const t_cerr_throw *t) {
+	int					r;
+	size_t				len;
+
+	r = snprintf(buf, CERR_MSG_SIZE, __CERR_M_FORMAT, t->line, t->file);
+	len = r < 0 ? 0 : (size_t)r;
+	if (len >= CERR_MSG_SIZE)
+		len = CERR_MSG_SIZE - 1;
+	__cerr_vformat(buf + len, CERR_MSG_SIZE - len, t->fmt, t->args,
+		t->argc, t->strs, t->err);
+	return buf;
+}
+
+// Same in the per-thread buffer, kept by err when there is one
+const char *__cerr_format(t_err_ctx *err, const t_cerr_throw *t) {
+	__cerr_format_in(g__cerr_msg, t);
+	if (err)
+		err->msg = g__cerr_msg;
+	return g__cerr_msg;
+}
+
+// Copy the reason of a caught exception before a nested TRY can throw over
+// it. Left to the per-thread buffer if the copy cannot be allocated.
+void __cerr_keep(t_err_ctx *err) {
+	const char	*why;
+	char		*copy;
+	size_t		len;
+
+	if (err->msg && err->msg != g__cerr_msg)
+		return;
+	why = __err_why(err);
+	len = strlen(why) + 1;
+	copy = malloc(len);
+	if (copy)
+		err->msg = memcpy(copy, why, len);
+}
+
+// Out of line, __builtin_longjmp cannot be used in the function of the
+// __builtin_setjmp, which a THROW in the body of a TRY_FAST would be.
+__attribute__((noinline))
+void __cerr_fast_jump(t_err_ctx *err) {
+	__builtin_longjmp((void **)err->frame, 1);
+}
+// Pop and call the records down to base, each one is popped before its call
+void __cerr_defer_run(uint32_t base) {
+	t_cerr_defer	d;
+
+	while (g__cerr_ndefers > base) {
+		d = g__cerr_defers[--g__cerr_ndefers];
+		d.fn(d.arg);
+	}
+}
+
+// A char * is copied up to the precision of its %s, or kept as a pointer
+// when the format does not print it as a string
+void __cerr_set_str(t_cerr_throw *t, t_cerr_arg *a) {
+	int		prec = __cerr_fmt_str(t->fmt, t->argc - 1);
+	size_t	len = CERR_MSG_SIZE - t->slen - 1;
+
+	if (prec == __CERR_P_RAW) {
+		a->kind = __CERR_A_RAW;
+		return;
+	}
+	if (prec == __CERR_P_ARG)
+		prec = t->argc > 1 && a[-1].size == sizeof(int) ? a[-1].val.i32
+			: __CERR_P_ALL;
+	if (prec >= 0 && (size_t)prec < len)
+		len = prec;
+	len = strnlen(a->val.p, len);
+	memcpy(t->strs + t->slen, a->val.p, len);
+	t->strs[t->slen + len] = '\0';
+	a->str = t->slen;
+	t->slen += len + (t->slen + len + 1 < CERR_MSG_SIZE);
+}
+
+// Same as __cerr_defer_run for a throw, the reason is kept aside while the
+// cleanups run, one may throw and catch its own
+void __cerr_defer_unwind(uint32_t base) {
+	t_cerr_throw	t = g__cerr_throw;
+
+	__cerr_defer_run(base);
+	g__cerr_throw = t;
+}
+
+// Highest address of the stack of the thread, looked up on its first throw
+static uintptr_t __cerr_stack_top(void) {
+	pthread_attr_t	attr;
+	void			*addr;
+	size_t			size;
+
+	if (__builtin_expect(g__cerr_stack_top != 0, 1))
+		return g__cerr_stack_top;
+	if (pthread_getattr_np(pthread_self(), &attr))
+		return 0;
+	if (!pthread_attr_getstack(&attr, &addr, &size))
+		g__cerr_stack_top = (uintptr_t)addr + size;
+	pthread_attr_destroy(&attr);
+	return g__cerr_stack_top;
+}
+
+// Follow the frame pointers from the THROW, each frame starts with the frame
+// pointer of its caller then the return address. A frame built without frame
+// pointer ends the walk: the next one must be higher, aligned and still on
+// the stack of the thread. No allocation and no symbol lookup.
+__attribute__((noinline))
+void __cerr_backtrace(t_cerr_throw *t) {
+	void		**fp = __builtin_frame_address(0);
+	uintptr_t	top = __cerr_stack_top();
+	uint32_t	n = 0;
+
+	while (n < CERR_BACKTRACE_DEPTH && fp[1]) {
+		t->frames[n++] = fp[1];
+		if ((void **)fp[0] <= fp || (uintptr_t)fp[0] % sizeof(void *)
+			|| (uintptr_t)((void **)fp[0] + 2) > top)
+			break;
+		fp = fp[0];
+	}
+	t->depth = n;
+}
+
+// backtrace_symbols gives the function when it is exported, the module and
+// the offset otherwise, enough for addr2line.
+void __cerr_trace(void) {
+	const t_cerr_throw	*t = &g__cerr_throw;
+	char				**syms;
+
+	if (!t->depth)
+		return;
+	syms = backtrace_symbols(t->frames, (int)t->depth);
+	for (uint32_t i = 0; i < t->depth; ++i) {
+		if (syms)
+			LOG_ERR(__CERR_M_FRAME, i, syms[i]);
+		else
+			LOG_ERR(__CERR_M_FRAME_RAW, i, t->frames[i]);
+	}
+	free(syms);
+}
+#endif
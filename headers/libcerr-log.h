@@ -1,6 +1,24 @@
 #pragma once
 
+// The implementation uses POSIX and GNU functions (strnlen, syscall,
+// sem_timedwait, pthread_getattr_np, MAP_ANONYMOUS...) that -std=c11 hides,
+// the rest of the headers only needs ISO C. The macro only works before the
+// first system header of the translation unit: include libcerr first in the
+// one defining CERR_IMPLEMENTATION, or build it with -D_GNU_SOURCE.
+# if defined(CERR_IMPLEMENTATION) && !defined(_GNU_SOURCE)
+#  define _GNU_SOURCE
+# endif
+
+# include <stddef.h>
 # include <stdio.h>
+# include <stdint.h>
+# include <string.h>
+
+#if defined(__STDC_VERSION__) && __STDC_VERSION__ >= 201112L
+  #define CERR_TLS _Thread_local
+#else
+  #define CERR_TLS __thread
+#endif
 
 // ╔════════════════════════════════[ LOGGING ]═══════════════════════════════╗
 
@@ -14,6 +32,17 @@
 #  define LOG_LEVEL __LOG_LEVELS
 # endif
 
+// Module of the file, its runtime level can be set apart from the others
+# ifndef LOG_MODULE
+#  define LOG_MODULE "default"
+# endif
+
+// Runtime level of a module until CERR_LOG_LEVEL or LOG_SET_LEVEL change it,
+// LOG_LEVEL stays the compile-time ceiling
+# ifndef LOG_DEFAULT_LEVEL
+#  define LOG_DEFAULT_LEVEL LOG_LEVEL
+# endif
+
 # define 	__F_COLOR(C, X)		C X __F_RESET
 # define	__F_SEP(C)			__F_BOLD(__F_COLOR(C, "%10s"))
 # define	__F_BOLD(X)			"\033[1m" X "\033[22m"
@@ -28,43 +57,1452 @@
 # define	__C_GRAY			"\033[90m"
 # define	__F_RESET			"\033[0m"
 
-# ifndef NVERBOSE
+// Record header "[seconds.micros tid] " before the level tag of each line
+// with LOG_HEADER, from the cheap LOG_CLOCK
+# ifndef LOG_CLOCK
+#  define LOG_CLOCK	CLOCK_MONOTONIC_COARSE
+# endif
+
+// 0 never colors, 1 always does, -1 only colors the terminals
+# ifndef LOG_COLOR
+#  define LOG_COLOR	-1
+# endif
+
+// A whole line is built in a thread buffer and sent with a single fwrite
+__attribute__((format(printf, 4, 5)))
+void	__cerr_log_sync(FILE *f, const char *color, const char *title,
+	const char *fmt, ...);
+
+// The binary logs go through the rings of the asynchronous mode
+# if defined(LOG_BINARY) && !defined(LOG_ASYNC)
+#  define LOG_ASYNC
+# endif
+
+# if !defined(NVERBOSE) && defined(LOG_BINARY)
+#  define __LOG(COLOR, TITLE, MSG, ...)	\
+	__CERR_BLOG(COLOR, TITLE, MSG, ##__VA_ARGS__)
+
+#  define LOG_NL() \
+	__CERR_BLOG("", "", "")
+
+#  define LOG_FLUSH() \
+	__cerr_log_flush()
+# elif !defined(NVERBOSE) && defined(LOG_ASYNC)
+#  define __LOG(COLOR, TITLE, MSG, ...)	\
+	__cerr_log_async(LOG_FDOUT, COLOR, TITLE, MSG, ##__VA_ARGS__)
+
+#  define LOG_NL() \
+	__cerr_log_async(LOG_FDOUT, NULL, NULL, "%s", "")
+
+#  define LOG_FLUSH() \
+	__cerr_log_flush()
+# elif !defined(NVERBOSE)
 #  define __LOG(COLOR, TITLE, MSG, ...)	\
-	fprintf(LOG_FDOUT, __F_SEP(COLOR) " > " MSG "\n", TITLE, ##__VA_ARGS__)
+	__cerr_log_sync(LOG_FDOUT, COLOR, TITLE, MSG, ##__VA_ARGS__)
 
 #  define LOG_NL() \
 	fprintf(LOG_FDOUT, "\n")
+
+#  define LOG_FLUSH() \
+	fflush(LOG_FDOUT)
 # else
 #  define __LOG(COLOR, TITLE, MSG, ...)	((void)0)
 #  define LOG_NL()						((void)0)
+#  define LOG_FLUSH()					((void)0)
+# endif
+
+// A call site below the level of its module costs a load and a branch
+# ifndef NVERBOSE
+#  define __LOG_IF(LEVEL, COLOR, TITLE, MSG, ...)                              \
+	(__builtin_expect(__atomic_load_n(&__cerr_logmod.level, __ATOMIC_RELAXED)  \
+		>= (LEVEL), 0) ? (void)__LOG(COLOR, TITLE, MSG, ##__VA_ARGS__)         \
+		: (void)0)
+# else
+#  define __LOG_IF(LEVEL, COLOR, TITLE, MSG, ...)	((void)0)
 # endif
 
 # if LOG_LEVEL >= __LOG_LEVELS
-#  define LOG_DEBUG(MSG, ...) __LOG(__C_BLUE, "debug: ", MSG, ##__VA_ARGS__)
+#  define LOG_DEBUG(MSG, ...) \
+	__LOG_IF(__LOG_LEVELS, __C_BLUE, "debug: ", MSG, ##__VA_ARGS__)
 # else
 #  define LOG_DEBUG(MSG, ...) ((void)0)
 # endif
 
 # if LOG_LEVEL >= __LOG_LEVELS - 1
-#  define LOG_INFO(MSG, ...) __LOG(__C_CYAN, "info: ", MSG, ##__VA_ARGS__)
+#  define LOG_INFO(MSG, ...) \
+	__LOG_IF(__LOG_LEVELS - 1, __C_CYAN, "info: ", MSG, ##__VA_ARGS__)
 # else
 #  define LOG_INFO(MSG, ...) ((void)0)
 # endif
 
 # if LOG_LEVEL >= __LOG_LEVELS - 2
-#  define LOG_WARN(MSG, ...) __LOG(__C_YELLOW, "warning: ", MSG, ##__VA_ARGS__)
+#  define LOG_WARN(MSG, ...) \
+	__LOG_IF(__LOG_LEVELS - 2, __C_YELLOW, "warning: ", MSG, ##__VA_ARGS__)
 # else
 #  define LOG_WARN(MSG, ...) ((void)0)
 # endif
 
 # if LOG_LEVEL >= __LOG_LEVELS - 3
-#  define LOG_OK(MSG, ...) __LOG(__C_GREEN, "done: ", MSG, ##__VA_ARGS__)
+#  define LOG_OK(MSG, ...) \
+	__LOG_IF(__LOG_LEVELS - 3, __C_GREEN, "done: ", MSG, ##__VA_ARGS__)
 # else
 #  define LOG_OK(MSG, ...) ((void)0)
 # endif
 
 # if LOG_LEVEL >= __LOG_LEVELS - 3
-#  define LOG_ERR(MSG, ...) __LOG(__C_RED, "error: ", MSG, ##__VA_ARGS__)
+#  define LOG_ERR(MSG, ...) \
+	__LOG_IF(__LOG_LEVELS - 3, __C_RED, "error: ", MSG, ##__VA_ARGS__)
 # else
 #  define LOG_ERR(MSG, ...) ((void)0)
 # endif
+
+// ---- Sampled logs
+// EVERY_N logs the first call of every N, ONCE the first call only and
+// RATELIMIT at most PER_SEC lines a second, in bursts of up to PER_SEC.
+// The state is per call site. A suppressed call evaluates no argument and
+// the next line it lets through ends with the number it suppressed.
+
+// State of a sampled call site: calls seen or next allowed time, and the
+// lines suppressed since the last one written. A rate limited site also
+// keeps the time stamp counter value before which it stays closed.
+typedef struct s_cerr_limit {
+	uint64_t	next;
+	uint64_t	suppressed;
+	uint64_t	until;
+}	t_cerr_limit;
+
+// Whether suppressed calls check the counter before the clock: -1 until the
+// first rate limited call times both reads, then 1 where the counter is the
+// cheaper one. Under a vDSO the coarse clock is a load and rarely loses.
+extern int g__cerr_limit_tsc;
+
+# ifndef NVERBOSE
+#  define __LOG_LIMITED(LEVEL, COLOR, TITLE, ALLOW, MSG, ...) ({               \
+	static t_cerr_limit __lim;                                                 \
+	uint64_t __sup;                                                            \
+	if (LOG_LEVEL >= (LEVEL) && __builtin_expect(__atomic_load_n(              \
+		&__cerr_logmod.level, __ATOMIC_RELAXED) >= (LEVEL), 0) && (ALLOW)) {   \
+		__sup = __atomic_load_n(&__lim.suppressed, __ATOMIC_RELAXED)           \
+			? __atomic_exchange_n(&__lim.suppressed, 0, __ATOMIC_RELAXED) : 0; \
+		if (__sup)                                                             \
+			__LOG(COLOR, TITLE, MSG __CERR_M_SUPPRESSED, ##__VA_ARGS__,        \
+				(unsigned long long)__sup);                                    \
+		else                                                                   \
+			__LOG(COLOR, TITLE, MSG, ##__VA_ARGS__);                           \
+	}                                                                          \
+	(void)0;                                                                   \
+})
+# else
+#  define __LOG_LIMITED(LEVEL, COLOR, TITLE, ALLOW, MSG, ...)	((void)0)
+# endif
+
+# define __CERR_M_SUPPRESSED " (%llu suppressed)"
+
+# define LOG_DEBUG_EVERY_N(N, MSG, ...)                                        \
+	__LOG_LIMITED(__LOG_LEVELS, __C_BLUE, "debug: ",                           \
+		__cerr_log_every(&__lim, (N)), MSG, ##__VA_ARGS__)
+# define LOG_DEBUG_ONCE(MSG, ...)                                              \
+	__LOG_LIMITED(__LOG_LEVELS, __C_BLUE, "debug: ",                           \
+		__cerr_log_once(&__lim), MSG, ##__VA_ARGS__)
+# define LOG_DEBUG_RATELIMIT(PER_SEC, MSG, ...)                                \
+	__LOG_LIMITED(__LOG_LEVELS, __C_BLUE, "debug: ",                           \
+		__cerr_log_ratelimit(&__lim, (PER_SEC)), MSG, ##__VA_ARGS__)
+
+# define LOG_INFO_EVERY_N(N, MSG, ...)                                         \
+	__LOG_LIMITED(__LOG_LEVELS - 1, __C_CYAN, "info: ",                        \
+		__cerr_log_every(&__lim, (N)), MSG, ##__VA_ARGS__)
+# define LOG_INFO_ONCE(MSG, ...)                                               \
+	__LOG_LIMITED(__LOG_LEVELS - 1, __C_CYAN, "info: ",                        \
+		__cerr_log_once(&__lim), MSG, ##__VA_ARGS__)
+# define LOG_INFO_RATELIMIT(PER_SEC, MSG, ...)                                 \
+	__LOG_LIMITED(__LOG_LEVELS - 1, __C_CYAN, "info: ",                        \
+		__cerr_log_ratelimit(&__lim, (PER_SEC)), MSG, ##__VA_ARGS__)
+
+# define LOG_WARN_EVERY_N(N, MSG, ...)                                         \
+	__LOG_LIMITED(__LOG_LEVELS - 2, __C_YELLOW, "warning: ",                   \
+		__cerr_log_every(&__lim, (N)), MSG, ##__VA_ARGS__)
+# define LOG_WARN_ONCE(MSG, ...)                                               \
+	__LOG_LIMITED(__LOG_LEVELS - 2, __C_YELLOW, "warning: ",                   \
+		__cerr_log_once(&__lim), MSG, ##__VA_ARGS__)
+# define LOG_WARN_RATELIMIT(PER_SEC, MSG, ...)                                 \
+	__LOG_LIMITED(__LOG_LEVELS - 2, __C_YELLOW, "warning: ",                   \
+		__cerr_log_ratelimit(&__lim, (PER_SEC)), MSG, ##__VA_ARGS__)
+
+# define LOG_OK_EVERY_N(N, MSG, ...)                                           \
+	__LOG_LIMITED(__LOG_LEVELS - 3, __C_GREEN, "done: ",                       \
+		__cerr_log_every(&__lim, (N)), MSG, ##__VA_ARGS__)
+# define LOG_OK_ONCE(MSG, ...)                                                 \
+	__LOG_LIMITED(__LOG_LEVELS - 3, __C_GREEN, "done: ",                       \
+		__cerr_log_once(&__lim), MSG, ##__VA_ARGS__)
+# define LOG_OK_RATELIMIT(PER_SEC, MSG, ...)                                   \
+	__LOG_LIMITED(__LOG_LEVELS - 3, __C_GREEN, "done: ",                       \
+		__cerr_log_ratelimit(&__lim, (PER_SEC)), MSG, ##__VA_ARGS__)
+
+# define LOG_ERR_EVERY_N(N, MSG, ...)                                          \
+	__LOG_LIMITED(__LOG_LEVELS - 3, __C_RED, "error: ",                        \
+		__cerr_log_every(&__lim, (N)), MSG, ##__VA_ARGS__)
+# define LOG_ERR_ONCE(MSG, ...)                                                \
+	__LOG_LIMITED(__LOG_LEVELS - 3, __C_RED, "error: ",                        \
+		__cerr_log_once(&__lim), MSG, ##__VA_ARGS__)
+# define LOG_ERR_RATELIMIT(PER_SEC, MSG, ...)                                  \
+	__LOG_LIMITED(__LOG_LEVELS - 3, __C_RED, "error: ",                        \
+		__cerr_log_ratelimit(&__lim, (PER_SEC)), MSG, ##__VA_ARGS__)
+
+// A suppressed call is a single increment, the count is known when it passes
+static inline int __cerr_log_every(t_cerr_limit *l, uint64_t n) {
+	uint64_t	seen = __atomic_fetch_add(&l->next, 1, __ATOMIC_RELAXED);
+
+	n = n ? n : 1;
+	if (seen % n)
+		return 0;
+	if (seen)
+		__atomic_store_n(&l->suppressed, n - 1, __ATOMIC_RELAXED);
+	return 1;
+}
+
+// Read first, the line of a site already logged is never written again
+static inline int __cerr_log_once(t_cerr_limit *l) {
+	return !__atomic_load_n(&l->next, __ATOMIC_RELAXED)
+		&& !__atomic_exchange_n(&l->next, 1, __ATOMIC_RELAXED);
+}
+
+int		__cerr_log_ratelimit(t_cerr_limit *l, uint32_t per_sec);
+
+// Set the runtime level of the modules named MODULE, of every module if it
+// is NULL, returns how many changed. Levels above LOG_LEVEL stay stripped.
+# define LOG_SET_LEVEL(MODULE, LEVEL)	__cerr_log_set_level(MODULE, LEVEL)
+
+// Runtime level of the module, -1 if no file registered it
+# define LOG_GET_LEVEL(MODULE)			__cerr_log_get_level(MODULE)
+
+// Runtime level of the files of a module, each file registers its own at load
+typedef struct s_cerr_logmod t_cerr_logmod;
+struct s_cerr_logmod {
+	t_cerr_logmod	*next;
+	const char		*name;
+	uint8_t			level;
+};
+
+int		__cerr_log_set_level(const char *name, int level);
+int		__cerr_log_get_level(const char *name);
+int		__cerr_log_rules(const char *rules, const char *name, int level);
+void	__cerr_logmod_register(t_cerr_logmod *m);
+
+# ifndef NVERBOSE
+__attribute__((unused))
+static t_cerr_logmod __cerr_logmod = {NULL, LOG_MODULE, LOG_DEFAULT_LEVEL};
+
+// Before the constructors of the user, CERR_LOG_LEVEL applies from there
+__attribute__((constructor(101)))
+static void __cerr_logmod_init(void) {
+	__cerr_logmod_register(&__cerr_logmod);
+}
+# endif
+
+// ╔═══════════════════════════════[ ARGUMENTS ]═══════════════════════════════╗
+// Arguments captured as raw bytes and formatted later, by THROW_MSG and by
+// the binary logs.
+
+// Maximum number of arguments of a deferred format
+# define __CERR_ARGS_MAX	12
+
+// One captured argument, kept as raw bytes until formatting.
+// char * arguments are copied, they may point into unwound frames, str is
+// the offset of the copy.
+typedef union u_cerr_val {
+	int8_t		i8;
+	uint8_t		u8;
+	int16_t		i16;
+	uint16_t	u16;
+	int32_t		i32;
+	uint32_t	u32;
+	int64_t		i64;
+	uint64_t	u64;
+	float		f32;
+	double		f64;
+	long double	f80;
+	const void	*p;
+}	t_cerr_val;
+
+typedef struct s_cerr_arg {
+	t_cerr_val	val;
+	uint32_t	str;
+	uint8_t		kind;
+	uint8_t		size;
+}	t_cerr_arg;
+
+# define __CERR_A_RAW	0
+# define __CERR_A_SINT	1
+# define __CERR_A_UINT	2
+# define __CERR_A_FLT	3
+# define __CERR_A_STR	4
+
+# define __CERR_ARG_KIND(V) _Generic((V),                                      \
+	char: (char)-1 < 0 ? __CERR_A_SINT : __CERR_A_UINT,                        \
+	signed char: __CERR_A_SINT,         unsigned char: __CERR_A_UINT,          \
+	short: __CERR_A_SINT,               unsigned short: __CERR_A_UINT,         \
+	int: __CERR_A_SINT,                 unsigned int: __CERR_A_UINT,           \
+	long: __CERR_A_SINT,                unsigned long: __CERR_A_UINT,          \
+	long long: __CERR_A_SINT,           unsigned long long: __CERR_A_UINT,     \
+	_Bool: __CERR_A_UINT,               float: __CERR_A_FLT,                   \
+	double: __CERR_A_FLT,               long double: __CERR_A_FLT,             \
+	char *: __CERR_A_STR,               const char *: __CERR_A_STR,            \
+	default: __CERR_A_RAW)
+
+// Apply F to each argument, up to __CERR_ARGS_MAX. Empty arguments are told
+// apart with __VA_OPT__, the GNU comma elision keeps the comma of an empty
+// __VA_ARGS__ passed on under -std=c11.
+# define __CERR_CAT(A, B)	__CERR_CAT_(A, B)
+# define __CERR_CAT_(A, B)	A##B
+# define __CERR_NARGS(...)                                                     \
+	__CERR_NARGS_(_ __VA_OPT__(,) __VA_ARGS__,                                 \
+		12, 11, 10, 9, 8, 7, 6, 5, 4, 3, 2, 1, 0)
+# define __CERR_NARGS_(_, _1, _2, _3, _4, _5, _6, _7, _8, _9, _10, _11, _12,   \
+	N, ...) N
+# define __CERR_MAP(F, ...)                                                    \
+	__CERR_CAT(__CERR_MAP_, __CERR_NARGS(__VA_ARGS__))(F __VA_OPT__(,) __VA_ARGS__)
+# define __CERR_MAP_0(F)
+# define __CERR_MAP_1(F, X)			F(X)
+# define __CERR_MAP_2(F, X, ...)	F(X) __CERR_MAP_1(F, __VA_ARGS__)
+# define __CERR_MAP_3(F, X, ...)	F(X) __CERR_MAP_2(F, __VA_ARGS__)
+# define __CERR_MAP_4(F, X, ...)	F(X) __CERR_MAP_3(F, __VA_ARGS__)
+# define __CERR_MAP_5(F, X, ...)	F(X) __CERR_MAP_4(F, __VA_ARGS__)
+# define __CERR_MAP_6(F, X, ...)	F(X) __CERR_MAP_5(F, __VA_ARGS__)
+# define __CERR_MAP_7(F, X, ...)	F(X) __CERR_MAP_6(F, __VA_ARGS__)
+# define __CERR_MAP_8(F, X, ...)	F(X) __CERR_MAP_7(F, __VA_ARGS__)
+# define __CERR_MAP_9(F, X, ...)	F(X) __CERR_MAP_8(F, __VA_ARGS__)
+# define __CERR_MAP_10(F, X, ...)	F(X) __CERR_MAP_9(F, __VA_ARGS__)
+# define __CERR_MAP_11(F, X, ...)	F(X) __CERR_MAP_10(F, __VA_ARGS__)
+# define __CERR_MAP_12(F, X, ...)	F(X) __CERR_MAP_11(F, __VA_ARGS__)
+
+// Never called, lets the compiler check deferred formats and arguments
+__attribute__((format(printf, 1, 2)))
+static inline void __cerr_check_fmt(const char *fmt, ...) { (void)fmt; }
+
+size_t	__cerr_vformat(char *dst, size_t n, const char *fmt,
+	const t_cerr_arg *args, uint32_t argc, const char *strs, int err);
+
+// How __cerr_fmt_str says the argument is printed, else the precision of its %s
+# define __CERR_P_RAW	-3	// not by a %s, kept as a pointer
+# define __CERR_P_ARG	-2	// by a %.*s, the argument before is the precision
+# define __CERR_P_ALL	-1	// by a %s without precision
+
+int		__cerr_fmt_str(const char *fmt, uint32_t i);
+
+// ╔═════════════════════════════════[ ASYNC ]═════════════════════════════════╗
+// With LOG_ASYNC, a log line is formatted in a ring owned by the calling
+// thread and a writer thread sends the rings to their files with writev.
+
+# ifdef LOG_ASYNC
+
+// Bytes of each thread ring, must be a power of two
+#  ifndef LOG_RING_SIZE
+#   define LOG_RING_SIZE	0x10000
+#  endif
+
+// Longest line kept, longer ones are truncated
+#  ifndef LOG_LINE_SIZE
+#   define LOG_LINE_SIZE	512
+#  endif
+
+// A full ring drops the line and counts it, LOG_BLOCK waits for room instead
+
+// One formatted line in a ring, fd is -1 for the padding before a wrap
+typedef struct s_cerr_rec {
+	uint32_t	len;
+	int32_t		fd;
+}	t_cerr_rec;
+
+// Single producer (its thread), single consumer (whoever holds the log lock)
+typedef struct s_cerr_ring t_cerr_ring;
+struct s_cerr_ring {
+	t_cerr_ring	*link;
+	uint32_t	state;
+	uint32_t	dropped;
+	uint64_t	head __attribute__((aligned(64)));
+	uint64_t	tail __attribute__((aligned(64)));
+	char		data[LOG_RING_SIZE] __attribute__((aligned(64)));
+};
+
+extern CERR_TLS t_cerr_ring *g__cerr_ring;
+
+// Without a title, the line is only the message
+__attribute__((format(printf, 4, 5)))
+void	__cerr_log_async(FILE *f, const char *color, const char *title,
+	const char *fmt, ...);
+void	__cerr_log_flush(void);
+
+# endif
+
+// ╔═════════════════════════════════[ BINARY ]════════════════════════════════╗
+// With LOG_BINARY, each call site registers a static descriptor once and a
+// log line is only its id, a timestamp and the raw arguments. The rings
+// write these records and tools/cerr-decode turns the file back into text.
+
+// Every record starts with this header, size counts it. A SITE record
+// carries the line then the color, title, format and file strings, a LOG
+// record its arguments and a DROP record the lines lost in site.
+typedef struct __attribute__((packed)) s_cerr_brec {
+	uint16_t	size;
+	uint8_t		type;
+	uint8_t		argc;
+	uint32_t	site;
+	uint64_t	time;
+	int32_t		err;
+	uint32_t	tid;
+}	t_cerr_brec;
+
+# define __CERR_B_SITE	1
+# define __CERR_B_LOG	2
+# define __CERR_B_DROP	3
+
+// Static descriptor of a call site, id stays 0 until its first line
+typedef struct s_cerr_logsite {
+	const char	*color;
+	const char	*title;
+	const char	*fmt;
+	const char	*file;
+	uint32_t	line;
+	uint32_t	id;
+}	t_cerr_logsite;
+
+// Flags of __cerr_log_decode: time and thread of each line, no colors
+# define __CERR_DECODE_STAMP	1
+# define __CERR_DECODE_PLAIN	2
+
+size_t	__cerr_log_decode(FILE *out, const char *data, size_t len, int flags);
+
+# ifdef LOG_BINARY
+
+_Static_assert(LOG_LINE_SIZE <= 0xffff, "LOG_LINE_SIZE");
+
+// Arguments of one line, a record is never longer than LOG_LINE_SIZE
+typedef struct s_cerr_bbuf {
+	const char	*fmt;
+	uint32_t	len;
+	uint32_t	argc;
+	uint32_t	last;
+	char		data[LOG_LINE_SIZE - sizeof(t_cerr_brec)];
+}	t_cerr_bbuf;
+
+void	__cerr_log_binary(FILE *f, t_cerr_logsite *site, const t_cerr_bbuf *b);
+void	__cerr_bbuf_str(t_cerr_bbuf *b, const char *str);
+
+// A statement expression, CATCH_LOG logs from a for increment
+#  define __CERR_BLOG(COLOR, TITLE, MSG, ...) ({                               \
+	static t_cerr_logsite __site = {COLOR, TITLE, MSG, __FILE__, __LINE__, 0}; \
+	t_cerr_bbuf __b;                                                           \
+	if (0) __cerr_check_fmt("%s" MSG, "", ##__VA_ARGS__);                      \
+	__b.fmt = MSG;                                                             \
+	__b.len = 0;                                                               \
+	__b.argc = 0;                                                              \
+	__CERR_MAP(__CERR_BLOG_ARG, ##__VA_ARGS__)                                 \
+	__cerr_log_binary(LOG_FDOUT, &__site, &__b);                               \
+})
+
+// Record one argument, arrays decay and keep their pointer type
+#  define __CERR_BLOG_ARG(X) {                                                 \
+	__auto_type __v = ((void)0, (X));                                          \
+	__cerr_bbuf_arg(&__b, __CERR_ARG_KIND(__v), &__v, sizeof(__v));            \
+}
+
+// Append one argument as its kind, size and bytes, last is its offset. The
+// argument that does not fit is dropped with the next ones.
+static inline void __cerr_bbuf_arg(t_cerr_bbuf *b, uint8_t kind,
+	const void *v, size_t size) {
+	char		*dst = b->data + b->len;
+	const char	*str = NULL;
+
+	if (size > sizeof(t_cerr_val))
+		size = sizeof(t_cerr_val);
+	if (kind == __CERR_A_STR)
+		memcpy(&str, v, sizeof(str));
+	if (str)
+		__cerr_bbuf_str(b, str);
+	else if (sizeof(b->data) - b->len < 2 + size)
+		b->len = sizeof(b->data);
+	else {
+		dst[0] = kind;
+		dst[1] = size;
+		memcpy(dst + 2, v, size);
+		b->last = b->len;
+		b->len += 2 + size;
+		++b->argc;
+	}
+}
+
+# endif
+
+# ifdef CERR_IMPLEMENTATION
+#  include <pthread.h>
+#  include <stdarg.h>
+#  include <stdlib.h>
+#  include <sys/syscall.h>
+#  include <time.h>
+#  include <unistd.h>
+
+#  define __CERR_M_DROPPED	"libcerr: log, dropped %u lines\n"
+#  define __CERR_LOG_ENV	"CERR_LOG_LEVEL"
+
+static t_cerr_logmod *g__cerr_logmods = NULL;
+
+static int __cerr_log_clamp(int level) {
+	return level < 0 ? 0 : level > __LOG_LEVELS ? __LOG_LEVELS : level;
+}
+
+// Level of the module name from rules like "3,net=4,db=0". A bare level is
+// for every module, the last rule that applies wins.
+int __cerr_log_rules(const char *rules, const char *name, int level) {
+	const char	*eq;
+	char		*end;
+	long		v;
+	size_t		len;
+
+	for (; rules && *rules; rules += len + (rules[len] == ',')) {
+		len = strcspn(rules, ",");
+		eq = memchr(rules, '=', len);
+		if (eq && ((size_t)(eq - rules) != strlen(name)
+			|| strncmp(rules, name, eq - rules)))
+			continue;
+		v = strtol(eq ? eq + 1 : rules, &end, 10);
+		if (end != (eq ? eq + 1 : rules))
+			level = __cerr_log_clamp(v);
+	}
+	return level;
+}
+
+void __cerr_logmod_register(t_cerr_logmod *m) {
+	__atomic_store_n(&m->level, __cerr_log_rules(getenv(__CERR_LOG_ENV),
+		m->name, m->level), __ATOMIC_RELAXED);
+	m->next = __atomic_load_n(&g__cerr_logmods, __ATOMIC_RELAXED);
+	while (!__atomic_compare_exchange_n(&g__cerr_logmods, &m->next, m, 1,
+		__ATOMIC_RELEASE, __ATOMIC_RELAXED))
+		;
+}
+
+int __cerr_log_set_level(const char *name, int level) {
+	int	n = 0;
+
+	for (t_cerr_logmod *m = __atomic_load_n(&g__cerr_logmods,
+		__ATOMIC_ACQUIRE); m; m = m->next) {
+		if (name && strcmp(m->name, name))
+			continue;
+		__atomic_store_n(&m->level, __cerr_log_clamp(level), __ATOMIC_RELAXED);
+		++n;
+	}
+	return n;
+}
+
+// Time stamp counter where there is one, 0 otherwise. It runs at a GHz or
+// more, fewer ticks than nanoseconds never make up the time they count.
+static inline uint64_t __cerr_log_ticks(void) {
+#  if defined(__x86_64__) || defined(__i386__)
+	return __builtin_ia32_rdtsc();
+#  else
+	return 0;
+#  endif
+}
+
+// Slack of the coarse clock, one kernel tick at HZ=100
+#  define __CERR_LIMIT_SLACK	10000000
+
+int g__cerr_limit_tsc = -1;
+
+static int __cerr_log_tsc(void) {
+	struct timespec		ts;
+	volatile uint64_t	sink = 0;
+	uint64_t			t0;
+	uint64_t			t1;
+	uint64_t			t2;
+
+	if (!__cerr_log_ticks())
+		return 0;
+	t0 = __cerr_log_ticks();
+	for (int i = 0; i < 16; ++i)
+		clock_gettime(CLOCK_MONOTONIC_COARSE, &ts);
+	t1 = __cerr_log_ticks();
+	for (int i = 0; i < 16; ++i)
+		sink += __cerr_log_ticks();
+	t2 = __cerr_log_ticks();
+	return t2 - t1 < t1 - t0;
+}
+
+// Token bucket kept as its next conforming time (GCRA), a line passes while
+// next is less than a second ahead. The coarse clock is a vDSO read of the
+// kernel tick, no syscall. Where the counter is cheaper, a suppressed call
+// also leaves as many ticks as nanoseconds to wait, less a kernel tick, in
+// until: the calls before them are suppressed on the counter alone, a token
+// cannot be there yet.
+int __cerr_log_ratelimit(t_cerr_limit *l, uint32_t per_sec) {
+	uint64_t		step = 1000000000 / (per_sec ? per_sec : 1);
+	int				tsc = __atomic_load_n(&g__cerr_limit_tsc, __ATOMIC_RELAXED);
+	uint64_t		tick = 0;
+	uint64_t		next;
+	uint64_t		now;
+	uint64_t		last;
+	struct timespec	ts;
+
+	if (__builtin_expect(tsc < 0, 0)) {
+		tsc = __cerr_log_tsc();
+		__atomic_store_n(&g__cerr_limit_tsc, tsc, __ATOMIC_RELAXED);
+	}
+	if (tsc)
+		tick = __cerr_log_ticks();
+	if (tick && tick < __atomic_load_n(&l->until, __ATOMIC_RELAXED)) {
+		__atomic_add_fetch(&l->suppressed, 1, __ATOMIC_RELAXED);
+		return 0;
+	}
+	clock_gettime(CLOCK_MONOTONIC_COARSE, &ts);
+	now = (uint64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+	last = now + 1000000000 - step;
+	next = __atomic_load_n(&l->next, __ATOMIC_RELAXED);
+	do {
+		if (next > last) {
+			if (tick && next - last > __CERR_LIMIT_SLACK)
+				__atomic_store_n(&l->until,
+					tick + next - last - __CERR_LIMIT_SLACK, __ATOMIC_RELAXED);
+			__atomic_add_fetch(&l->suppressed, 1, __ATOMIC_RELAXED);
+			return 0;
+		}
+	} while (!__atomic_compare_exchange_n(&l->next, &next,
+		(next > now ? next : now) + step, 1, __ATOMIC_RELAXED,
+		__ATOMIC_RELAXED));
+	return 1;
+}
+
+#  undef __CERR_LIMIT_SLACK
+
+int __cerr_log_get_level(const char *name) {
+	for (t_cerr_logmod *m = __atomic_load_n(&g__cerr_logmods,
+		__ATOMIC_ACQUIRE); m; m = m->next)
+		if (!strcmp(m->name, name))
+			return __atomic_load_n(&m->level, __ATOMIC_RELAXED);
+	return -1;
+}
+
+// Longest header and level tag, a title is cut at 32 bytes and a color
+// at 16
+#  define __CERR_LOG_PREFIX	128
+#  define __CERR_LOG_BUF		1024
+
+static CERR_TLS char g__cerr_log_buf[__CERR_LOG_BUF];
+#  if LOG_COLOR < 0
+static uint8_t g__cerr_log_tty[256];
+#  endif
+
+#  if defined(LOG_HEADER) || defined(LOG_BINARY)
+static CERR_TLS int g__cerr_tid = 0;
+
+static void __cerr_tid_reset(void) {
+	g__cerr_tid = 0;
+}
+
+static void __cerr_tid_atfork(void) {
+	pthread_atfork(NULL, NULL, __cerr_tid_reset);
+}
+
+// Kernel id of the calling thread, asked once per thread and after a fork
+static int __cerr_log_tid(void) {
+	static pthread_once_t	once = PTHREAD_ONCE_INIT;
+
+	if (__builtin_expect(!g__cerr_tid, 0)) {
+		pthread_once(&once, __cerr_tid_atfork);
+		g__cerr_tid = syscall(SYS_gettid);
+	}
+	return g__cerr_tid;
+}
+#  endif
+
+// Whether the lines sent to fd are colored, isatty is cached per fd
+static int __cerr_log_colored(int fd) {
+#  if LOG_COLOR >= 0
+	(void)fd;
+	return LOG_COLOR;
+#  else
+	uint8_t	*cached = fd >= 0 && fd < 256 ? &g__cerr_log_tty[fd] : NULL;
+	uint8_t	tty = cached ? __atomic_load_n(cached, __ATOMIC_RELAXED) : 0;
+
+	if (!tty) {
+		tty = 1 + (fd >= 0 && isatty(fd));
+		if (cached)
+			__atomic_store_n(cached, tty, __ATOMIC_RELAXED);
+	}
+	return tty == 2;
+#  endif
+}
+
+static inline char *__cerr_log_put(char *dst, const char *str, size_t max) {
+	size_t	len = strnlen(str, max);
+
+	memcpy(dst, str, len);
+	return dst + len;
+}
+
+#  ifdef LOG_HEADER
+// Decimal v right-aligned on width chars at least
+static char *__cerr_log_uint(char *dst, uint64_t v, int width, char pad) {
+	char	digits[20];
+	int		n = 0;
+
+	do
+		digits[n++] = '0' + v % 10;
+	while ((v /= 10));
+	for (; width > n; --width)
+		*dst++ = pad;
+	while (n)
+		*dst++ = digits[--n];
+	return dst;
+}
+#  endif
+
+// Header and level tag of a line, at most __CERR_LOG_PREFIX bytes. The
+// colored tag is the same as __F_SEP(color) with its title.
+static size_t __cerr_log_prefix(char *dst, int fd, const char *color,
+	const char *title) {
+	char			*p = dst;
+	int				tty = __cerr_log_colored(fd);
+	size_t			len = strnlen(title, 32);
+#  ifdef LOG_HEADER
+	struct timespec	now;
+
+	clock_gettime(LOG_CLOCK, &now);
+	if (tty)
+		p = __cerr_log_put(p, __C_GRAY, 8);
+	*p++ = '[';
+	p = __cerr_log_uint(p, now.tv_sec, 5, ' ');
+	*p++ = '.';
+	p = __cerr_log_uint(p, now.tv_nsec / 1000, 6, '0');
+	*p++ = ' ';
+	p = __cerr_log_uint(p, __cerr_log_tid(), 0, ' ');
+	*p++ = ']';
+	*p++ = ' ';
+	if (tty)
+		p = __cerr_log_put(p, __F_RESET, 8);
+#  endif
+	if (tty) {
+		p = __cerr_log_put(p, "\033[1m", 8);
+		p = __cerr_log_put(p, color, 16);
+	}
+	if (len < 10) {
+		memset(p, ' ', 10 - len);
+		p += 10 - len;
+	}
+	memcpy(p, title, len);
+	p += len;
+	if (tty)
+		p = __cerr_log_put(p, __F_RESET "\033[22m", 16);
+	memcpy(p, " > ", 3);
+	return p + 3 - dst;
+}
+
+void __cerr_log_sync(FILE *f, const char *color, const char *title,
+	const char *fmt, ...) {
+	char	*buf = g__cerr_log_buf;
+	size_t	len = __cerr_log_prefix(buf, fileno(f), color, title);
+	size_t	room = __CERR_LOG_BUF - len - 1;
+	va_list	ap;
+	int		n;
+
+	va_start(ap, fmt);
+	n = vsnprintf(buf + len, room, fmt, ap);
+	va_end(ap);
+	if (n >= 0 && (size_t)n < room) {
+		buf[len + n] = '\n';
+		fwrite(buf, 1, len + n + 1, f);
+		return;
+	}
+	// Longer than the buffer, the message goes through stdio on its own
+	fwrite(buf, 1, len, f);
+	va_start(ap, fmt);
+	vfprintf(f, fmt, ap);
+	va_end(ap);
+	fputc('\n', f);
+}
+
+static inline void __cerr_advance(char **dst, size_t *n, int w) {
+	size_t	len = w < 0 ? 0 : (size_t)w;
+
+	if (len >= *n)
+		len = *n - 1;
+	*dst += len;
+	*n -= len;
+}
+
+static inline uintmax_t __cerr_arg_int(const t_cerr_arg *a) {
+	int	sign = a->kind == __CERR_A_SINT;
+
+	switch (a->size) {
+		case 1: return sign ? (uintmax_t)a->val.i8 : a->val.u8;
+		case 2: return sign ? (uintmax_t)a->val.i16 : a->val.u16;
+		case 4: return sign ? (uintmax_t)a->val.i32 : a->val.u32;
+		default: return a->val.u64;
+	}
+}
+
+static inline long double __cerr_arg_flt(const t_cerr_arg *a) {
+	if (a->kind != __CERR_A_FLT)
+		return (long double)(intmax_t)__cerr_arg_int(a);
+	switch (a->size) {
+		case 4: return a->val.f32;
+		case 8: return a->val.f64;
+		default: return a->val.f80;
+	}
+}
+
+// How the argument i of fmt is printed, its arguments read as by
+// __cerr_vformat: a char * is only read up to the precision of its %s, and
+// not at all by another conversion. Called when a string is captured.
+int __cerr_fmt_str(const char *fmt, uint32_t i) {
+	const char	*f = fmt;
+	uint32_t	n = 0;
+	int			prec;
+
+	while (*f) {
+		if (*f != '%' || f[1] == '%') {
+			f += 1 + (*f == '%');
+			continue;
+		}
+		f += 1 + strspn(f + 1, "-+ #0'");
+		for (prec = __CERR_P_ALL; *f == '*' || *f == '.'
+			|| (*f >= '0' && *f <= '9'); ++f) {
+			if (*f == '*' && n++ == i)
+				return __CERR_P_RAW;
+			if (*f == '.')
+				prec = f[1] == '*' ? __CERR_P_ARG : 0;
+			else if (*f != '*' && prec >= 0 && prec < 0xffffff)
+				prec = prec * 10 + *f - '0';
+		}
+		while (*f && strchr("hljztL", *f))
+			++f;
+		if (!*f)
+			break;
+		if (*f++ == 'm')
+			continue;
+		if (n++ == i)
+			return f[-1] == 's' ? prec : __CERR_P_RAW;
+	}
+	return __CERR_P_RAW;
+}
+
+// Print one argument with the conversion SPEC, W holds '*' width/precision
+#  define __CERR_EMIT(V) (nw == 0 ? snprintf(dst, n, spec, V)                  \
+	: nw == 1 ? snprintf(dst, n, spec, w[0], V)                                \
+	: snprintf(dst, n, spec, w[0], w[1], V))
+
+// Print fmt with the captured arguments, the strings of which are in strs,
+// %m prints strerror(err). Returns the length written, at most n - 1.
+size_t __cerr_vformat(char *dst, size_t n, const char *fmt,
+	const t_cerr_arg *args, uint32_t argc, const char *strs, int err) {
+	const t_cerr_arg	*a;
+	const char			*f = fmt;
+	const char			*start;
+	char				*begin = dst;
+	uint32_t			i = 0;
+	char				spec[32];
+	char				len[2];
+	uintmax_t			v;
+	int					w[2];
+	int					nw;
+	int					r;
+
+	while (*f && n > 1) {
+		if (*f != '%' || f[1] == '%') {
+			*dst++ = *f;
+			f += 1 + (*f == '%');
+			--n;
+			continue;
+		}
+		start = f++;
+		f += strspn(f, "-+ #0'");
+		for (nw = 0; *f == '*' || *f == '.' || (*f >= '0' && *f <= '9'); ++f)
+			if (*f == '*' && nw < 2 && i < argc)
+				w[nw++] = (int)__cerr_arg_int(&args[i++]);
+		len[0] = len[1] = 0;
+		while (*f && strchr("hljztL", *f))
+			len[len[0] != 0] = *f++;
+		if (!*f || (size_t)(f + 1 - start) >= sizeof(spec))
+			break;
+		memcpy(spec, start, f + 1 - start);
+		spec[f + 1 - start] = '\0';
+		if (*f == 'm') {
+			r = snprintf(dst, n, "%s", strerror(err));
+			__cerr_advance(&dst, &n, r);
+			++f;
+			continue;
+		}
+		if (i >= argc)
+			break;
+		a = &args[i++];
+		v = __cerr_arg_int(a);
+		switch (*f++) {
+			case 'd': case 'i':
+				r = len[1] == 'l' ? __CERR_EMIT((long long)v)
+					: len[0] == 'l' ? __CERR_EMIT((long)v)
+					: len[0] == 'j' ? __CERR_EMIT((intmax_t)v)
+					: len[0] == 'z' || len[0] == 't' ? __CERR_EMIT((ptrdiff_t)v)
+					: __CERR_EMIT((int)v);
+				break;
+			case 'u': case 'o': case 'x': case 'X':
+				r = len[1] == 'l' ? __CERR_EMIT((unsigned long long)v)
+					: len[0] == 'l' ? __CERR_EMIT((unsigned long)v)
+					: len[0] == 'j' ? __CERR_EMIT((uintmax_t)v)
+					: len[0] == 'z' || len[0] == 't' ? __CERR_EMIT((size_t)v)
+					: __CERR_EMIT((unsigned)v);
+				break;
+			case 'c':
+				r = __CERR_EMIT((int)v);
+				break;
+			case 'e': case 'E': case 'f': case 'F':
+			case 'g': case 'G': case 'a': case 'A':
+				r = len[0] == 'L' ? __CERR_EMIT(__cerr_arg_flt(a))
+					: __CERR_EMIT((double)__cerr_arg_flt(a));
+				break;
+			case 's':
+				r = a->kind == __CERR_A_STR && a->val.p
+					? __CERR_EMIT(strs + a->str) : __CERR_EMIT(a->val.p);
+				break;
+			case 'p':
+				r = __CERR_EMIT(a->val.p);
+				break;
+			default:
+				r = 0;
+		}
+		__cerr_advance(&dst, &n, r);
+	}
+	*dst = '\0';
+	return dst - begin;
+}
+
+#  undef __CERR_EMIT
+
+// Header of the record at p, NULL when it does not fit before end
+static const char *__cerr_brec_read(const char *p, const char *end,
+	t_cerr_brec *h) {
+	if (!p || end - p < (ptrdiff_t)sizeof(*h))
+		return NULL;
+	memcpy(h, p, sizeof(*h));
+	if (h->size < sizeof(*h) || h->size > end - p)
+		return NULL;
+	return p;
+}
+
+// Descriptor of a SITE record, its strings stay in the decoded data
+static int __cerr_brec_site(t_cerr_logsite *s, const char *p,
+	const char *end) {
+	const char	**strs[] = {&s->color, &s->title, &s->fmt, &s->file};
+	const char	*nul;
+
+	if (end - p < (ptrdiff_t)sizeof(s->line))
+		return 0;
+	memcpy(&s->line, p, sizeof(s->line));
+	p += sizeof(s->line);
+	for (size_t i = 0; i < sizeof(strs) / sizeof(*strs); ++i) {
+		if (!(nul = memchr(p, '\0', end - p)))
+			return 0;
+		*strs[i] = p;
+		p = nul + 1;
+	}
+	return 1;
+}
+
+// Arguments of a LOG record, string offsets are from the record start
+static int __cerr_brec_args(t_cerr_arg *args, uint32_t argc, const char *rec,
+	const char *end) {
+	const char	*p = rec + sizeof(t_cerr_brec);
+	uint16_t	len;
+
+	for (uint32_t i = 0; i < argc; ++i) {
+		if (end - p < 2)
+			return 0;
+		args[i] = (t_cerr_arg){.kind = p[0], .size = p[1]};
+		if (args[i].kind == __CERR_A_STR && !args[i].size) {
+			if (end - p < 5)
+				return 0;
+			memcpy(&len, p + 2, sizeof(len));
+			if (end - p < 5 + len || p[4 + len])
+				return 0;
+			args[i].val.p = p + 4;
+			args[i].str = p + 4 - rec;
+			p += 5 + len;
+			continue;
+		}
+		if (args[i].size > sizeof(t_cerr_val) || end - p < 2 + args[i].size)
+			return 0;
+		memcpy(&args[i].val, p + 2, args[i].size);
+		p += 2 + args[i].size;
+	}
+	return 1;
+}
+
+static void __cerr_log_stamp(FILE *out, const t_cerr_brec *h, int plain) {
+	time_t		sec = h->time / 1000000000;
+	struct tm	tm;
+	char		date[32];
+
+	localtime_r(&sec, &tm);
+	strftime(date, sizeof(date), "%F %T", &tm);
+	fprintf(out, plain ? "[%s.%06u %u] "
+		: __F_COLOR(__C_GRAY, "[%s.%06u %u] "), date,
+		(unsigned)(h->time % 1000000000 / 1000), h->tid);
+}
+
+// Print a binary log as the text logs, see __CERR_DECODE_* for the flags.
+// Sites are read first, a thread may log a site before its SITE record is
+// written. Records of unknown sites are skipped. Returns the lines printed.
+size_t __cerr_log_decode(FILE *out, const char *data, size_t len, int flags) {
+	const char		*end = data + len;
+	const char		*p;
+	t_cerr_logsite	*sites = NULL;
+	t_cerr_logsite	*s;
+	t_cerr_logsite	site;
+	uint32_t		nsites = 0;
+	uint32_t		cap;
+	t_cerr_brec		h;
+	t_cerr_arg		args[__CERR_ARGS_MAX];
+	char			msg[4096];
+	size_t			lines = 0;
+
+	for (p = data; __cerr_brec_read(p, end, &h); p += h.size) {
+		if (h.type != __CERR_B_SITE || h.site >= 1u << 24
+			|| !__cerr_brec_site(&site, p + sizeof(h), p + h.size))
+			continue;
+		if (h.site >= nsites) {
+			cap = (h.site + 1) * 2;
+			if (!(s = realloc(sites, cap * sizeof(*s))))
+				break;
+			memset(s + nsites, 0, (cap - nsites) * sizeof(*s));
+			sites = s;
+			nsites = cap;
+		}
+		sites[h.site] = site;
+	}
+	for (p = data; __cerr_brec_read(p, end, &h); p += h.size) {
+		if (h.type == __CERR_B_DROP) {
+			fprintf(out, __CERR_M_DROPPED, h.site);
+			continue;
+		}
+		if (h.type != __CERR_B_LOG || h.site >= nsites || !sites[h.site].fmt
+			|| h.argc > __CERR_ARGS_MAX
+			|| !__cerr_brec_args(args, h.argc, p, p + h.size))
+			continue;
+		s = &sites[h.site];
+		__cerr_vformat(msg, sizeof(msg), s->fmt, args, h.argc, p, h.err);
+		if (!*s->title) {
+			fprintf(out, "%s\n", msg);
+			++lines;
+			continue;
+		}
+		if (flags & __CERR_DECODE_STAMP)
+			__cerr_log_stamp(out, &h, flags & __CERR_DECODE_PLAIN);
+		if (flags & __CERR_DECODE_PLAIN)
+			fprintf(out, "%10s > %s\n", s->title, msg);
+		else
+			fprintf(out, __F_BOLD("%s%10s" __F_RESET) " > %s\n", s->color,
+				s->title, msg);
+		++lines;
+	}
+	free(sites);
+	return lines;
+}
+
+#  ifdef LOG_ASYNC
+#   include <errno.h>
+#   include <pthread.h>
+#   include <semaphore.h>
+#   include <stdarg.h>
+#   include <stddef.h>
+#   include <stdlib.h>
+#   include <string.h>
+#   include <sys/uio.h>
+#   include <time.h>
+#   include <unistd.h>
+
+#   define __CERR_LOG_BATCH		64
+#   define __CERR_LOG_IDLE_NS	10000000
+#   define __CERR_LOG_WAKE		(LOG_RING_SIZE / 4)
+#   define __CERR_LOG_RECSIZE(N)                                               \
+	(sizeof(t_cerr_rec) + (((N) + 7) & ~(uint64_t)7))
+
+_Static_assert((LOG_RING_SIZE & (LOG_RING_SIZE - 1)) == 0, "LOG_RING_SIZE");
+_Static_assert(LOG_RING_SIZE >= 2 * __CERR_LOG_RECSIZE(LOG_LINE_SIZE),
+	"LOG_RING_SIZE");
+_Static_assert(LOG_LINE_SIZE >= 2 * __CERR_LOG_PREFIX, "LOG_LINE_SIZE");
+
+// Rings of every thread, the writer state and the consumer lock.
+// Producers never take the lock, they wake the writer with a post once
+// their ring is a quarter full, it also wakes up on its own every 10 ms.
+static struct {
+	t_cerr_ring		*rings;
+	pthread_mutex_t	lock;
+	sem_t			wake;
+	pthread_once_t	once;
+	pthread_key_t	key;
+	uint32_t		sleeping;
+	uint32_t		sync;
+	uint32_t		sites;
+}	g__cerr_log = {
+	.lock = PTHREAD_MUTEX_INITIALIZER,
+	.once = PTHREAD_ONCE_INIT,
+};
+
+CERR_TLS t_cerr_ring *g__cerr_ring = NULL;
+
+// Write every byte of the batch, retrying short writes
+static void __cerr_log_write(int fd, struct iovec *iov, int n) {
+	ssize_t	w;
+
+	while (n > 0) {
+		w = writev(fd, iov, n);
+		if (w < 0 && errno == EINTR)
+			continue;
+		if (w < 0)
+			return;
+		for (; n > 0 && (size_t)w >= iov->iov_len; ++iov, --n)
+			w -= iov->iov_len;
+		if (n > 0) {
+			iov->iov_base = (char *)iov->iov_base + w;
+			iov->iov_len -= w;
+		}
+	}
+}
+
+// Report the lines a ring lost, as a DROP record in a binary log
+static void __cerr_log_dropped(int fd, uint32_t dropped) {
+#   ifdef LOG_BINARY
+	t_cerr_brec		h = {sizeof(h), __CERR_B_DROP, 0, dropped, 0, 0, 0};
+	struct timespec	now;
+
+	clock_gettime(CLOCK_REALTIME, &now);
+	h.time = (uint64_t)now.tv_sec * 1000000000 + now.tv_nsec;
+	__cerr_log_write(fd, &(struct iovec){&h, sizeof(h)}, 1);
+#   else
+	char	msg[64];
+	int		n = snprintf(msg, sizeof(msg), __CERR_M_DROPPED, dropped);
+
+	__cerr_log_write(fd, &(struct iovec){msg, n}, 1);
+#   endif
+}
+
+// Send the published lines of a ring, consecutive lines of a file share a
+// writev. Returns the number of lines sent. Caller holds the log lock.
+static uint32_t __cerr_ring_drain(t_cerr_ring *r) {
+	struct iovec	iov[__CERR_LOG_BATCH];
+	uint64_t		head = __atomic_load_n(&r->head, __ATOMIC_ACQUIRE);
+	uint64_t		tail = r->tail;
+	uint32_t		lines = 0;
+	uint32_t		dropped;
+	t_cerr_rec		*rec;
+	int				fd = STDERR_FILENO;
+	int				n = 0;
+
+	while (tail != head) {
+		rec = (t_cerr_rec *)(r->data + (tail & (LOG_RING_SIZE - 1)));
+		if (n && (n == __CERR_LOG_BATCH || (rec->fd >= 0 && rec->fd != fd))) {
+			__cerr_log_write(fd, iov, n);
+			__atomic_store_n(&r->tail, tail, __ATOMIC_RELEASE);
+			n = 0;
+		}
+		if (rec->fd >= 0) {
+			fd = rec->fd;
+			iov[n++] = (struct iovec){rec + 1, rec->len};
+			++lines;
+		}
+		tail += __CERR_LOG_RECSIZE(rec->len);
+	}
+	if (n)
+		__cerr_log_write(fd, iov, n);
+	__atomic_store_n(&r->tail, tail, __ATOMIC_RELEASE);
+	dropped = __atomic_exchange_n(&r->dropped, 0, __ATOMIC_RELAXED);
+	if (dropped)
+		__cerr_log_dropped(fd, dropped);
+	return lines;
+}
+
+static uint32_t __cerr_log_drain(void) {
+	uint32_t	lines = 0;
+
+	for (t_cerr_ring *r = __atomic_load_n(&g__cerr_log.rings,
+		__ATOMIC_ACQUIRE); r; r = r->link)
+		lines += __cerr_ring_drain(r);
+	return lines;
+}
+
+static int __cerr_log_pending(void) {
+	for (t_cerr_ring *r = __atomic_load_n(&g__cerr_log.rings,
+		__ATOMIC_ACQUIRE); r; r = r->link)
+		if (__atomic_load_n(&r->head, __ATOMIC_ACQUIRE)
+			!= __atomic_load_n(&r->tail, __ATOMIC_RELAXED)
+			|| __atomic_load_n(&r->dropped, __ATOMIC_RELAXED))
+			return 1;
+	return 0;
+}
+
+// Drain while there is work, then sleep until a producer posts
+static void *__cerr_log_writer(void *arg) {
+	struct timespec	until;
+	uint32_t		lines;
+
+	(void)arg;
+	for (;;) {
+		pthread_mutex_lock(&g__cerr_log.lock);
+		lines = __cerr_log_drain();
+		pthread_mutex_unlock(&g__cerr_log.lock);
+		if (lines)
+			continue;
+		__atomic_store_n(&g__cerr_log.sleeping, 1, __ATOMIC_SEQ_CST);
+		if (!__cerr_log_pending()) {
+			clock_gettime(CLOCK_REALTIME, &until);
+			until.tv_nsec += __CERR_LOG_IDLE_NS;
+			until.tv_sec += until.tv_nsec / 1000000000;
+			until.tv_nsec %= 1000000000;
+			sem_timedwait(&g__cerr_log.wake, &until);
+		}
+		__atomic_store_n(&g__cerr_log.sleeping, 0, __ATOMIC_RELAXED);
+	}
+	return NULL;
+}
+
+// Thread exit: the ring waits, with its last lines, for the next thread
+static void __cerr_ring_detach(void *r) {
+	__atomic_store_n(&((t_cerr_ring *)r)->state, 0, __ATOMIC_RELEASE);
+}
+
+// The writer is detached, the process does not wait for it at exit.
+// Without it, every line is written by its producer.
+static void __cerr_log_start(void) {
+	pthread_attr_t	attr;
+	pthread_t		writer;
+
+	pthread_key_create(&g__cerr_log.key, __cerr_ring_detach);
+	sem_init(&g__cerr_log.wake, 0, 0);
+	pthread_attr_init(&attr);
+	pthread_attr_setdetachstate(&attr, PTHREAD_CREATE_DETACHED);
+	if (pthread_create(&writer, &attr, __cerr_log_writer, NULL))
+		g__cerr_log.sync = 1;
+	pthread_attr_destroy(&attr);
+}
+
+static t_cerr_ring *__cerr_ring_attach(void) {
+	t_cerr_ring	*r;
+	uint32_t	state;
+
+	pthread_once(&g__cerr_log.once, __cerr_log_start);
+	r = __atomic_load_n(&g__cerr_log.rings, __ATOMIC_ACQUIRE);
+	for (; r; r = r->link) {
+		state = 0;
+		if (__atomic_compare_exchange_n(&r->state, &state, 1, 0,
+			__ATOMIC_ACQUIRE, __ATOMIC_RELAXED))
+			break;
+	}
+	if (!r) {
+		r = aligned_alloc(_Alignof(t_cerr_ring), sizeof(t_cerr_ring));
+		if (!r)
+			return NULL;
+		memset(r, 0, offsetof(t_cerr_ring, data));
+		r->state = 1;
+		r->link = __atomic_load_n(&g__cerr_log.rings, __ATOMIC_RELAXED);
+		while (!__atomic_compare_exchange_n(&g__cerr_log.rings, &r->link, r,
+			1, __ATOMIC_RELEASE, __ATOMIC_RELAXED))
+			;
+	}
+	g__cerr_ring = r;
+	pthread_setspecific(g__cerr_log.key, r);
+	return r;
+}
+
+// Only the producer that clears the flag posts, once per sleep
+static void __cerr_log_wake(void) {
+	if (__atomic_exchange_n(&g__cerr_log.sleeping, 0, __ATOMIC_ACQ_REL))
+		sem_post(&g__cerr_log.wake);
+}
+
+// Room for one more line after the padding skip. A blocking producer
+// writes the pending lines itself instead of waiting for the writer.
+static int __cerr_ring_reserve(t_cerr_ring *r, uint64_t need) {
+	while (LOG_RING_SIZE - (r->head
+		- __atomic_load_n(&r->tail, __ATOMIC_ACQUIRE)) < need) {
+#   ifdef LOG_BLOCK
+		__cerr_log_flush();
+#   else
+		__atomic_add_fetch(&r->dropped, 1, __ATOMIC_RELAXED);
+		__cerr_log_wake();
+		return 0;
+#   endif
+	}
+	return 1;
+}
+
+// Ring of the calling thread, NULL if none could be allocated
+static inline t_cerr_ring *__cerr_ring_get(void) {
+	t_cerr_ring	*r = g__cerr_ring;
+
+	if (__builtin_expect(!r, 0))
+		r = __cerr_ring_attach();
+	return r;
+}
+
+// Room for a record of at most n bytes, after the padding that skips the
+// end of the ring when it is too short. NULL when the line is dropped.
+static t_cerr_rec *__cerr_ring_begin(t_cerr_ring *r, uint32_t n) {
+	uint64_t	off = r->head & (LOG_RING_SIZE - 1);
+	uint64_t	skip = LOG_RING_SIZE - off < __CERR_LOG_RECSIZE(n)
+		? LOG_RING_SIZE - off : 0;
+	t_cerr_rec	*pad;
+
+	if (!__cerr_ring_reserve(r, skip + __CERR_LOG_RECSIZE(n)))
+		return NULL;
+	if (skip) {
+		pad = (t_cerr_rec *)(r->data + off);
+		*pad = (t_cerr_rec){skip - sizeof(t_cerr_rec), -1};
+		__atomic_store_n(&r->head, r->head + skip, __ATOMIC_RELEASE);
+		off = 0;
+	}
+	return (t_cerr_rec *)(r->data + off);
+}
+
+// Publish the n bytes written after rec, the writer is woken up once the
+// ring is a quarter full
+static void __cerr_ring_commit(t_cerr_ring *r, t_cerr_rec *rec, int fd,
+	uint32_t n) {
+	*rec = (t_cerr_rec){n, fd};
+	__atomic_store_n(&r->head, r->head + __CERR_LOG_RECSIZE(n),
+		__ATOMIC_RELEASE);
+	if (__builtin_expect(g__cerr_log.sync, 0))
+		__cerr_log_flush();
+	else if (r->head - __atomic_load_n(&r->tail, __ATOMIC_RELAXED)
+		>= __CERR_LOG_WAKE)
+		__cerr_log_wake();
+}
+
+void __cerr_log_async(FILE *f, const char *color, const char *title,
+	const char *fmt, ...) {
+	int			fd = fileno(f);
+	t_cerr_ring	*r = __cerr_ring_get();
+	t_cerr_rec	*rec;
+	char		*line;
+	size_t		len;
+	va_list		ap;
+	int			n;
+
+	if (!r || !(rec = __cerr_ring_begin(r, LOG_LINE_SIZE)))
+		return;
+	line = (char *)(rec + 1);
+	len = title ? __cerr_log_prefix(line, fd, color, title) : 0;
+	va_start(ap, fmt);
+	n = vsnprintf(line + len, LOG_LINE_SIZE - len, fmt, ap);
+	va_end(ap);
+	if (n < 0)
+		n = 0;
+	if ((size_t)n >= LOG_LINE_SIZE - len)
+		n = LOG_LINE_SIZE - len - 1;
+	line[len + n] = '\n';
+	__cerr_ring_commit(r, rec, fd, len + n + 1);
+}
+
+// Write every line published so far, from the calling thread
+void __cerr_log_flush(void) {
+	pthread_mutex_lock(&g__cerr_log.lock);
+	__cerr_log_drain();
+	pthread_mutex_unlock(&g__cerr_log.lock);
+}
+
+// Runs after the other destructors, the last lines are written directly
+__attribute__((destructor(101)))
+static void __cerr_log_exit(void) {
+	__atomic_store_n(&g__cerr_log.sync, 1, __ATOMIC_SEQ_CST);
+	__cerr_log_flush();
+}
+
+#   ifdef LOG_BINARY
+// First line of a site: take an id and write the descriptor in the ring.
+// A dropped descriptor leaves the site unregistered, 0 is returned.
+static uint32_t __cerr_logsite_register(t_cerr_ring *r, int fd,
+	t_cerr_logsite *s) {
+	const char	*strs[] = {s->color, s->title, s->fmt, s->file};
+	t_cerr_brec	h = {0, __CERR_B_SITE, 0, 0, 0, 0, 0};
+	uint32_t	id = __atomic_add_fetch(&g__cerr_log.sites, 1,
+		__ATOMIC_RELAXED);
+	uint32_t	prev = 0;
+	t_cerr_rec	*rec;
+	char		*dst;
+	size_t		len;
+
+	if (!__atomic_compare_exchange_n(&s->id, &prev, id, 0, __ATOMIC_ACQ_REL,
+		__ATOMIC_ACQUIRE))
+		return prev;
+	if (!(rec = __cerr_ring_begin(r, LOG_LINE_SIZE))) {
+		__atomic_store_n(&s->id, 0, __ATOMIC_RELEASE);
+		return 0;
+	}
+	h.site = id;
+	h.size = sizeof(h) + sizeof(s->line);
+	dst = (char *)(rec + 1);
+	memcpy(dst + sizeof(h), &s->line, sizeof(s->line));
+	for (size_t i = 0; i < sizeof(strs) / sizeof(*strs); ++i) {
+		len = strnlen(strs[i], LOG_LINE_SIZE - h.size - 4 + i);
+		memcpy(dst + h.size, strs[i], len);
+		dst[h.size + len] = '\0';
+		h.size += len + 1;
+	}
+	memcpy(dst, &h, sizeof(h));
+	__cerr_ring_commit(r, rec, fd, h.size);
+	return id;
+}
+
+// A string is copied up to the precision of its %s with its terminator after
+// a 16 bits length. A NULL one, or one not printed by a %s, is kept as a
+// pointer by __cerr_bbuf_arg.
+void __cerr_bbuf_str(t_cerr_bbuf *b, const char *str) {
+	char		*dst = b->data + b->len;
+	size_t		room = sizeof(b->data) - b->len;
+	int			prec = __cerr_fmt_str(b->fmt, b->argc);
+	int32_t		arg;
+	uint16_t	len;
+
+	if (prec == __CERR_P_RAW)
+		return __cerr_bbuf_arg(b, __CERR_A_RAW, &str, sizeof(str));
+	if (room < 5) {
+		b->len = sizeof(b->data);
+		return;
+	}
+	if (prec == __CERR_P_ARG && b->argc && b->data[b->last + 1] == sizeof(arg)) {
+		memcpy(&arg, b->data + b->last + 2, sizeof(arg));
+		prec = arg;
+	}
+	len = strnlen(str, prec >= 0 && (size_t)prec < room - 5 ? (size_t)prec
+		: room - 5);
+	dst[0] = __CERR_A_STR;
+	dst[1] = 0;
+	memcpy(dst + 2, &len, sizeof(len));
+	memcpy(dst + 4, str, len);
+	dst[4 + len] = '\0';
+	b->last = b->len;
+	b->len += 5 + len;
+	++b->argc;
+}
+
+void __cerr_log_binary(FILE *f, t_cerr_logsite *site, const t_cerr_bbuf *b) {
+	t_cerr_brec		h = {0, __CERR_B_LOG, b->argc, 0, 0, errno, 0};
+	int				fd = fileno(f);
+	t_cerr_ring		*r = __cerr_ring_get();
+	struct timespec	now;
+	t_cerr_rec		*rec;
+
+	if (!r)
+		return;
+	h.site = __atomic_load_n(&site->id, __ATOMIC_ACQUIRE);
+	if (!h.site && !(h.site = __cerr_logsite_register(r, fd, site)))
+		return;
+	clock_gettime(CLOCK_REALTIME, &now);
+	h.time = (uint64_t)now.tv_sec * 1000000000 + now.tv_nsec;
+	h.tid = __cerr_log_tid();
+	h.size = sizeof(h) + b->len;
+	if (!(rec = __cerr_ring_begin(r, h.size)))
+		return;
+	memcpy(rec + 1, &h, sizeof(h));
+	memcpy((char *)(rec + 1) + sizeof(h), b->data, b->len);
+	__cerr_ring_commit(r, rec, fd, h.size);
+}
+#   endif
+#  endif
+# endif
@@ -0,0 +1,132 @@
+#pragma once
+
+// GNU extensions of the implementation, see libcerr-log.h
+#if defined(CERR_IMPLEMENTATION) && !defined(_GNU_SOURCE)
+# define _GNU_SOURCE
+#endif
+
+#include <pthread.h>
+
+#include <libcerr-exception.h>
+
+// ╔═══════════════════════════════[ DEFINITION ]══════════════════════════════╗
+
+// Most threads of a parallel loop, the calling one included
+#ifndef		CERR_PARALLEL_MAX
+# define	CERR_PARALLEL_MAX 64
+#endif
+
+// Body of a parallel loop, called once for each index
+typedef void (*t_cerr_task)(size_t i, void *arg);
+
+// Shared by the threads of a loop: next is the first index not handed out,
+// failed counts the iterations that threw, the first cap are kept in errs.
+typedef struct s_cerr_par {
+	t_cerr_task			fn;
+	void				*arg;
+	size_t				n;
+	size_t				chunk;
+	size_t				next;
+	size_t				failed;
+	int					first;
+	int					stop;
+	pthread_mutex_t		lock;
+	t_cerr_exception	*errs;
+	size_t				cap;
+}	t_cerr_par;
+
+size_t	cerr_parallel_for(size_t n, t_cerr_task fn, void *arg,
+			t_cerr_exception *errs, size_t cap);
+size_t	__cerr_parallel(size_t n, t_cerr_task fn, void *arg,
+			t_cerr_exception *errs, size_t cap, int first);
+
+// ╔═════════════════════════════════[ MACROS ]════════════════════════════════╗
+
+// Call FN(i, ARG) for every i below N, spread over the cores. Once one throws,
+// no other iteration starts and the exception is thrown again by the caller.
+# define PARALLEL_FOR(N, FN, ARG) do {                                         \
+	t_cerr_exception __pe;                                                     \
+	if (__cerr_parallel((N), (FN), (ARG), &__pe, 1, 1))                        \
+		RETHROW(&__pe);                                                        \
+} while (0)
+
+
+// ╔══════════════════════════════[ IMPLEMENTATION ]═══════════════════════════╗
+
+#ifdef CERR_IMPLEMENTATION
+# include <unistd.h>
+
+// Threads of a loop, 0 for one per online core
+# ifndef CERR_PARALLEL_THREADS
+#  define CERR_PARALLEL_THREADS 0
+# endif
+
+// One iteration, what it throws is counted and kept if there is room
+__attribute__((noinline))
+static void __cerr_par_run(t_cerr_par *par, size_t i) {
+	TRY_FAST {
+		par->fn(i, par->arg);
+	} CATCH_ALL() {
+		pthread_mutex_lock(&par->lock);
+		if (par->failed < par->cap)
+			CERR_STORE(&par->errs[par->failed]);
+		++par->failed;
+		if (par->first)
+			__atomic_store_n(&par->stop, 1, __ATOMIC_RELAXED);
+		pthread_mutex_unlock(&par->lock);
+	}
+}
+
+// Take chunks of indexes until there are none left or the loop stops
+static void *__cerr_par_worker(void *arg) {
+	t_cerr_par	*par = arg;
+	size_t		i;
+	size_t		end;
+
+	while ((i = __atomic_fetch_add(&par->next, par->chunk, __ATOMIC_RELAXED))
+		< par->n) {
+		end = i + par->chunk < par->n ? i + par->chunk : par->n;
+		for (; i < end; ++i) {
+			if (__atomic_load_n(&par->stop, __ATOMIC_RELAXED))
+				return NULL;
+			__cerr_par_run(par, i);
+		}
+	}
+	return NULL;
+}
+
+// The caller is one of the threads, each taking about 4 chunks so that uneven
+// iterations still balance
+size_t __cerr_parallel(size_t n, t_cerr_task fn, void *arg,
+	t_cerr_exception *errs, size_t cap, int first) {
+	pthread_t	threads[CERR_PARALLEL_MAX];
+	long		cores = CERR_PARALLEL_THREADS ? CERR_PARALLEL_THREADS
+		: sysconf(_SC_NPROCESSORS_ONLN);
+	size_t		count = cores > 0 ? (size_t)cores : 1;
+	size_t		started = 0;
+	t_cerr_par	par = {.fn = fn, .arg = arg, .n = n, .first = first,
+		.errs = errs, .cap = errs ? cap : 0};
+
+	if (count > CERR_PARALLEL_MAX)
+		count = CERR_PARALLEL_MAX;
+	if (count > n)
+		count = n ? n : 1;
+	par.chunk = n / (count * 4) ? n / (count * 4) : 1;
+	pthread_mutex_init(&par.lock, NULL);
+	while (started + 1 < count
+		&& !pthread_create(&threads[started], NULL, __cerr_par_worker, &par))
+		++started;
+	__cerr_par_worker(&par);
+	while (started)
+		pthread_join(threads[--started], NULL);
+	pthread_mutex_destroy(&par.lock);
+	return par.failed;
+}
+
+// Run every iteration, keep the first cap exceptions in errs by time and
+// return the number of iterations that threw
+size_t cerr_parallel_for(size_t n, t_cerr_task fn, void *arg,
+	t_cerr_exception *errs, size_t cap) {
+	return __cerr_parallel(n, fn, arg, errs, cap, 0);
+}
+#endif
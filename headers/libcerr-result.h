@@ -0,0 +1,85 @@
+#pragma once
+
+#include <libcerr-exception.h>
+
+// ╔═══════════════════════════════[ DEFINITION ]══════════════════════════════╗
+
+// Value or error code returned by a function, err is CERR_E_NONE on success.
+// The reason of an error is recorded like a throw, in a per-thread record of
+// its own so throws and catches in between keep it, and only formatted when
+// CERR_RESULT_WHY() asks for it.
+// Name it once: typedef CERR_RESULT(int) t_int_result;
+#define CERR_RESULT(T)                                                         \
+	struct { CERR_TYPE err; T val; }
+
+extern CERR_TLS t_cerr_throw g__cerr_fail;
+extern CERR_TLS char g__cerr_fail_msg[CERR_MSG_SIZE];
+
+// ╔═════════════════════════════════[ MACROS ]════════════════════════════════╗
+// ---- RETURN
+// Successful result of type T holding VAL
+# define CERR_OK(T, VAL)                                                       \
+	((T){.err = CERR_E_NONE, .val = (VAL)})
+
+// Failed result of type T, records the reason of the error like THROW_MSG
+# define CERR_FAIL(T, EXCEPTION, MSG, ...) ({                                  \
+	__CERR_IS_RAISABLE(EXCEPTION);                                             \
+	__CERR_SET_IN(&g__cerr_fail, MSG, ##__VA_ARGS__);                          \
+	(T){.err = (EXCEPTION)};                                                   \
+})
+
+// ---- PROPAGATE
+// Value of the result EXPR, or return its error as a result of type T.
+// A branch only, the recorded reason is passed up untouched.
+# define PROPAGATE(T, EXPR) ({                                                 \
+	__auto_type __r = (EXPR);                                                  \
+	if (__builtin_expect(__r.err != CERR_E_NONE, 0))                           \
+		return (T){.err = __r.err};                                            \
+	__r.val;                                                                   \
+})
+
+// ---- BOUNDARIES
+// Value of the result EXPR, or throw its error with its recorded reason
+# define TRY_EXPR(EXPR) ({                                                     \
+	__auto_type __r = (EXPR);                                                  \
+	if (__builtin_expect(__r.err != CERR_E_NONE, 0)) {                         \
+		g__cerr_throw = g__cerr_fail;                                          \
+		__CERR_RAISE(__r.err);                                                 \
+	}                                                                          \
+	__r.val;                                                                   \
+})
+
+// Result of type T holding EXPR, or the code and reason of what it threw
+# define CERR_CAPTURE(T, EXPR) ({                                              \
+	T __res;                                                                   \
+	TRY { __res = CERR_OK(T, EXPR); }                                          \
+	CATCH_ALL() {                                                              \
+		__res = (T){.err = __err.thrown};                                      \
+		g__cerr_fail = g__cerr_throw;                                          \
+	}                                                                          \
+	__res;                                                                     \
+})
+
+// ---- OTHER
+// Reason of the error of RESULT, valid until the next failure of the thread,
+// "" on success
+# define CERR_RESULT_WHY(RESULT) ((RESULT).err != CERR_E_NONE                  \
+	? __cerr_format_in(g__cerr_fail_msg, &g__cerr_fail) : "")
+
+
+// ╔══════════════════════════════════[ UTILS ]════════════════════════════════╗
+
+#define		__CERR_M_FAIL	"Failure with code[%d], use a code, not 0 or a category"
+
+// Same checks as a THROW, without needing a TRY around
+#define __CERR_IS_RAISABLE(EXCEPTION)                                          \
+	ASSERT((EXCEPTION) != CERR_E_NONE && !__CERR_IS_GROUP(EXCEPTION),          \
+		__CERR_M_FAIL, (int)(EXCEPTION))
+
+
+// ╔══════════════════════════════[ IMPLEMENTATION ]═══════════════════════════╗
+
+#ifdef CERR_IMPLEMENTATION
+CERR_TLS t_cerr_throw g__cerr_fail;
+CERR_TLS char g__cerr_fail_msg[CERR_MSG_SIZE];
+#endif
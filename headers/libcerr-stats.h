@@ -0,0 +1,440 @@
+#pragma once
+
+// GNU extensions of the implementation, see libcerr-log.h
+# if defined(CERR_IMPLEMENTATION) && !defined(_GNU_SOURCE)
+#  define _GNU_SOURCE
+# endif
+
+# include <stdint.h>
+
+# include <libcerr-log.h>
+# include <libcerr-assert.h>
+
+// ╔═══════════════════════════════[ DEFINITION ]══════════════════════════════╗
+
+// Exception codes counted apart by each thread, the next ones share a slot
+# ifndef CERR_STATS_CODES
+#  define CERR_STATS_CODES	64
+# endif
+
+// Buckets of the probe length histogram, the last one holds the longer ones
+# define __CERR_STATS_PROBES	16
+
+# define CERR_STATS_TEXT	0
+# define CERR_STATS_JSON	1
+
+typedef struct s_cerr_code_stats {
+	uint64_t	code;
+	uint64_t	thrown;
+	uint64_t	caught;
+}	t_cerr_code_stats;
+
+// Counters of one thread, only ever written by it. Blocks are never freed,
+// the block of an exited thread is adopted by the next one, counters kept.
+typedef struct s_cerr_stats t_cerr_stats;
+struct s_cerr_stats {
+	t_cerr_stats		*link;
+	uint32_t			state;
+	int					tid;
+	uint32_t			depth;
+	uint32_t			depth_max;
+	uint64_t			tries;
+	uint64_t			allocs;
+	uint64_t			alloc_bytes;
+	uint64_t			frees;
+	uint64_t			free_bytes;
+	uint64_t			probes[__CERR_STATS_PROBES];
+	t_cerr_code_stats	codes[CERR_STATS_CODES + 1];
+} __attribute__((aligned(64)));
+
+extern CERR_TLS t_cerr_stats *g__cerr_stats;
+extern t_cerr_stats *g__cerr_stats_all;
+
+t_cerr_stats	*__cerr_stats_attach(void);
+void			cerr_stats_dump(int fd, int format);
+
+// Defined by libcerr-cache.h, weak so a program without it still links
+__attribute__((weak))
+void			__cerr_cache_usage(uint64_t *len, uint64_t *cap);
+
+// ╔═════════════════════════════════[ MACROS ]════════════════════════════════╗
+
+// Write the counters of every thread, summed, to fd as text or JSON
+# define CERR_STATS_DUMP(FD, FORMAT)	cerr_stats_dump(FD, FORMAT)
+
+// Counting hooks of the exception and cache headers, only with CERR_STATS
+# ifdef CERR_STATS
+#  define __CERR_STAT_TRY()				__cerr_stat_try()
+#  define __CERR_STAT_LEAVE()			(--__cerr_stats()->depth)
+#  define __CERR_STAT_THROW(CODE)		(++__cerr_stat_code(CODE)->thrown)
+#  define __CERR_STAT_CATCH(CODE)		(++__cerr_stat_code(CODE)->caught)
+#  define __CERR_STAT_ALLOC(SIZE)		__cerr_stat_bytes(1, SIZE)
+#  define __CERR_STAT_FREE(SIZE)		__cerr_stat_bytes(0, SIZE)
+#  define __CERR_STAT_PROBE(D)			__cerr_stat_probe(D)
+# else
+#  define __CERR_STAT_TRY()				((void)0)
+#  define __CERR_STAT_LEAVE()			((void)0)
+#  define __CERR_STAT_THROW(CODE)		((void)0)
+#  define __CERR_STAT_CATCH(CODE)		((void)0)
+#  define __CERR_STAT_ALLOC(SIZE)		((void)0)
+#  define __CERR_STAT_FREE(SIZE)		((void)0)
+#  define __CERR_STAT_PROBE(D)			((void)(D))
+# endif
+
+// ╔══════════════════════════════════[ UTILS ]════════════════════════════════╗
+
+# define __CERR_M_SFAIL "libcerr: stats, alloc failed, exiting safely."
+# define __CERR_M_STATS "libcerr stats: %u threads, %llu tries, depth max %u\n"
+# define __CERR_M_STHREAD "  thread %d: %llu tries, depth max %u\n"
+# define __CERR_M_SCODE "  code %llu: %llu thrown, %llu caught\n"
+# define __CERR_M_SOTHER "  other codes: %llu thrown, %llu caught\n"
+# define __CERR_M_SCACHE "  cache: %llu of %llu slots (%llu.%u%%)\n"
+# define __CERR_M_SALLOC "  allocs: %llu, %llu bytes, frees: %llu, %llu bytes\n"
+
+# define __CERR_ST_USED	1
+# define __CERR_ST_FREE	2
+
+// Counters of the calling thread, attached on first use
+static inline t_cerr_stats *__cerr_stats(void) {
+	t_cerr_stats	*s = g__cerr_stats;
+
+	if (__builtin_expect(!s, 0))
+		s = __cerr_stats_attach();
+	return s;
+}
+
+static inline void __cerr_stat_try(void) {
+	t_cerr_stats	*s = __cerr_stats();
+
+	++s->tries;
+	if (++s->depth > s->depth_max)
+		s->depth_max = s->depth;
+}
+
+// Slot of a code in a table of CERR_STATS_CODES + 1 entries, the last one
+// taking the codes that found no room. Codes start at 1, 0 marks a free slot.
+static inline t_cerr_code_stats *__cerr_code_slot(t_cerr_code_stats *t,
+	uint64_t code) {
+	uint32_t	i = (uint32_t)(code * 0x9E3779B97F4A7C15ull >> 40)
+		% CERR_STATS_CODES;
+
+	code += !code;
+	for (uint32_t n = 0; n < CERR_STATS_CODES; ++n) {
+		if (t[i].code == code)
+			return t + i;
+		if (!t[i].code) {
+			t[i].code = code;
+			return t + i;
+		}
+		i = i + 1 < CERR_STATS_CODES ? i + 1 : 0;
+	}
+	return t + CERR_STATS_CODES;
+}
+
+static inline t_cerr_code_stats *__cerr_stat_code(uint64_t code) {
+	return __cerr_code_slot(__cerr_stats()->codes, code);
+}
+
+static inline void __cerr_stat_probe(uint32_t d) {
+	++__cerr_stats()->probes[d < __CERR_STATS_PROBES
+		? d : __CERR_STATS_PROBES - 1];
+}
+
+static inline void __cerr_stat_bytes(int alloc, uint64_t size) {
+	t_cerr_stats	*s = __cerr_stats();
+
+	if (alloc) {
+		++s->allocs;
+		s->alloc_bytes += size;
+	} else {
+		++s->frees;
+		s->free_bytes += size;
+	}
+}
+
+// ╔══════════════════════════════[ IMPLEMENTATION ]═══════════════════════════╗
+
+# ifdef CERR_IMPLEMENTATION
+#  include <errno.h>
+#  include <pthread.h>
+#  include <signal.h>
+#  include <stdarg.h>
+#  include <stdlib.h>
+#  include <sys/syscall.h>
+#  include <unistd.h>
+
+CERR_TLS t_cerr_stats *g__cerr_stats = NULL;
+t_cerr_stats *g__cerr_stats_all = NULL;
+
+static pthread_key_t g__cerr_stats_key;
+static pthread_once_t g__cerr_stats_once = PTHREAD_ONCE_INIT;
+
+// Thread exit: the counters stay in the list for the next thread
+static void __cerr_stats_detach(void *s) {
+	__atomic_store_n(&((t_cerr_stats *)s)->state, __CERR_ST_FREE,
+		__ATOMIC_RELEASE);
+}
+
+static void __cerr_stats_key(void) {
+	pthread_key_create(&g__cerr_stats_key, __cerr_stats_detach);
+}
+
+t_cerr_stats *__cerr_stats_attach(void) {
+	t_cerr_stats	*s;
+	uint32_t		state;
+
+	pthread_once(&g__cerr_stats_once, __cerr_stats_key);
+	s = __atomic_load_n(&g__cerr_stats_all, __ATOMIC_ACQUIRE);
+	for (; s; s = s->link) {
+		state = __CERR_ST_FREE;
+		if (__atomic_compare_exchange_n(&s->state, &state, __CERR_ST_USED, 0,
+			__ATOMIC_ACQUIRE, __ATOMIC_RELAXED))
+			break;
+	}
+	if (!s) {
+		s = aligned_alloc(_Alignof(t_cerr_stats), sizeof(t_cerr_stats));
+		ASSERT(s, __CERR_M_SFAIL);
+		*s = (t_cerr_stats){.state = __CERR_ST_USED};
+		s->link = __atomic_load_n(&g__cerr_stats_all, __ATOMIC_RELAXED);
+		while (!__atomic_compare_exchange_n(&g__cerr_stats_all, &s->link, s, 1,
+			__ATOMIC_RELEASE, __ATOMIC_RELAXED))
+			;
+	}
+	s->tid = (int)syscall(SYS_gettid);
+	s->depth = 0;
+	g__cerr_stats = s;
+	pthread_setspecific(g__cerr_stats_key, s);
+	return s;
+}
+
+// ---- DUMP
+
+// Output gathered in a stack buffer and written out when full, so a dump
+// makes a few write(2) and no allocation.
+typedef struct s_cerr_out {
+	int		fd;
+	size_t	len;
+	char	buf[4096];
+}	t_cerr_out;
+
+static void __cerr_out_flush(t_cerr_out *o) {
+	size_t	done = 0;
+	ssize_t	w;
+
+	while (done < o->len) {
+		w = write(o->fd, o->buf + done, o->len - done);
+		if (w <= 0)
+			break;
+		done += (size_t)w;
+	}
+	o->len = 0;
+}
+
+static void __cerr_out_char(t_cerr_out *o, char c) {
+	if (o->len == sizeof(o->buf))
+		__cerr_out_flush(o);
+	o->buf[o->len++] = c;
+}
+
+static void __cerr_out_num(t_cerr_out *o, unsigned long long n, int neg) {
+	char	d[24];
+	int		i = 0;
+
+	do
+		d[i++] = (char)('0' + n % 10);
+	while (n /= 10);
+	if (neg)
+		__cerr_out_char(o, '-');
+	while (i)
+		__cerr_out_char(o, d[--i]);
+}
+
+// Formatter of the few conversions the dump needs: %s %d %u %llu and %%.
+// No locale nor floating point is involved, unlike vsnprintf.
+__attribute__((format(printf, 2, 3)))
+static void __cerr_out(t_cerr_out *o, const char *fmt, ...) {
+	va_list		ap;
+	const char	*str;
+	int			d;
+
+	va_start(ap, fmt);
+	for (; *fmt; ++fmt) {
+		if (*fmt != '%') {
+			__cerr_out_char(o, *fmt);
+			continue;
+		}
+		switch (*++fmt) {
+		case 's':
+			for (str = va_arg(ap, const char *); *str; ++str)
+				__cerr_out_char(o, *str);
+			break;
+		case 'd':
+			d = va_arg(ap, int);
+			__cerr_out_num(o, d < 0 ? -(unsigned long long)d
+				: (unsigned long long)d, d < 0);
+			break;
+		case 'u':
+			__cerr_out_num(o, va_arg(ap, unsigned), 0);
+			break;
+		case 'l':
+			fmt += 2;
+			__cerr_out_num(o, va_arg(ap, unsigned long long), 0);
+			break;
+		case '%':
+			__cerr_out_char(o, '%');
+			break;
+		default:
+			va_end(ap);
+			return;
+		}
+	}
+	va_end(ap);
+}
+
+// Sum of every thread, codes merged by value
+static void __cerr_stats_sum(t_cerr_stats *sum, uint32_t *threads) {
+	t_cerr_stats	*s = __atomic_load_n(&g__cerr_stats_all, __ATOMIC_ACQUIRE);
+	const t_cerr_code_stats	*c;
+	t_cerr_code_stats		*to;
+
+	*threads = 0;
+	for (; s; s = s->link, ++*threads) {
+		sum->tries += s->tries;
+		if (s->depth_max > sum->depth_max)
+			sum->depth_max = s->depth_max;
+		sum->allocs += s->allocs;
+		sum->alloc_bytes += s->alloc_bytes;
+		sum->frees += s->frees;
+		sum->free_bytes += s->free_bytes;
+		for (uint32_t i = 0; i < __CERR_STATS_PROBES; ++i)
+			sum->probes[i] += s->probes[i];
+		for (uint32_t i = 0; i <= CERR_STATS_CODES; ++i) {
+			c = s->codes + i;
+			if (!c->thrown && !c->caught)
+				continue;
+			to = i < CERR_STATS_CODES ? __cerr_code_slot(sum->codes, c->code)
+				: sum->codes + CERR_STATS_CODES;
+			to->thrown += c->thrown;
+			to->caught += c->caught;
+		}
+	}
+}
+
+static void __cerr_stats_text(t_cerr_out *o, const t_cerr_stats *sum,
+	uint32_t threads, uint64_t len, uint64_t cap) {
+	const t_cerr_stats		*s = g__cerr_stats_all;
+	const t_cerr_code_stats	*c;
+	uint64_t				per;
+
+	__cerr_out(o, __CERR_M_STATS, threads, (unsigned long long)sum->tries,
+		sum->depth_max);
+	for (; s; s = s->link)
+		__cerr_out(o, __CERR_M_STHREAD, s->tid, (unsigned long long)s->tries,
+			s->depth_max);
+	for (uint32_t i = 0; i <= CERR_STATS_CODES; ++i) {
+		c = sum->codes + i;
+		if (!c->thrown && !c->caught)
+			continue;
+		if (i < CERR_STATS_CODES)
+			__cerr_out(o, __CERR_M_SCODE, (unsigned long long)c->code,
+				(unsigned long long)c->thrown, (unsigned long long)c->caught);
+		else
+			__cerr_out(o, __CERR_M_SOTHER, (unsigned long long)c->thrown,
+				(unsigned long long)c->caught);
+	}
+	per = cap ? len * 1000 / cap : 0;
+	__cerr_out(o, __CERR_M_SCACHE, (unsigned long long)len,
+		(unsigned long long)cap, (unsigned long long)(per / 10),
+		(unsigned)(per % 10));
+	__cerr_out(o, __CERR_M_SALLOC, (unsigned long long)sum->allocs,
+		(unsigned long long)sum->alloc_bytes, (unsigned long long)sum->frees,
+		(unsigned long long)sum->free_bytes);
+	__cerr_out(o, "  probes ");
+	for (uint32_t i = 0; i < __CERR_STATS_PROBES; ++i)
+		__cerr_out(o, " %llu", (unsigned long long)sum->probes[i]);
+	__cerr_out(o, "\n");
+}
+
+static void __cerr_stats_json(t_cerr_out *o, const t_cerr_stats *sum,
+	uint32_t threads, uint64_t len, uint64_t cap) {
+	const t_cerr_stats		*s = g__cerr_stats_all;
+	const t_cerr_code_stats	*c;
+	const char				*sep = "";
+
+	__cerr_out(o, "{\"threads\":%u,\"tries\":%llu,\"depth_max\":%u,"
+		"\"per_thread\":[", threads, (unsigned long long)sum->tries,
+		sum->depth_max);
+	for (; s; s = s->link, sep = ",")
+		__cerr_out(o, "%s{\"tid\":%d,\"tries\":%llu,\"depth_max\":%u}", sep,
+			s->tid, (unsigned long long)s->tries, s->depth_max);
+	__cerr_out(o, "],\"codes\":[");
+	sep = "";
+	for (uint32_t i = 0; i < CERR_STATS_CODES; ++i) {
+		c = sum->codes + i;
+		if (!c->thrown && !c->caught)
+			continue;
+		__cerr_out(o, "%s{\"code\":%llu,\"thrown\":%llu,\"caught\":%llu}", sep,
+			(unsigned long long)c->code, (unsigned long long)c->thrown,
+			(unsigned long long)c->caught);
+		sep = ",";
+	}
+	c = sum->codes + CERR_STATS_CODES;
+	__cerr_out(o, "],\"other\":{\"thrown\":%llu,\"caught\":%llu},"
+		"\"cache\":{\"len\":%llu,\"cap\":%llu},"
+		"\"allocs\":{\"count\":%llu,\"bytes\":%llu},"
+		"\"frees\":{\"count\":%llu,\"bytes\":%llu},\"probes\":[",
+		(unsigned long long)c->thrown, (unsigned long long)c->caught,
+		(unsigned long long)len, (unsigned long long)cap,
+		(unsigned long long)sum->allocs, (unsigned long long)sum->alloc_bytes,
+		(unsigned long long)sum->frees, (unsigned long long)sum->free_bytes);
+	for (uint32_t i = 0; i < __CERR_STATS_PROBES; ++i)
+		__cerr_out(o, "%s%llu", i ? "," : "",
+			(unsigned long long)sum->probes[i]);
+	__cerr_out(o, "]}\n");
+}
+
+// Counters are read while their threads keep counting, each value is exact
+// but they are not a single snapshot. Only write(2) is called, with no lock
+// nor allocation, so it can run from a signal handler.
+void cerr_stats_dump(int fd, int format) {
+	t_cerr_stats	sum = {0};
+	t_cerr_out		o;
+	uint32_t		threads;
+	uint64_t		len;
+	uint64_t		cap;
+
+	o.fd = fd;
+	o.len = 0;
+	__cerr_stats_sum(&sum, &threads);
+	len = 0;
+	cap = 0;
+	if (__cerr_cache_usage)
+		__cerr_cache_usage(&len, &cap);
+	if (format == CERR_STATS_JSON)
+		__cerr_stats_json(&o, &sum, threads, len, cap);
+	else
+		__cerr_stats_text(&o, &sum, threads, len, cap);
+	__cerr_out_flush(&o);
+}
+
+#  ifdef CERR_STATS_SIGNAL
+static void __cerr_stats_signal(int sig) {
+	int	err = errno;
+
+	(void)sig;
+	cerr_stats_dump(STDERR_FILENO, CERR_STATS_TEXT);
+	errno = err;
+}
+
+// Dump to stderr whenever CERR_STATS_SIGNAL is received
+__attribute__((constructor))
+static void __cerr_stats_install(void) {
+	struct sigaction	sa = {0};
+
+	sa.sa_handler = __cerr_stats_signal;
+	sa.sa_flags = SA_RESTART;
+	sigemptyset(&sa.sa_mask);
+	sigaction(CERR_STATS_SIGNAL, &sa, NULL);
+}
+#  endif
+# endif
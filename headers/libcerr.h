@@ -2,5 +2,9 @@
 
 # include <libcerr-log.h>
 # include <libcerr-assert.h>
+# include <libcerr-arena.h>
+# include <libcerr-stats.h>
 # include <libcerr-exception.h>
+# include <libcerr-result.h>
+# include <libcerr-parallel.h>
 # include <libcerr-cache.h>
@@ -0,0 +1,48 @@
+// Prints a LOG_BINARY file, or stdin, back as the text logs, colored for a
+// terminal. usage: cerr-decode [-t] [file], -t adds the time and thread
+#define CERR_IMPLEMENTATION
+#include <libcerr.h>
+
+static char *read_all(FILE *in, size_t *len) {
+	size_t	cap = 0x10000;
+	char	*data = malloc(cap);
+	char	*grown;
+	size_t	n;
+
+	*len = 0;
+	while (data && (n = fread(data + *len, 1, cap - *len, in)) > 0) {
+		*len += n;
+		if (*len < cap)
+			continue;
+		if (!(grown = realloc(data, cap * 2)))
+			free(data);
+		data = grown;
+		cap *= 2;
+	}
+	return data;
+}
+
+int main(int ac, char **av) {
+	int		stamp = ac > 1 && !strcmp(av[1], "-t");
+	FILE	*in = stdin;
+	char	*data;
+	size_t	len;
+
+	if (ac > 2 + stamp) {
+		fprintf(stderr, "usage: %s [-t] [file]\n", av[0]);
+		return 2;
+	}
+	if (ac > 1 + stamp && !(in = fopen(av[1 + stamp], "rb"))) {
+		perror(av[1 + stamp]);
+		return 1;
+	}
+	if (!(data = read_all(in, &len))) {
+		perror(av[0]);
+		return 1;
+	}
+	__cerr_log_decode(stdout, data, len, (stamp ? __CERR_DECODE_STAMP : 0)
+		| (isatty(STDOUT_FILENO) ? 0 : __CERR_DECODE_PLAIN));
+	free(data);
+	fclose(in);
+	return 0;
+}
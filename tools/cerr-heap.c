@@ -0,0 +1,51 @@
+// Prints what a CERR_CACHE_TRACE file says about the heap: totals, peak, live
+// bytes over time and leaks by site. usage: cerr-heap [-r rows] file
+#define CERR_IMPLEMENTATION
+#include <libcerr.h>
+
+static char *read_all(FILE *in, size_t *len) {
+	size_t	cap = 0x10000;
+	char	*data = malloc(cap);
+	char	*grown;
+	size_t	n;
+
+	*len = 0;
+	while (data && (n = fread(data + *len, 1, cap - *len, in)) > 0) {
+		*len += n;
+		if (*len < cap)
+			continue;
+		if (!(grown = realloc(data, cap * 2)))
+			free(data);
+		data = grown;
+		cap *= 2;
+	}
+	return data;
+}
+
+int main(int ac, char **av) {
+	int		rows = ac > 2 && !strcmp(av[1], "-r") ? atoi(av[2]) : 20;
+	int		file = ac > 2 && !strcmp(av[1], "-r") ? 3 : 1;
+	FILE	*in;
+	char	*data;
+	size_t	len;
+	int		ret;
+
+	if (ac != file + 1 || rows < 0) {
+		fprintf(stderr, "usage: %s [-r rows] file\n", av[0]);
+		return 2;
+	}
+	if (!(in = fopen(av[file], "rb"))) {
+		perror(av[file]);
+		return 1;
+	}
+	if (!(data = read_all(in, &len))) {
+		perror(av[0]);
+		fclose(in);
+		return 1;
+	}
+	if ((ret = __cerr_trace_analyze(stdout, data, len, rows)))
+		fprintf(stderr, "%s: %s is not a heap trace\n", av[0], av[file]);
+	free(data);
+	fclose(in);
+	return ret != 0;
+}
@@ -0,0 +1,152 @@
+#include "tests.h"
+
+static void *arena_top(void) {
+	return g__cerr_arena.top;
+}
+
+static int arena_return(void **out) {
+	TRY_ARENA {
+		*out = ARENA_MALLOC(64);
+		return 1;
+	}
+	return 0;
+}
+
+UTEST(arena, released_on_exit) {
+	void *top = NULL;
+	char *a = NULL;
+	char *b = NULL;
+
+	TRY_ARENA {
+		top = arena_top();
+		a = ARENA_MALLOC(10);
+		b = ARENA_MALLOC(1);
+		memset(a, 'a', 10);
+		*b = 'b';
+		ASSERT_EQ((uintptr_t)a % __CERR_ARENA_ALIGN, 0u);
+		ASSERT_EQ((uintptr_t)b % __CERR_ARENA_ALIGN, 0u);
+		ASSERT_TRUE(b >= a + 10);
+		ASSERT_EQ(g__cerr_arena.depth, 1u);
+	} CATCH_ALL() {
+		END_BAD_TEST(BAD_CATCH_MSG);
+	}
+	ASSERT_TRUE(arena_top() == top);
+	ASSERT_EQ(g__cerr_arena.depth, 0u);
+}
+
+UTEST(arena, released_on_throw) {
+	void *volatile top = NULL;
+	volatile int caught = 0;
+
+	TRY_ARENA {
+		top = arena_top();
+		for (int i = 0; i < 100; ++i)
+			ARENA_MALLOC(128);
+		THROW(ERROR);
+	} CATCH(ERROR) {
+		caught = 1;
+		ASSERT_TRUE(arena_top() != top);
+	}
+	ASSERT_TRUE(caught);
+	ASSERT_TRUE(arena_top() == top);
+	ASSERT_EQ(g__cerr_arena.depth, 0u);
+}
+
+UTEST(arena, released_on_return) {
+	void *top = NULL;
+	void *p = NULL;
+
+	TRY_ARENA {
+		top = arena_top();
+		ASSERT_TRUE(arena_return(&p));
+		ASSERT_TRUE(p == top);
+		ASSERT_TRUE(arena_top() == top);
+	}
+	ASSERT_EQ(g__cerr_arena.depth, 0u);
+}
+
+static void arena_throw(void *arg) {
+	(void)arg;
+	THROW(ERROR);
+}
+
+// A cleanup throwing out of a TRY_ARENA still leaves the arena scope
+UTEST(arena, throwing_cleanup) {
+	void *volatile top = NULL;
+	volatile int caught = 0;
+
+	TRY {
+		top = arena_top();
+		TRY_ARENA {
+			ARENA_MALLOC(128);
+			DEFER(arena_throw, NULL);
+		}
+	} CATCH(ERROR) {
+		caught = 1;
+	}
+	ASSERT_TRUE(caught);
+	ASSERT_TRUE(arena_top() == top);
+	ASSERT_EQ(g__cerr_arena.depth, 0u);
+}
+
+UTEST(arena, nested) {
+	char *outer = NULL;
+	char *volatile inner = NULL;
+
+	TRY_ARENA {
+		outer = ARENA_MALLOC(32);
+		strcpy(outer, "outer");
+		TRY_ARENA {
+			inner = ARENA_MALLOC(32);
+			ASSERT_TRUE(inner != outer);
+			THROW(ERROR);
+		} CATCH_ALL() {}
+		ASSERT_TRUE(ARENA_MALLOC(32) == inner);
+		TRY {
+			ARENA_MALLOC(32);
+		}
+		ASSERT_STREQ(outer, "outer");
+	}
+	ASSERT_EQ(g__cerr_arena.depth, 0u);
+}
+
+UTEST(arena, grows_and_reuses) {
+	t_cerr_region *head = NULL;
+	t_cerr_region *next = NULL;
+	char *big = NULL;
+
+	for (int round = 0; round < 2; ++round) {
+		TRY_ARENA {
+			head = g__cerr_arena.head;
+			for (int i = 0; i < 3 * CERR_ARENA_SIZE / 1024; ++i)
+				memset(ARENA_MALLOC(1024), i, 1024);
+			big = ARENA_MALLOC(4 * CERR_ARENA_SIZE);
+			memset(big, 0, 4 * CERR_ARENA_SIZE);
+			ASSERT_TRUE(g__cerr_arena.region != head);
+			if (round == 0)
+				next = head->next;
+			else
+				ASSERT_TRUE(head->next == next);
+		}
+		ASSERT_TRUE(g__cerr_arena.region == head);
+	}
+}
+
+UTEST(arena, calloc) {
+	TRY_ARENA {
+		memset(ARENA_MALLOC(256), 0xff, 256);
+	}
+	TRY_ARENA {
+		unsigned char *p = ARENA_CALLOC(16, 16);
+		for (int i = 0; i < 256; ++i)
+			ASSERT_EQ(p[i], 0);
+	}
+}
+
+UTEST(arena, outside) {
+	ASSERT_EQ(g__cerr_arena.depth, 0u);
+	ASSERT_TRUE(__cerr_arena_alloc(&g__cerr_arena, 16) == NULL);
+	TRY {
+		ASSERT_TRUE(__cerr_arena_alloc(&g__cerr_arena, 16) == NULL);
+	}
+}
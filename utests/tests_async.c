@@ -0,0 +1,142 @@
+# define _GNU_SOURCE
+# include <stdio.h>
+# include <stdlib.h>
+# include <unistd.h>
+
+static FILE *g_log = NULL;
+static char g_path[] = "/tmp/libcerr_async_XXXXXX";
+
+# define CERR_IMPLEMENTATION
+# define LOG_ASYNC
+# define LOG_HEADER
+# define LOG_FDOUT		g_log
+# define LOG_RING_SIZE	0x1000
+# define LOG_LINE_SIZE	256
+#include "tests.h"
+#include <pthread.h>
+#include <string.h>
+#include <sys/syscall.h>
+
+// Small enough for the lines of every thread to fit in one ring
+# define THREADS	4
+# define LINES		10
+
+__attribute__((constructor))
+static void log_open(void) {
+	g_log = fdopen(mkstemp(g_path), "w");
+}
+
+__attribute__((destructor))
+static void log_close(void) {
+	unlink(g_path);
+}
+
+// Everything written to the log file so far
+static char *log_read(void) {
+	static char buf[1 << 20];
+	FILE *f = fopen(g_path, "r");
+	size_t len = fread(buf, 1, sizeof(buf) - 1, f);
+
+	fclose(f);
+	buf[len] = '\0';
+	return buf;
+}
+
+static int count(const char *str, const char *needle) {
+	int n = 0;
+
+	for (; (str = strstr(str, needle)); str += strlen(needle))
+		++n;
+	return n;
+}
+
+// ════════════════════════════════[ ASYNC TESTS ]═══════════════════════════════
+
+UTEST(async, ordered) {
+	char *log;
+	char *prev;
+	char line[32];
+
+	for (int i = 0; i < LINES; ++i)
+		LOG_INFO("ordered %d;", i);
+	LOG_FLUSH();
+	log = log_read();
+	prev = log;
+	for (int i = 0; i < LINES; ++i) {
+		snprintf(line, sizeof(line), "ordered %d;", i);
+		char *at = strstr(prev, line);
+		ASSERT_TRUE(at != NULL);
+		prev = at;
+	}
+}
+
+static void *log_thread(void *arg) {
+	for (int i = 0; i < LINES; ++i)
+		LOG_WARN("thread %d line %d;", (int)(uintptr_t)arg, i);
+	return NULL;
+}
+
+UTEST(async, threads) {
+	pthread_t threads[THREADS];
+	char line[32];
+
+	for (int t = 0; t < THREADS; ++t)
+		pthread_create(&threads[t], NULL, log_thread, (void *)(uintptr_t)t);
+	for (int t = 0; t < THREADS; ++t)
+		pthread_join(threads[t], NULL);
+	LOG_FLUSH();
+	for (int t = 0; t < THREADS; ++t)
+		for (int i = 0; i < LINES; ++i) {
+			snprintf(line, sizeof(line), "thread %d line %d;", t, i);
+			ASSERT_EQ(count(log_read(), line), 1);
+		}
+}
+
+UTEST(async, truncated) {
+	char big[4 * LOG_LINE_SIZE];
+
+	memset(big, 'x', sizeof(big) - 1);
+	big[sizeof(big) - 1] = '\0';
+	LOG_INFO("truncated %s", big);
+	LOG_INFO("after truncated;");
+	LOG_FLUSH();
+	ASSERT_TRUE(strstr(log_read(), "xxx\n") != NULL);
+	ASSERT_TRUE(strstr(log_read(), "after truncated;") != NULL);
+}
+
+UTEST(async, drop_when_full) {
+	// Holding the consumer lock keeps the writer from emptying the ring
+	pthread_mutex_lock(&g__cerr_log.lock);
+	for (int i = 0; i < 200; ++i)
+		LOG_INFO("flood %d;", i);
+	ASSERT_GT(__atomic_load_n(&g__cerr_ring->dropped, __ATOMIC_RELAXED), 0u);
+	pthread_mutex_unlock(&g__cerr_log.lock);
+	LOG_FLUSH();
+	ASSERT_EQ(count(log_read(), "libcerr: log, dropped"), 1);
+	ASSERT_EQ(count(log_read(), "flood 0;"), 1);
+	LOG_INFO("recovered;");
+	LOG_FLUSH();
+	ASSERT_EQ(count(log_read(), "recovered;"), 1);
+}
+
+UTEST(async, header) {
+	const char *tag = "]     info:  > with header;";
+	char *line;
+	unsigned long sec;
+	unsigned usec;
+	int tid;
+
+	LOG_INFO("with header;");
+	LOG_FLUSH();
+	line = strstr(log_read(), "with header;");
+	ASSERT_TRUE(line != NULL);
+	while (line > log_read() && line[-1] != '\n')
+		--line;
+	ASSERT_EQ(sscanf(line, "[%lu.%6u %d]", &sec, &usec, &tid), 3);
+	ASSERT_EQ(tid, (int)syscall(SYS_gettid));
+	// Not a terminal, no escape sequence
+	ASSERT_TRUE(strncmp(strchr(line, ']'), tag, strlen(tag)) == 0);
+	ASSERT_TRUE(strchr(log_read(), '\033') == NULL);
+}
+
+UTEST_MAIN();
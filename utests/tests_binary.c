@@ -0,0 +1,170 @@
+# define _GNU_SOURCE
+# include <stdio.h>
+# include <stdlib.h>
+# include <unistd.h>
+
+static FILE *g_log = NULL;
+static char g_path[] = "/tmp/libcerr_binary_XXXXXX";
+
+# define CERR_IMPLEMENTATION
+# define LOG_BINARY
+# define LOG_FDOUT		g_log
+# define LOG_RING_SIZE	0x1000
+# define LOG_LINE_SIZE	256
+#include "tests.h"
+#include <errno.h>
+#include <string.h>
+#include <sys/mman.h>
+
+__attribute__((constructor))
+static void log_open(void) {
+	g_log = fdopen(mkstemp(g_path), "w");
+}
+
+__attribute__((destructor))
+static void log_close(void) {
+	unlink(g_path);
+}
+
+// Raw bytes written to the log file so far
+static char *log_raw(size_t *len) {
+	static char buf[1 << 20];
+	FILE *f = fopen(g_path, "r");
+
+	*len = fread(buf, 1, sizeof(buf), f);
+	fclose(f);
+	return buf;
+}
+
+// Everything logged so far, decoded back to text
+static char *log_text(void) {
+	static char *text = NULL;
+	size_t size = 0;
+	size_t len;
+	char *raw;
+	FILE *out;
+
+	LOG_FLUSH();
+	raw = log_raw(&len);
+	free(text);
+	out = open_memstream(&text, &size);
+	__cerr_log_decode(out, raw, len, 0);
+	fclose(out);
+	return text;
+}
+
+static int count(const char *str, const char *needle) {
+	int n = 0;
+
+	for (; (str = strstr(str, needle)); str += strlen(needle))
+		++n;
+	return n;
+}
+
+// ═══════════════════════════════[ BINARY TESTS ]═══════════════════════════════
+
+UTEST(binary, decoded_as_text) {
+	char line[128];
+
+	LOG_INFO("decoded %d %s %.2f %c %lu;", -42, "str", 1.5, 'c', 7ul);
+	snprintf(line, sizeof(line), __F_SEP(__C_CYAN) " > %s\n", "info: ",
+		"decoded -42 str 1.50 c 7;");
+	ASSERT_TRUE(strstr(log_text(), line) != NULL);
+}
+
+UTEST(binary, site_registered_once) {
+	const char *fmt = "once %d;";
+	size_t len;
+	char *raw;
+	t_cerr_brec h;
+	int sites = 0;
+
+	for (int i = 0; i < 5; ++i)
+		LOG_DEBUG("once %d;", i);
+	ASSERT_EQ(count(log_text(), "once "), 5);
+	raw = log_raw(&len);
+	for (char *p = raw; __cerr_brec_read(p, raw + len, &h); p += h.size)
+		if (h.type == __CERR_B_SITE
+			&& memmem(p, h.size, fmt, strlen(fmt) + 1))
+			++sites;
+	ASSERT_EQ(sites, 1);
+}
+
+// A single site, only its first line carries the descriptor
+static size_t log_size(void) {
+	size_t len;
+
+	LOG_WARN("size %d %d;", 1, 2);
+	LOG_FLUSH();
+	log_raw(&len);
+	return len;
+}
+
+UTEST(binary, smaller_than_text) {
+	size_t before = log_size();
+	size_t after = log_size();
+
+	ASSERT_EQ(after - before, sizeof(t_cerr_brec) + 2 * (2 + sizeof(int)));
+	ASSERT_LT(after - before, (size_t)snprintf(NULL, 0,
+		__F_SEP(__C_YELLOW) " > size 1 2;\n", "warning: "));
+}
+
+UTEST(binary, strings_are_copied) {
+	char word[16];
+	char *null = NULL;
+
+	strcpy(word, "before");
+	LOG_INFO("copied %s %s;", word, null);
+	strcpy(word, "after");
+	ASSERT_EQ(count(log_text(), "copied before (null);"), 1);
+}
+
+// A string is only read up to its precision, a %p one is not read at all
+UTEST(binary, strings_by_precision) {
+	long page = sysconf(_SC_PAGESIZE);
+	char *map = mmap(NULL, 2 * page, PROT_READ | PROT_WRITE,
+		MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+	char *tok = map + page - 4;
+	char line[64];
+
+	ASSERT_TRUE(map != MAP_FAILED);
+	ASSERT_EQ(mprotect(map + page, page, PROT_NONE), 0);
+	memcpy(tok, "abcd", 4);
+	LOG_INFO("precision '%.*s' '%.2s' %p;", 4, tok, tok, map + page);
+	snprintf(line, sizeof(line), "precision 'abcd' 'ab' %p;", map + page);
+	ASSERT_EQ(count(log_text(), line), 1);
+	munmap(map, 2 * page);
+}
+
+UTEST(binary, errno_and_truncation) {
+	char big[4 * LOG_LINE_SIZE];
+	char line[128];
+
+	memset(big, 'x', sizeof(big) - 1);
+	big[sizeof(big) - 1] = '\0';
+	errno = ENOENT;
+	LOG_ERR("errno %m;");
+	LOG_ERR("truncated %s %d", big, 1);
+	snprintf(line, sizeof(line), "errno %s;", strerror(ENOENT));
+	ASSERT_EQ(count(log_text(), line), 1);
+	ASSERT_TRUE(strstr(log_text(), "truncated xxxx") != NULL);
+}
+
+UTEST(binary, new_line) {
+	LOG_OK("before nl;");
+	LOG_NL();
+	ASSERT_TRUE(strstr(log_text(), "before nl;\n\n") != NULL);
+}
+
+UTEST(binary, drop_when_full) {
+	// Holding the consumer lock keeps the writer from emptying the ring
+	pthread_mutex_lock(&g__cerr_log.lock);
+	for (int i = 0; i < 200; ++i)
+		LOG_INFO("flood %d;", i);
+	ASSERT_GT(__atomic_load_n(&g__cerr_ring->dropped, __ATOMIC_RELAXED), 0u);
+	pthread_mutex_unlock(&g__cerr_log.lock);
+	ASSERT_EQ(count(log_text(), "libcerr: log, dropped"), 1);
+	ASSERT_EQ(count(log_text(), "flood 0;"), 1);
+}
+
+UTEST_MAIN();
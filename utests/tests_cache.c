@@ -160,17 +160,17 @@ UTEST(cache_integrity, pointer_in_cache) {
 	void *c = MALLOC(16);
 	
 	// Verify each pointer actually exists in cache array
-	uint32_t idx_a = __CERR_CACHE_SEARCH(a, __CERR_MOD((uintptr_t)a));
-	uint32_t idx_b = __CERR_CACHE_SEARCH(b, __CERR_MOD((uintptr_t)b));
-	uint32_t idx_c = __CERR_CACHE_SEARCH(c, __CERR_MOD((uintptr_t)c));
+	void **idx_a = __CERR_CACHE_FIND(a);
+	void **idx_b = __CERR_CACHE_FIND(b);
+	void **idx_c = __CERR_CACHE_FIND(c);
 	
-	ASSERT_TRUE(idx_a < CERR_CACHE_SIZE);
-	ASSERT_TRUE(idx_b < CERR_CACHE_SIZE);
-	ASSERT_TRUE(idx_c < CERR_CACHE_SIZE);
+	ASSERT_TRUE(idx_a != NULL);
+	ASSERT_TRUE(idx_b != NULL);
+	ASSERT_TRUE(idx_c != NULL);
 	
-	ASSERT_EQ(g__cerr_cache.allocs[idx_a], a);
-	ASSERT_EQ(g__cerr_cache.allocs[idx_b], b);
-	ASSERT_EQ(g__cerr_cache.allocs[idx_c], c);
+	ASSERT_EQ(*idx_a, a);
+	ASSERT_EQ(*idx_b, b);
+	ASSERT_EQ(*idx_c, c);
 	
 	FREE(a);
 	FREE(b);
@@ -180,31 +180,31 @@ UTEST(cache_integrity, pointer_in_cache) {
 UTEST(cache_integrity, pointer_removed_after_free) {
 	void *ptr = MALLOC(32);
 	
-	uint32_t idx_before = __CERR_CACHE_SEARCH(ptr, __CERR_MOD((uintptr_t)ptr));
-	ASSERT_TRUE(idx_before < CERR_CACHE_SIZE);
+	void **idx_before = __CERR_CACHE_FIND(ptr);
+	ASSERT_TRUE(idx_before != NULL);
 	
 	FREE(ptr);
 	
-	uint32_t idx_after = __CERR_CACHE_SEARCH(ptr, __CERR_MOD((uintptr_t)ptr));
-	ASSERT_TRUE(idx_after >= CERR_CACHE_SIZE); // Not found
+	void **idx_after = __CERR_CACHE_FIND(ptr);
+	ASSERT_TRUE(idx_after == NULL); // Not found
 }
 
 UTEST(cache_integrity, realloc_updates_cache) {
 	void *old_ptr = MALLOC(16);
 	
-	uint32_t idx_old = __CERR_CACHE_SEARCH(old_ptr, __CERR_MOD((uintptr_t)old_ptr));
-	ASSERT_TRUE(idx_old < CERR_CACHE_SIZE);
+	void **idx_old = __CERR_CACHE_FIND(old_ptr);
+	ASSERT_TRUE(idx_old != NULL);
 	
 	void *new_ptr = REALLOC(old_ptr, 256);
 	
 	// New pointer must be in cache
-	uint32_t idx_new = __CERR_CACHE_SEARCH(new_ptr, __CERR_MOD((uintptr_t)new_ptr));
-	ASSERT_TRUE(idx_new < CERR_CACHE_SIZE);
+	void **idx_new = __CERR_CACHE_FIND(new_ptr);
+	ASSERT_TRUE(idx_new != NULL);
 	
 	// If address changed, old pointer must be gone
 	if (old_ptr != new_ptr) {
-		uint32_t idx_old_after = __CERR_CACHE_SEARCH(old_ptr, __CERR_MOD((uintptr_t)old_ptr));
-		ASSERT_TRUE(idx_old_after >= CERR_CACHE_SIZE);
+		void **idx_old_after = __CERR_CACHE_FIND(old_ptr);
+		ASSERT_TRUE(idx_old_after == NULL);
 	}
 	
 	FREE(new_ptr);
@@ -221,8 +221,8 @@ UTEST(cache_hash, collision_handling) {
 		ASSERT_TRUE_MSG(ptrs[i] != NULL, "MALLOC returned NULL");
 		
 		// Verify it's findable immediately after insert
-		uint32_t idx = __CERR_CACHE_SEARCH(ptrs[i], __CERR_MOD((uintptr_t)ptrs[i]));
-		ASSERT_TRUE(idx < CERR_CACHE_SIZE);
+		void **idx = __CERR_CACHE_FIND(ptrs[i]);
+		ASSERT_TRUE(idx != NULL);
 	}
 	
 	ASSERT_EQ(g__cerr_cache.len, N);
@@ -234,6 +234,131 @@ UTEST(cache_hash, collision_handling) {
 	ASSERT_EQ(g__cerr_cache.len, 0);
 }
 
+static uint32_t cache_max_dist(void) {
+	uint32_t max = 0;
+	
+	for (uint32_t i = 0; i < g__cerr_cache.cap; ++i) {
+		void *cur = g__cerr_cache.allocs[i];
+		if (cur && __CERR_DIST(cur, i, g__cerr_cache.cap) > max)
+			max = __CERR_DIST(cur, i, g__cerr_cache.cap);
+	}
+	return max;
+}
+
+UTEST(cache_hash, page_aligned) {
+	static const uintptr_t N = 0x4000;
+	const uintptr_t base = (uintptr_t)0x7f0000000000ull;
+	uint32_t found = 0, missed = 0, removed = 0;
+	
+	// Synthetic page aligned addresses, only inserted and removed, never freed
+	for (uintptr_t i = 0; i < N; ++i)
+		__CERR_CACHE_INSERT((void *)(base + i * 4096), 0, 0);
+	ASSERT_EQ(g__cerr_cache.len, N);
+	uint32_t max_dist = cache_max_dist();
+	for (uintptr_t i = 0; i < N; ++i)
+		found += __CERR_CACHE_FIND((void *)(base + i * 4096)) != NULL;
+	for (uintptr_t i = N; i < 2 * N; ++i)
+		missed += __CERR_CACHE_FIND((void *)(base + i * 4096)) == NULL;
+	for (uintptr_t i = 0; i < N; ++i)
+		removed += __CERR_CACHE_REMOVE((void *)(base + i * 4096), NULL);
+	
+	ASSERT_EQ(found, N);
+	ASSERT_EQ(missed, N);
+	ASSERT_EQ(removed, N);
+	ASSERT_EQ(g__cerr_cache.len, 0);
+	ASSERT_LT(max_dist, 32);
+}
+
+UTEST(cache_hash, large_allocations) {
+	static const int N = 64;
+	void *ptrs[N];
+	
+	// Big enough to be mmap backed, page aligned plus the malloc header
+	for (int i = 0; i < N; ++i) {
+		ptrs[i] = MALLOC(1 << 18);
+		ASSERT_TRUE(__CERR_CACHE_FIND(ptrs[i]) != NULL);
+	}
+	ASSERT_EQ(g__cerr_cache.len, N);
+	ASSERT_LT(cache_max_dist(), 16);
+	for (int i = 0; i < N; ++i)
+		FREE(ptrs[i]);
+	ASSERT_EQ(g__cerr_cache.len, 0);
+}
+
+// ═══════════════════════════════[ GROWTH TESTS ]═══════════════════════════════
+
+UTEST(cache_grow, beyond_initial_size) {
+	static const uintptr_t N = 0x30000;
+	const uintptr_t base = (uintptr_t)0x7e0000000000ull;
+	uint32_t found = 0, removed = 0;
+	
+	// More synthetic entries than the former fixed limit, found while migrating
+	for (uintptr_t i = 0; i < N; ++i) {
+		__CERR_CACHE_INSERT((void *)(base + i * 16), 0, 0);
+		found += __CERR_CACHE_FIND((void *)(base + i / 2 * 16)) != NULL;
+	}
+	uint32_t len = g__cerr_cache.len;
+	uint32_t cap = g__cerr_cache.cap;
+	for (uintptr_t i = 0; i < N; ++i)
+		found += __CERR_CACHE_FIND((void *)(base + i * 16)) != NULL;
+	for (uintptr_t i = 0; i < N; i += 2)
+		removed += __CERR_CACHE_REMOVE((void *)(base + i * 16), NULL);
+	for (uintptr_t i = 1; i < N; i += 2)
+		removed += __CERR_CACHE_REMOVE((void *)(base + i * 16), NULL);
+	
+	ASSERT_EQ(len, N);
+	ASSERT_GE(cap, 2 * N);
+	ASSERT_EQ(found, 2 * N);
+	ASSERT_EQ(removed, N);
+	ASSERT_EQ(g__cerr_cache.len, 0);
+}
+
+UTEST(cache_grow, migrating_free) {
+	void *ptrs[CERR_CACHE_SIZE];
+	
+	// Fill up to the growth threshold, then free while the old table migrates
+	for (int i = 0; i < CERR_CACHE_SIZE; ++i)
+		ptrs[i] = MALLOC(8);
+	ASSERT_EQ(g__cerr_cache.len, CERR_CACHE_SIZE);
+	for (int i = CERR_CACHE_SIZE - 1; i >= 0; --i) {
+		ASSERT_TRUE(__CERR_CACHE_FIND(ptrs[i]) != NULL);
+		FREE(ptrs[i]);
+		ASSERT_TRUE(__CERR_CACHE_FIND(ptrs[i]) == NULL);
+	}
+	ASSERT_EQ(g__cerr_cache.len, 0);
+}
+
+// Occupied slots according to the bitmaps, must always match len
+static uint32_t cache_bit_count(void) {
+	uint32_t n = 0;
+
+	for (uint32_t w = 0; w < g__cerr_cache.cap / 64; ++w)
+		n += __builtin_popcountll(__CERR_BITS(g__cerr_cache.allocs,
+			g__cerr_cache.cap)[w]);
+	for (uint32_t w = 0; g__cerr_cache.old && w < g__cerr_cache.old_cap / 64; ++w)
+		n += __builtin_popcountll(__CERR_BITS(g__cerr_cache.old,
+			g__cerr_cache.old_cap)[w]);
+	return n;
+}
+
+UTEST(cache_grow, occupancy_bitmap) {
+	static const int N = 3 * CERR_CACHE_SIZE;
+	static void *ptrs[3 * CERR_CACHE_SIZE];
+
+	for (int i = 0; i < N; ++i) {
+		ptrs[i] = MALLOC(8);
+		ASSERT_EQ(cache_bit_count(), g__cerr_cache.len);
+	}
+	for (int i = 0; i < N; i += 2) {
+		FREE(ptrs[i]);
+		ASSERT_EQ(cache_bit_count(), g__cerr_cache.len);
+	}
+	for (int i = 1; i < N; i += 2)
+		FREE(ptrs[i]);
+	ASSERT_EQ(cache_bit_count(), 0u);
+	ASSERT_EQ(__cerr_cache_live(), 0u);
+}
+
 // ═══════════════════════════════[ MIXED TESTS ]════════════════════════════════
 
 UTEST(cache_mixed, stress_test) {
@@ -263,6 +388,207 @@ UTEST(cache_mixed, stress_test) {
 	ASSERT_EQ(g__cerr_cache. len, 0);
 }
 
+// ════════════════════════════════[ SITE TESTS ]════════════════════════════════
+
+static uint64_t cache_meta(void *ptr) {
+	void **slot = __CERR_CACHE_FIND(ptr);
+	t_cerr_cache *c = &g__cerr_cache;
+
+	if (slot >= c->allocs && slot < c->allocs + c->cap)
+		return __CERR_METAS(c->allocs, c->cap)[slot - c->allocs];
+	return __CERR_METAS(c->old, c->old_cap)[slot - c->old];
+}
+
+static void *site_a(size_t size) {
+	return MALLOC(size);
+}
+
+static void *site_b(size_t size) {
+	return CALLOC(1, size);
+}
+
+UTEST(cache_site, interned_once) {
+	void *a1 = site_a(24);
+	void *a2 = site_a(48);
+	void *b = site_b(100);
+	uint32_t sa = __CERR_META_SITE(cache_meta(a1));
+	uint32_t sb = __CERR_META_SITE(cache_meta(b));
+
+	ASSERT_NE(sa, 0u);
+	ASSERT_NE(sb, 0u);
+	ASSERT_NE(sa, sb);
+	ASSERT_EQ(__CERR_META_SITE(cache_meta(a2)), sa);
+	ASSERT_EQ(__CERR_META_SIZE(cache_meta(a1)), 24u);
+	ASSERT_EQ(__CERR_META_SIZE(cache_meta(a2)), 48u);
+	ASSERT_EQ(__CERR_META_SIZE(cache_meta(b)), 100u);
+	ASSERT_STREQ(g__cerr_sites[sa]->file, __FILE__);
+	ASSERT_EQ(g__cerr_sites[sb]->line, g__cerr_sites[sa]->line + 4);
+	FREE(a1);
+	FREE(a2);
+	FREE(b);
+}
+
+UTEST(cache_site, kept_by_realloc_and_growth) {
+	static void *ptrs[2 * CERR_CACHE_SIZE];
+	void *r = site_a(8);
+	uint32_t sa = __CERR_META_SITE(cache_meta(r));
+
+	r = REALLOC(r, 512);
+	ASSERT_NE(__CERR_META_SITE(cache_meta(r)), sa);
+	ASSERT_EQ(__CERR_META_SIZE(cache_meta(r)), 512u);
+	// Metas follow their pointer through displacement and migration
+	for (int i = 0; i < 2 * CERR_CACHE_SIZE; ++i)
+		ptrs[i] = site_a(i + 1);
+	for (int i = 0; i < 2 * CERR_CACHE_SIZE; ++i) {
+		ASSERT_EQ(__CERR_META_SITE(cache_meta(ptrs[i])), sa);
+		ASSERT_EQ(__CERR_META_SIZE(cache_meta(ptrs[i])), (uint64_t)i + 1);
+	}
+	LOG_INFO("Testing CERR_CACHE_REPORT (expect 2 sites):");
+	CERR_CACHE_REPORT();
+	for (int i = 0; i < 2 * CERR_CACHE_SIZE; ++i)
+		FREE(ptrs[i]);
+	FREE(r);
+}
+
+// ═══════════════════════════════[ CHECKPOINT TESTS ]═══════════════════════════
+
+UTEST(cache_checkpoint, young_only) {
+	t_cerr_block out[4];
+	void *old = MALLOC(8);
+	t_cerr_checkpoint cp = cerr_cache_checkpoint();
+	void *a = MALLOC(24);
+	void *b = CALLOC(2, 16);
+	void *c = MALLOC(40);
+
+	FREE(b);
+	ASSERT_EQ(cerr_cache_diff(cp, out, 4), (size_t)2);
+	ASSERT_TRUE(out[0].ptr == a);
+	ASSERT_EQ(out[0].size, (size_t)24);
+	ASSERT_TRUE(out[1].ptr == c);
+	ASSERT_EQ(out[1].size, (size_t)40);
+	ASSERT_STREQ(out[1].file, __FILE__);
+	ASSERT_EQ(out[1].line, out[0].line + 2);
+	// A later checkpoint only sees what comes after it
+	ASSERT_EQ(cerr_cache_diff(cerr_cache_checkpoint(), out, 4), (size_t)0);
+	FREE(a);
+	FREE(c);
+	FREE(old);
+	ASSERT_EQ(cerr_cache_diff(cp, out, 4), (size_t)0);
+}
+
+UTEST(cache_checkpoint, reused_address) {
+	t_cerr_block out[4];
+	t_cerr_checkpoint cp = cerr_cache_checkpoint();
+	void *a = MALLOC(64);
+	void *b;
+
+	FREE(a);
+	b = MALLOC(64);
+	ASSERT_EQ(cerr_cache_diff(cp, out, 4), (size_t)1);
+	ASSERT_TRUE(out[0].ptr == b);
+	b = REALLOC(b, 4096);
+	ASSERT_EQ(cerr_cache_diff(cp, NULL, 0), (size_t)1);
+	FREE(b);
+}
+
+UTEST(cache_checkpoint, realloc_keeps_epoch) {
+	t_cerr_block out[4];
+	void *old = MALLOC(8);
+	t_cerr_checkpoint cp = cerr_cache_checkpoint();
+	void *a = MALLOC(8);
+	t_cerr_checkpoint later = cerr_cache_checkpoint();
+
+	// Moved or not, a block is as old as its first allocation
+	old = REALLOC(old, 4096);
+	a = REALLOC(a, 4096);
+	ASSERT_EQ(cerr_cache_diff(later, out, 4), (size_t)0);
+	ASSERT_EQ(cerr_cache_diff(cp, out, 4), (size_t)1);
+	ASSERT_TRUE(out[0].ptr == a);
+	ASSERT_EQ(out[0].size, (size_t)4096);
+	FREE(a);
+	FREE(old);
+}
+
+UTEST(cache_checkpoint, churn_compacts) {
+	static void *ptrs[8];
+	t_cerr_checkpoint cp = cerr_cache_checkpoint();
+
+	// Far more records than the journal holds, only the live ones stay
+	for (int i = 0; i < 16 * CERR_CACHE_SIZE; ++i) {
+		FREE(ptrs[i % 8]);
+		ptrs[i % 8] = MALLOC(i % 100 + 1);
+	}
+	ASSERT_LE(g__cerr_cache.young_cap, (uint32_t)2 * CERR_CACHE_SIZE);
+	ASSERT_EQ(cerr_cache_diff(cp, NULL, 0), (size_t)8);
+	LOG_INFO("Testing CERR_CACHE_DIFF_REPORT (expect 1 site, 8 blocks):");
+	CERR_CACHE_DIFF_REPORT(cp);
+	for (int i = 0; i < 8; ++i)
+		FREE(ptrs[i]);
+	ASSERT_EQ(cerr_cache_diff(cp, NULL, 0), (size_t)0);
+}
+
+// ═════════════════════════════════[ BYTES TESTS ]══════════════════════════════
+
+UTEST(cache_mem, live_and_peak) {
+	t_cerr_mem before;
+	t_cerr_mem m;
+	void *a;
+	void *b;
+
+	cerr_cache_mem(&before);
+	a = MALLOC(100);
+	b = CALLOC(8, 64);
+	a = REALLOC(a, 1000);
+	cerr_cache_mem(&m);
+	ASSERT_EQ(m.live, before.live + 1512);
+	ASSERT_EQ(m.blocks, before.blocks + 2);
+	ASSERT_GE(m.peak, before.live + 1512);
+	ASSERT_EQ(m.sizes[7], before.sizes[7] + 1);
+	ASSERT_EQ(m.sizes[10], before.sizes[10] + 2);
+	FREE(a);
+	FREE(b);
+	cerr_cache_mem(&m);
+	ASSERT_EQ(m.live, before.live);
+	ASSERT_GE(m.peak, before.live + 1512);
+	ASSERT_EQ(m.sizes[0], before.sizes[0]);
+}
+
+UTEST(cache_mem, budget) {
+	t_cerr_mem m;
+	void *a = NULL;
+	volatile int caught = 0;
+
+	cerr_cache_mem(&m);
+	cerr_cache_budget(m.live + 4096);
+	TRY {
+		a = MALLOC(3000);
+		a = REALLOC(a, 4000);
+		MALLOC(200);
+	} CATCH(CERR_E_NOMEM) {
+		caught = 1;
+		ASSERT_TRUE(strstr(CERR_WHY(), "200 bytes") != NULL);
+	}
+	ASSERT_EQ(caught, 1);
+	TRY {
+		CALLOC(2, 4000);
+	} CATCH(CERR_E_NOMEM) {
+		caught = 2;
+	}
+	ASSERT_EQ(caught, 2);
+	// The product wraps to 16 bytes, it is still over the budget
+	TRY {
+		volatile size_t huge = SIZE_MAX / 16 + 2;
+
+		CALLOC(huge, 16);
+	} CATCH(CERR_E_NOMEM) {
+		caught = 3;
+	}
+	ASSERT_EQ(caught, 3);
+	cerr_cache_budget(0);
+	FREE(a);
+	FREE(MALLOC(8192));
+}
+
 // ═══════════════════════════════[ DESTRUCTOR TEST ]════════════════════════════
 
 UTEST(cache_clear, clears_all) {
@@ -276,3 +602,16 @@ UTEST(cache_clear, clears_all) {
 	__CERR_CACHE_CLEAR();
 	ASSERT_EQ(g__cerr_cache.len, 0);
 }
+
+UTEST(cache_clear, while_migrating) {
+	// Leaks spread over the live and the migrating table, all freed
+	__CERR_CACHE_CLEAR();
+	for (int i = 0; i < CERR_CACHE_SIZE / 2 + 8; ++i)
+		MALLOC(8);
+	ASSERT_TRUE(g__cerr_cache.old != NULL);
+	ASSERT_EQ(__cerr_cache_live(), (uint32_t)CERR_CACHE_SIZE / 2 + 8);
+	LOG_INFO("Testing __CERR_CACHE_CLEAR (expect leak warning):");
+	__CERR_CACHE_CLEAR();
+	ASSERT_EQ(g__cerr_cache.len, 0);
+	ASSERT_EQ(__cerr_cache_live(), 0u);
+}
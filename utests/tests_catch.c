@@ -1,4 +1,7 @@
 #include "tests.h"
+#include <string.h>
+#include <sys/mman.h>
+#include <unistd.h>
 
 static inline void throw(void) {
 	THROW_MSG(ERROR, GOOD_CATCH_MSG);
@@ -110,3 +113,172 @@ UTEST(catch, throw_if) {
 	}
 	END_BAD_TEST(BAD_CATCH_END_MSG);
 }
+
+static inline void throw_stack_string(void) {
+	char buf[32];
+	snprintf(buf, sizeof(buf), "stack-%d", 42);
+	THROW_MSG(ERROR, "%s", buf);
+}
+
+UTEST(catch, message_format) {
+	char expected[CERR_MSG_SIZE];
+	TRY {
+		THROW_MSG(ERROR, "%d %u %5.2f %c %s %lld %zu %x %% %*d|%-4s|", -3,
+			3u, 3.14159, 'z', "str", -9000000000LL, (size_t)7, 255u, 4, 12, "ab");
+		END_BAD_TEST(BAD_TRY_MSG);
+	} CATCH(ERROR) {
+		snprintf(expected, sizeof(expected), "%d %u %5.2f %c %s %lld %zu %x %% "
+			"%*d|%-4s|", -3, 3u, 3.14159, 'z', "str", -9000000000LL, (size_t)7,
+			255u, 4, 12, "ab");
+		const char *why = strstr(CERR_WHY(), __FILE__ ": ");
+		ASSERT_TRUE(why != NULL);
+		ASSERT_STREQ(why + strlen(__FILE__ ": "), expected);
+		END_GOOD_TEST(CERR_WHY());
+	}
+	END_BAD_TEST(BAD_CATCH_END_MSG);
+}
+
+UTEST(catch, message_small_ints) {
+	signed char sc = -5;
+	short sh = -300;
+	TRY {
+		THROW_MSG(ERROR, "%d %d %hhu", sc, sh, sc);
+		END_BAD_TEST(BAD_TRY_MSG);
+	} CATCH(ERROR) {
+		ASSERT_TRUE(strstr(CERR_WHY(), ": -5 -300 251") != NULL);
+		END_GOOD_TEST(CERR_WHY());
+	}
+	END_BAD_TEST(BAD_CATCH_END_MSG);
+}
+
+UTEST(catch, message_stack_string) {
+	TRY {
+		throw_stack_string();
+		END_BAD_TEST(BAD_TRY_MSG);
+	} CATCH(ERROR) {
+		char clobber[64];
+		memset(clobber, 'x', sizeof(clobber));
+		__asm__ volatile("" : : "r"(clobber) : "memory");
+		ASSERT_TRUE(strstr(CERR_WHY(), ": stack-42") != NULL);
+		END_GOOD_TEST(CERR_WHY());
+	}
+	END_BAD_TEST(BAD_CATCH_END_MSG);
+}
+
+UTEST(catch, message_empty) {
+	TRY {
+		THROW(ERROR);
+		END_BAD_TEST(BAD_TRY_MSG);
+	} CATCH(ERROR) {
+		char expected[64];
+		snprintf(expected, sizeof(expected), "line %d in %s: ", __LINE__ - 4,
+			__FILE__);
+		ASSERT_STREQ(CERR_WHY(), expected);
+		END_GOOD_TEST(CERR_WHY());
+	}
+	END_BAD_TEST(BAD_CATCH_END_MSG);
+}
+
+// A string is only read up to its precision, a %p one is not read at all
+UTEST(catch, message_string_precision) {
+	long page = sysconf(_SC_PAGESIZE);
+	char *map = mmap(NULL, 2 * page, PROT_READ | PROT_WRITE,
+		MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+	char *tok = map + page - 4;
+	char expected[64];
+
+	ASSERT_TRUE(map != MAP_FAILED);
+	ASSERT_EQ(mprotect(map + page, page, PROT_NONE), 0);
+	memcpy(tok, "abcd", 4);
+	TRY {
+		THROW_MSG(ERROR, "'%.*s' '%.2s' %p", 4, tok, tok, map + page);
+	} CATCH(ERROR) {
+		snprintf(expected, sizeof(expected), ": 'abcd' 'ab' %p", map + page);
+		ASSERT_TRUE(strstr(CERR_WHY(), expected) != NULL);
+	}
+	munmap(map, 2 * page);
+}
+
+// ═════════════════════════════[ CATEGORY TESTS ]═══════════════════════════════
+
+# define IO_ERROR	CERR_CATEGORY(CERR_E_ALL, 1, 8)
+# define NET_ERROR	CERR_CATEGORY(IO_ERROR, 1, 4)
+# define IO_EOF		CERR_CODE(IO_ERROR, 1)
+# define NET_RESET	CERR_CODE(NET_ERROR, 3)
+# define LOW_ERROR	CERR_CATEGORY(CERR_E_ALL, 1, 3)
+
+static int catch_code(CERR_TYPE code) {
+	TRY {
+		THROW(code);
+	} CATCH(NET_ERROR) {
+		return 1;
+	} CATCH(IO_ERROR) {
+		return 2;
+	} CATCH(ERROR, 5, LOW_ERROR, 63) {
+		return 3;
+	} CATCH(64, 200, CERR_CODE(CERR_E_ALL, 1 << 20)) {
+		return 4;
+	} CATCH(CERR_E_ALL) {
+		return 5;
+	}
+	return 0;
+}
+
+UTEST(category, layout) {
+	ASSERT_EQ(IO_EOF, 0x101u);
+	ASSERT_EQ(NET_RESET, 0x113u);
+	ASSERT_TRUE(CERR_IS(NET_RESET, NET_ERROR));
+	ASSERT_TRUE(CERR_IS(NET_RESET, IO_ERROR));
+	ASSERT_TRUE(CERR_IS(NET_RESET, CERR_E_ALL));
+	ASSERT_TRUE(CERR_IS(NET_RESET, NET_RESET));
+	ASSERT_FALSE(CERR_IS(IO_EOF, NET_ERROR));
+	ASSERT_FALSE(CERR_IS(0x200, IO_ERROR));
+	ASSERT_FALSE(CERR_IS(0xff, IO_ERROR));
+}
+
+// The codes of libcerr stay out of the way of the small ones of a program
+UTEST(category, reserved) {
+	ASSERT_EQ(CERR_E_NOMEM, 0x3ff0001u);
+	ASSERT_TRUE(CERR_IS(CERR_E_NOMEM, CERR_E_LIBCERR));
+	ASSERT_TRUE(CERR_IS(CERR_E_NOMEM, CERR_E_ALL));
+	ASSERT_FALSE(CERR_IS(2, CERR_E_LIBCERR));
+	ASSERT_FALSE(CERR_IS(0x3feffff, CERR_E_LIBCERR));
+	ASSERT_EQ(catch_code(CERR_E_NOMEM), 5);
+}
+
+UTEST(category, hierarchy) {
+	ASSERT_EQ(catch_code(NET_RESET), 1);
+	ASSERT_EQ(catch_code(CERR_CODE(NET_ERROR, 0)), 1);
+	ASSERT_EQ(catch_code(IO_EOF), 2);
+	ASSERT_EQ(catch_code(CERR_CODE(IO_ERROR, 0xff)), 2);
+	ASSERT_EQ(catch_code(0x120), 2);
+	ASSERT_EQ(catch_code(0x200), 5);
+}
+
+UTEST(category, lists) {
+	ASSERT_EQ(catch_code(ERROR), 3);
+	ASSERT_EQ(catch_code(5), 3);
+	ASSERT_EQ(catch_code(8), 3);
+	ASSERT_EQ(catch_code(15), 3);
+	ASSERT_EQ(catch_code(63), 3);
+	ASSERT_EQ(catch_code(64), 4);
+	ASSERT_EQ(catch_code(200), 4);
+	ASSERT_EQ(catch_code(1 << 20), 4);
+	ASSERT_EQ(catch_code(2), 5);
+	ASSERT_EQ(catch_code(16), 5);
+	ASSERT_EQ(catch_code(62), 5);
+	ASSERT_EQ(catch_code(65), 5);
+}
+
+UTEST(category, outside_root) {
+	volatile int caught = 0;
+
+	TRY {
+		THROW(1 << 26);
+	} CATCH(CERR_E_ALL) {
+		caught = 1;
+	} CATCH(1 << 26) {
+		caught = 2;
+	}
+	ASSERT_EQ(caught, 2);
+}
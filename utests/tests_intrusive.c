@@ -0,0 +1,188 @@
+# define _GNU_SOURCE
+# define CERR_IMPLEMENTATION
+# define CERR_CACHE_INTRUSIVE
+#include "tests.h"
+#include <pthread.h>
+#include <string.h>
+
+# define N	2000
+
+// Hides where a pointer comes from, FREE of a stack buffer is the point
+__attribute__((noipa))
+static void *opaque(void *ptr) {
+	return ptr;
+}
+
+static int is_live(void *ptr) {
+	for (t_cerr_hdr *hdr = __CERR_CACHE_SELF()->live; hdr; hdr = hdr->lnext)
+		if (hdr + 1 == ptr)
+			return 1;
+	return 0;
+}
+
+// ═══════════════════════════════[ HEADER TESTS ]═══════════════════════════════
+
+UTEST(intrusive, header) {
+	t_cerr_cache *self = __CERR_CACHE_SELF();
+	uint32_t before = self->len;
+	char *ptr = MALLOC(40);
+	t_cerr_hdr *hdr = (t_cerr_hdr *)ptr - 1;
+	
+	ASSERT_EQ((uintptr_t)ptr % 16, 0);
+	ASSERT_TRUE(hdr->owner == self);
+	ASSERT_EQ(__CERR_META_SIZE(hdr->meta), 40u);
+	ASSERT_NE(__CERR_META_SITE(hdr->meta), 0u);
+	ASSERT_TRUE(__cerr_shard_owns(ptr));
+	ASSERT_TRUE(self->live == hdr);
+	ASSERT_EQ(self->len, before + 1);
+	FREE(ptr);
+	ASSERT_EQ(self->len, before);
+}
+
+UTEST(intrusive, unlink_order) {
+	void *a = MALLOC(16);
+	void *b = CALLOC(4, 8);
+	void *c = MALLOC(16);
+	
+	FREE(b);
+	ASSERT_TRUE(is_live(a) && !is_live(b) && is_live(c));
+	FREE(a);
+	ASSERT_TRUE(!is_live(a) && is_live(c));
+	FREE(c);
+	ASSERT_FALSE(is_live(c));
+}
+
+UTEST(intrusive, realloc) {
+	t_cerr_cache *self = __CERR_CACHE_SELF();
+	uint32_t before = self->len;
+	char *ptr = REALLOC(NULL, 8);
+	
+	strcpy(ptr, "grow");
+	for (int i = 0; i < 6; ++i) {
+		ptr = REALLOC(ptr, 16 << i);
+		ASSERT_STREQ(ptr, "grow");
+		ASSERT_TRUE(is_live(ptr));
+		ASSERT_EQ(self->len, before + 1);
+	}
+	FREE(ptr);
+	ASSERT_EQ(self->len, before);
+}
+
+UTEST(intrusive, untracked) {
+	t_cerr_cache *self = __CERR_CACHE_SELF();
+	uint32_t before = self->len;
+	char buf[sizeof(t_cerr_hdr) + 16] __attribute__((aligned(16))) = {0};
+	char *heap = malloc(64);
+	char *page = mmap(NULL, 2 * 4096, PROT_READ | PROT_WRITE,
+		MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+	
+	// The tag check rejects a block that was never tracked, a header that
+	// would start on the previous page is not even read
+	ASSERT_TRUE(heap != NULL && page != MAP_FAILED);
+	munmap(page, 4096);
+	LOG_INFO("Expected warnings about untracked pointers:");
+	FREE(opaque(buf + sizeof(t_cerr_hdr)));
+	FREE(opaque(heap));
+	FREE(opaque(page + 4096));
+	ASSERT_EQ(self->len, before);
+	free(heap);
+	munmap(page + 4096, 4096);
+}
+
+UTEST(intrusive, checkpoint) {
+	t_cerr_block out[4];
+	void *old = MALLOC(8);
+	t_cerr_checkpoint cp = cerr_cache_checkpoint();
+	void *a = MALLOC(24);
+	void *b = MALLOC(32);
+	void *c = MALLOC(40);
+
+	// Newest first, the walk ends at the block from before the checkpoint
+	FREE(b);
+	ASSERT_EQ(cerr_cache_diff(cp, out, 4), (size_t)2);
+	ASSERT_TRUE(out[0].ptr == c && out[1].ptr == a);
+	ASSERT_EQ(out[0].size, (size_t)40);
+	ASSERT_STREQ(out[1].file, __FILE__);
+	FREE(a);
+	FREE(c);
+	FREE(old);
+	ASSERT_EQ(cerr_cache_diff(cp, out, 4), (size_t)0);
+}
+
+UTEST(intrusive, realloc_keeps_place) {
+	t_cerr_block out[4];
+	void *old = MALLOC(8);
+	t_cerr_checkpoint cp = cerr_cache_checkpoint();
+	void *a = MALLOC(8);
+	void *b = MALLOC(8);
+
+	// The list stays newest first, the walk still ends at the old block
+	a = REALLOC(a, 4096);
+	old = REALLOC(old, 4096);
+	ASSERT_EQ(cerr_cache_diff(cp, out, 4), (size_t)2);
+	ASSERT_TRUE(out[0].ptr == b && out[1].ptr == a);
+	ASSERT_EQ(out[1].size, (size_t)4096);
+	FREE(a);
+	FREE(b);
+	FREE(old);
+}
+
+UTEST(intrusive, bytes) {
+	t_cerr_mem before;
+	t_cerr_mem m;
+	void *a;
+
+	cerr_cache_mem(&before);
+	a = MALLOC(300);
+	a = REALLOC(a, 30);
+	cerr_cache_mem(&m);
+	ASSERT_EQ(m.live, before.live + 30);
+	ASSERT_EQ(m.sizes[9], before.sizes[9] + 1);
+	ASSERT_EQ(m.sizes[5], before.sizes[5] + 1);
+	FREE(a);
+	cerr_cache_mem(&m);
+	ASSERT_EQ(m.live, before.live);
+}
+
+// ═══════════════════════════════[ REMOTE TESTS ]═══════════════════════════════
+
+static void *remote_free(void *arg) {
+	void **ptrs = arg;
+	
+	for (int i = 0; i < N; ++i)
+		FREE(ptrs[i]);
+	return (void *)(uintptr_t)__CERR_CACHE_SELF()->len;
+}
+
+UTEST(intrusive, remote_free) {
+	static void *ptrs[N];
+	t_cerr_cache *self = __CERR_CACHE_SELF();
+	uint32_t before = self->len;
+	pthread_t thread;
+	void *len;
+	
+	for (int i = 0; i < N; ++i)
+		ptrs[i] = MALLOC(8 + i % 64);
+	pthread_create(&thread, NULL, remote_free, ptrs);
+	pthread_join(thread, &len);
+	ASSERT_EQ((uintptr_t)len, 0);
+	
+	// The blocks wait in our remote list until this thread uses its shard
+	FREE(MALLOC(1));
+	ASSERT_EQ(self->len, before);
+}
+
+// ═══════════════════════════════[ DESTRUCTOR TEST ]════════════════════════════
+
+UTEST(intrusive, clear) {
+	void *a = MALLOC(16);
+	void *b = CALLOC(4, 8);
+	(void)a; (void)b;
+	
+	LOG_INFO("Testing __CERR_CACHE_CLEAR (expect leak warning):");
+	__CERR_CACHE_CLEAR();
+	ASSERT_EQ(__CERR_CACHE_SELF()->len, 0);
+	ASSERT_TRUE(__CERR_CACHE_SELF()->live == NULL);
+}
+
+UTEST_MAIN();
@@ -0,0 +1,159 @@
+# define _GNU_SOURCE
+# include <stdio.h>
+# include <unistd.h>
+
+static FILE *g_log = NULL;
+static char *g_text = NULL;
+static size_t g_size = 0;
+
+# define LOG_MODULE	"tests_log"
+# define LOG_FDOUT	g_log
+#include "tests.h"
+
+__attribute__((constructor))
+static void log_open(void) {
+	g_log = open_memstream(&g_text, &g_size);
+}
+
+// Everything logged by this file so far
+static const char *log_text(void) {
+	fflush(g_log);
+	return g_text;
+}
+
+// ═══════════════════════════════[ LEVEL TESTS ]════════════════════════════════
+
+UTEST(log_level, filtered_at_runtime) {
+	ASSERT_EQ(LOG_GET_LEVEL("tests_log"), LOG_LEVEL);
+	ASSERT_EQ(LOG_SET_LEVEL("tests_log", 2), 1);
+	LOG_INFO("hidden info;");
+	LOG_DEBUG("hidden debug;");
+	LOG_WARN("shown warn;");
+	LOG_ERR("shown err;");
+	ASSERT_TRUE(strstr(log_text(), "hidden") == NULL);
+	ASSERT_TRUE(strstr(log_text(), "shown warn;") != NULL);
+	ASSERT_TRUE(strstr(log_text(), "shown err;") != NULL);
+	LOG_SET_LEVEL("tests_log", 4);
+	LOG_DEBUG("shown debug;");
+	ASSERT_TRUE(strstr(log_text(), "shown debug;") != NULL);
+}
+
+UTEST(log_level, per_module) {
+	int other = LOG_GET_LEVEL("default");
+
+	ASSERT_GE(other, 0);
+	LOG_SET_LEVEL("tests_log", 0);
+	ASSERT_EQ(LOG_GET_LEVEL("default"), other);
+	LOG_ERR("silenced;");
+	ASSERT_TRUE(strstr(log_text(), "silenced;") == NULL);
+	LOG_SET_LEVEL("tests_log", LOG_LEVEL);
+}
+
+UTEST(log_level, every_module) {
+	int other = LOG_GET_LEVEL("default");
+
+	ASSERT_GE(LOG_SET_LEVEL(NULL, 1), 2);
+	ASSERT_EQ(LOG_GET_LEVEL("tests_log"), 1);
+	ASSERT_EQ(LOG_GET_LEVEL("default"), 1);
+	LOG_SET_LEVEL(NULL, other);
+	LOG_SET_LEVEL("tests_log", LOG_LEVEL);
+}
+
+UTEST(log_level, unknown_and_clamped) {
+	ASSERT_EQ(LOG_GET_LEVEL("nope"), -1);
+	ASSERT_EQ(LOG_SET_LEVEL("nope", 1), 0);
+	LOG_SET_LEVEL("tests_log", 99);
+	ASSERT_EQ(LOG_GET_LEVEL("tests_log"), __LOG_LEVELS);
+	LOG_SET_LEVEL("tests_log", -3);
+	ASSERT_EQ(LOG_GET_LEVEL("tests_log"), 0);
+	LOG_SET_LEVEL("tests_log", LOG_LEVEL);
+}
+
+UTEST(log_level, rules) {
+	ASSERT_EQ(__cerr_log_rules(NULL, "net", 3), 3);
+	ASSERT_EQ(__cerr_log_rules("", "net", 3), 3);
+	ASSERT_EQ(__cerr_log_rules("2", "net", 3), 2);
+	ASSERT_EQ(__cerr_log_rules("1,net=4", "net", 3), 4);
+	ASSERT_EQ(__cerr_log_rules("net=4,1", "net", 3), 1);
+	ASSERT_EQ(__cerr_log_rules("1,network=4,ne=4", "net", 3), 1);
+	ASSERT_EQ(__cerr_log_rules("net=x,net", "net", 3), 3);
+	ASSERT_EQ(__cerr_log_rules("net=9", "net", 3), __LOG_LEVELS);
+}
+
+static int count(const char *str, const char *needle) {
+	int n = 0;
+
+	for (; (str = strstr(str, needle)); str += strlen(needle))
+		++n;
+	return n;
+}
+
+UTEST(log_level, plain_when_not_a_tty) {
+	LOG_INFO("plain %d;", 1);
+	ASSERT_TRUE(strstr(log_text(), "\n    info:  > plain 1;\n") != NULL);
+	ASSERT_TRUE(strchr(log_text(), '\033') == NULL);
+}
+
+// ══════════════════════════════[ SAMPLING TESTS ]══════════════════════════════
+
+UTEST(log_sampled, every_n) {
+	int evals = 0;
+
+	for (int i = 0; i < 10; ++i)
+		LOG_INFO_EVERY_N(3, "every %d %d;", i, ++evals);
+	ASSERT_EQ(evals, 4);
+	ASSERT_EQ(count(log_text(), "every "), 4);
+	ASSERT_EQ(count(log_text(), "every 0 1;\n"), 1);
+	ASSERT_EQ(count(log_text(), "every 3 2; (2 suppressed)\n"), 1);
+	ASSERT_EQ(count(log_text(), "every 9 4; (2 suppressed)\n"), 1);
+}
+
+UTEST(log_sampled, once) {
+	for (int i = 0; i < 5; ++i)
+		LOG_WARN_ONCE("once %d;", i);
+	ASSERT_EQ(count(log_text(), "once "), 1);
+	ASSERT_EQ(count(log_text(), "once 0;"), 1);
+}
+
+UTEST(log_sampled, ratelimit) {
+	int evals = 0;
+
+	for (int round = 0; round < 2; ++round) {
+		for (int i = 0; i < 100; ++i)
+			LOG_ERR_RATELIMIT(5, "limited %d;", ++evals);
+		// Past one step of 200 ms, one more line may pass
+		usleep(250000);
+	}
+	ASSERT_EQ(evals, 6);
+	ASSERT_EQ(count(log_text(), "limited "), 6);
+	ASSERT_EQ(count(log_text(), "limited 6; (95 suppressed)"), 1);
+}
+
+// Once closed for a while, a site is suppressed on the counter alone where
+// it is the cheaper read
+UTEST(log_sampled, ratelimit_closed) {
+	t_cerr_limit	lim = {0};
+	int				tsc;
+
+	ASSERT_TRUE(__cerr_log_ratelimit(&lim, 1));
+	tsc = g__cerr_limit_tsc;
+	ASSERT_GE(tsc, 0);
+# if defined(__x86_64__) || defined(__i386__)
+	g__cerr_limit_tsc = 1;
+	ASSERT_FALSE(__cerr_log_ratelimit(&lim, 1));
+	ASSERT_GT(lim.until, __builtin_ia32_rdtsc());
+# endif
+	ASSERT_FALSE(__cerr_log_ratelimit(&lim, 1));
+	g__cerr_limit_tsc = tsc;
+	ASSERT_FALSE(__cerr_log_ratelimit(&lim, 1));
+	ASSERT_GE(lim.suppressed, 2u);
+}
+
+UTEST(log_sampled, below_level_keeps_state) {
+	LOG_SET_LEVEL("tests_log", 1);
+	for (int i = 0; i < 2; ++i) {
+		LOG_INFO_ONCE("hidden once %d;", i);
+		LOG_SET_LEVEL("tests_log", LOG_LEVEL);
+	}
+	ASSERT_EQ(count(log_text(), "hidden once 1;"), 1);
+}
@@ -1,4 +1,6 @@
+# define _GNU_SOURCE
 # define CERR_IMPLEMENTATION
+# define CERR_PARALLEL_THREADS 4
 #include "tests.h"
 #include <time.h>
 
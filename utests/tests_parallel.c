@@ -0,0 +1,87 @@
+#include "tests.h"
+#include <pthread.h>
+
+# define TASKS		1000
+# define BAD_TASK	12
+
+typedef struct s_job {
+	size_t	done;
+	size_t	bad;
+}	t_job;
+
+static void count_task(size_t i, void *arg) {
+	t_job *job = arg;
+
+	if (i % job->bad == job->bad - 1)
+		THROW_MSG(BAD_TASK, "task %zu failed", i);
+	__atomic_fetch_add(&job->done, 1, __ATOMIC_RELAXED);
+}
+
+static void *store_worker(void *arg) {
+	TRY {
+		THROW_MSG(BAD_TASK, "from worker %d", 7);
+	} CATCH_ALL() {
+		CERR_STORE((t_cerr_exception *)arg);
+	}
+	return NULL;
+}
+
+UTEST(parallel, store_rethrow) {
+	static t_cerr_exception e;
+	pthread_t t;
+	volatile int caught = 0;
+
+	pthread_create(&t, NULL, store_worker, &e);
+	pthread_join(t, NULL);
+	ASSERT_EQ(e.code, (CERR_TYPE)BAD_TASK);
+	ASSERT_TRUE(strstr(CERR_EXCEPTION_WHY(&e), "from worker 7") != NULL);
+	TRY {
+		RETHROW(&e);
+	} CATCH(BAD_TASK) {
+		caught = 1;
+		ASSERT_TRUE(strstr(CERR_WHY(), "from worker 7") != NULL);
+		ASSERT_TRUE(strstr(CERR_WHY(), "tests_parallel.c") != NULL);
+	}
+	ASSERT_EQ(caught, 1);
+	e.code = CERR_E_NONE;
+	TRY {
+		RETHROW(&e);
+		caught = 2;
+	}
+	ASSERT_EQ(caught, 2);
+}
+
+UTEST(parallel, every_index) {
+	t_job job = {.done = 0, .bad = TASKS + 1};
+
+	PARALLEL_FOR(TASKS, count_task, &job);
+	ASSERT_EQ(job.done, (size_t)TASKS);
+}
+
+UTEST(parallel, first_rethrown) {
+	t_job job = {.done = 0, .bad = 10};
+	volatile int caught = 0;
+
+	TRY {
+		PARALLEL_FOR(TASKS, count_task, &job);
+	} CATCH(BAD_TASK) {
+		caught = 1;
+		ASSERT_TRUE(strstr(CERR_WHY(), "failed") != NULL);
+	}
+	ASSERT_EQ(caught, 1);
+	ASSERT_LT(job.done, (size_t)TASKS - TASKS / 10);
+}
+
+UTEST(parallel, all_kept) {
+	t_cerr_exception errs[8];
+	t_job job = {.done = 0, .bad = 10};
+	size_t failed = cerr_parallel_for(TASKS, count_task, &job, errs, 8);
+
+	ASSERT_EQ(failed, (size_t)TASKS / 10);
+	ASSERT_EQ(job.done, (size_t)TASKS - TASKS / 10);
+	for (int i = 0; i < 8; ++i) {
+		ASSERT_EQ(errs[i].code, (CERR_TYPE)BAD_TASK);
+		ASSERT_TRUE(strstr(CERR_EXCEPTION_WHY(&errs[i]), "failed") != NULL);
+	}
+	ASSERT_EQ(cerr_parallel_for(0, count_task, &job, NULL, 0), (size_t)0);
+}
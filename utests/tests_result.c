@@ -0,0 +1,99 @@
+#include "tests.h"
+
+# define PARSE_ERROR	12
+
+typedef CERR_RESULT(int) t_int_result;
+typedef CERR_RESULT(const char *) t_str_result;
+
+static t_int_result parse_digit(char c) {
+	if (c < '0' || c > '9')
+		return CERR_FAIL(t_int_result, PARSE_ERROR, "not a digit: %c", c);
+	return CERR_OK(t_int_result, c - '0');
+}
+
+// Sum of the digits of s, the first bad one is passed up
+static t_int_result parse_sum(const char *s) {
+	int sum = 0;
+
+	for (; *s; ++s)
+		sum += PROPAGATE(t_int_result, parse_digit(*s));
+	return CERR_OK(t_int_result, sum);
+}
+
+static t_str_result parse_name(const char *s) {
+	int n = PROPAGATE(t_str_result, parse_sum(s));
+
+	return CERR_OK(t_str_result, n > 5 ? "big" : "small");
+}
+
+static int throwing_sum(const char *s) {
+	THROW_IF_MSG(*s == '\0', PARSE_ERROR, "empty input");
+	return TRY_EXPR(parse_sum(s));
+}
+
+UTEST(result, ok) {
+	t_int_result r = parse_sum("1234");
+
+	ASSERT_EQ(r.err, (CERR_TYPE)CERR_E_NONE);
+	ASSERT_EQ(r.val, 10);
+	ASSERT_STREQ(CERR_RESULT_WHY(r), "");
+}
+
+UTEST(result, propagate) {
+	t_str_result r = parse_name("12x4");
+
+	ASSERT_EQ(r.err, (CERR_TYPE)PARSE_ERROR);
+	ASSERT_TRUE(strstr(CERR_RESULT_WHY(r), "not a digit: x") != NULL);
+	ASSERT_STREQ(parse_name("99").val, "big");
+}
+
+UTEST(result, to_exception) {
+	volatile int caught = 0;
+
+	TRY {
+		throwing_sum("1y");
+	} CATCH(PARSE_ERROR) {
+		caught = 1;
+		ASSERT_TRUE(strstr(CERR_WHY(), "not a digit: y") != NULL);
+	}
+	ASSERT_EQ(caught, 1);
+	TRY {
+		ASSERT_EQ(throwing_sum("55"), 10);
+	} CATCH_ALL() {
+		caught = 2;
+	}
+	ASSERT_EQ(caught, 1);
+}
+
+UTEST(result, from_exception) {
+	t_int_result r = CERR_CAPTURE(t_int_result, throwing_sum(""));
+
+	ASSERT_EQ(r.err, (CERR_TYPE)PARSE_ERROR);
+	ASSERT_TRUE(strstr(CERR_RESULT_WHY(r), "empty input") != NULL);
+	r = CERR_CAPTURE(t_int_result, throwing_sum("7"));
+	ASSERT_EQ(r.err, (CERR_TYPE)CERR_E_NONE);
+	ASSERT_EQ(r.val, 7);
+}
+
+// Throws caught between a failure and its reason leave the reason alone, and a
+// failure in a CATCH body leaves the caught reason alone
+UTEST(result, separate_reasons) {
+	volatile int caught = 0;
+	t_int_result r = parse_sum("3z");
+
+	TRY {
+		THROW_MSG(PARSE_ERROR, "thrown in between");
+	} CATCH(PARSE_ERROR) {
+		t_int_result f = parse_digit('w');
+
+		ASSERT_TRUE(strstr(CERR_RESULT_WHY(f), "not a digit: w") != NULL);
+		ASSERT_TRUE(strstr(CERR_WHY(), "thrown in between") != NULL);
+		caught = 1;
+	}
+	ASSERT_EQ(caught, 1);
+	r = parse_sum("5q");
+	TRY {
+		THROW(PARSE_ERROR);
+	} CATCH_ALL() {}
+	ASSERT_TRUE(strstr(CERR_RESULT_WHY(r), "not a digit: q") != NULL);
+}
@@ -0,0 +1,465 @@
+# define _GNU_SOURCE
+# define CERR_IMPLEMENTATION
+# define CERR_CACHE_SHARDED
+#include "tests.h"
+#include <pthread.h>
+#include <string.h>
+
+# define THREADS	4
+# define N			2000
+
+static uint32_t shard_count(void) {
+	uint32_t count = 0;
+	
+	for (t_cerr_cache *c = g__cerr_shards; c; c = c->link)
+		++count;
+	return count;
+}
+
+// A malloc too large for the sanitizer returns NULL as it would without it
+const char *__asan_default_options(void) {
+	return "allocator_may_return_null=1";
+}
+
+// Hides where a pointer comes from, FREE of a stack buffer is the point
+__attribute__((noipa))
+static void *opaque(void *ptr) {
+	return ptr;
+}
+
+// Forces the calling thread to drain the frees other threads handed back
+static void shard_sync(void) {
+	FREE(MALLOC(1));
+}
+
+// ═══════════════════════════════[ LOCAL TESTS ]════════════════════════════════
+
+static void *local_churn(void UNUSED *arg) {
+	void *ptrs[N];
+	
+	for (int i = 0; i < N; ++i)
+		ptrs[i] = MALLOC(16 + i % 64);
+	for (int i = 0; i < N; ++i)
+		FREE(ptrs[i]);
+	return (void *)(uintptr_t)__CERR_CACHE_SELF()->len;
+}
+
+UTEST(shard, local_churn) {
+	pthread_t threads[THREADS];
+	void *len;
+	
+	for (int t = 0; t < THREADS; ++t)
+		pthread_create(&threads[t], NULL, local_churn, NULL);
+	for (int t = 0; t < THREADS; ++t) {
+		pthread_join(threads[t], &len);
+		ASSERT_EQ((uintptr_t)len, 0);
+	}
+}
+
+UTEST(shard, own_shard) {
+	t_cerr_cache *self = __CERR_CACHE_SELF();
+	uint32_t before = self->len;
+	char *ptr = MALLOC(32);
+	
+	ASSERT_TRUE(__CERR_CACHE_FIND(ptr) != NULL);
+	ASSERT_EQ(self->len, before + 1);
+	ptr = REALLOC(ptr, 4096);
+	ASSERT_TRUE(__CERR_CACHE_FIND(ptr) != NULL);
+	ASSERT_EQ(self->len, before + 1);
+	FREE(ptr);
+	ASSERT_EQ(self->len, before);
+}
+
+UTEST(shard, untracked) {
+	t_cerr_cache *self = __CERR_CACHE_SELF();
+	uint32_t before = self->len;
+	char buf[64] __attribute__((aligned(16)));
+	char *heap = malloc(64);
+	char *page = mmap(NULL, 2 * 4096, PROT_READ | PROT_WRITE,
+		MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+
+	// Nothing is written, nor read before the page of the pointer
+	ASSERT_TRUE(heap != NULL && page != MAP_FAILED);
+	munmap(page, 4096);
+	LOG_INFO("Expected warnings about untracked pointers:");
+	FREE(opaque(heap));
+	FREE(opaque(buf + 32));
+	FREE(opaque(page + 4096));
+	ASSERT_EQ(self->len, before);
+	free(heap);
+	munmap(page + 4096, 4096);
+}
+
+// A size leaving no room for the header fails like malloc, the block given
+// to realloc stays tracked and untouched
+UTEST(shard, size_overflow) {
+	t_cerr_cache *self = __CERR_CACHE_SELF();
+	uint32_t before = self->len;
+	char *ptr = MALLOC(8);
+
+	memcpy(ptr, "libcerr", 8);
+	errno = 0;
+	ASSERT_TRUE(__cerr_shard_malloc(SIZE_MAX - 8) == NULL);
+	ASSERT_EQ(errno, ENOMEM);
+	ASSERT_TRUE(__cerr_shard_calloc(SIZE_MAX) == NULL);
+	ASSERT_TRUE(__cerr_shard_realloc(ptr, SIZE_MAX - 8, 0) == NULL);
+	ASSERT_TRUE(__cerr_shard_owns(ptr));
+	ASSERT_STREQ(ptr, "libcerr");
+	ASSERT_EQ(self->len, before + 1);
+	FREE(ptr);
+	ASSERT_EQ(self->len, before);
+}
+
+UTEST(shard, header_page) {
+	static void *ptrs[N];
+	int moved = 1;
+
+	// Blocks whose header would start on the previous page are moved
+	for (int i = 0; i < N; ++i) {
+		ptrs[i] = MALLOC(16 * (i % 300));
+		moved &= !__CERR_HDR_CROSSES(ptrs[i]) && __cerr_shard_owns(ptrs[i]);
+	}
+	for (int i = 0; i < N; ++i)
+		FREE(ptrs[i]);
+	ASSERT_TRUE(moved);
+}
+
+// ═══════════════════════════════[ REMOTE TESTS ]═══════════════════════════════
+
+static void *remote_free(void *arg) {
+	void **ptrs = arg;
+	
+	for (int i = 0; i < N; ++i)
+		FREE(ptrs[i]);
+	return (void *)(uintptr_t)__CERR_CACHE_SELF()->len;
+}
+
+UTEST(shard, remote_free) {
+	static void *ptrs[THREADS][N];
+	pthread_t threads[THREADS];
+	t_cerr_cache *self = __CERR_CACHE_SELF();
+	uint32_t before = self->len;
+	
+	for (int t = 0; t < THREADS; ++t)
+		for (int i = 0; i < N; ++i)
+			ptrs[t][i] = MALLOC(24);
+	ASSERT_EQ(self->len, before + THREADS * N);
+	for (int t = 0; t < THREADS; ++t)
+		pthread_create(&threads[t], NULL, remote_free, ptrs[t]);
+	for (int t = 0; t < THREADS; ++t)
+		pthread_join(threads[t], NULL);
+	
+	// The blocks wait in our remote list until this thread uses its shard
+	shard_sync();
+	ASSERT_EQ(self->len, before);
+	ASSERT_TRUE(__CERR_CACHE_FIND(ptrs[0][0]) == NULL);
+}
+
+static void *orphan_alloc(void *arg) {
+	void **ptrs = arg;
+
+	for (int i = 0; i < N; ++i)
+		ptrs[i] = MALLOC(24);
+	return __CERR_CACHE_SELF();
+}
+
+UTEST(shard, orphan_free) {
+	static void *ptrs[N];
+	pthread_t thread;
+	t_cerr_cache *shard;
+
+	// The shard of an exited thread releases what is freed to it at once,
+	// without waiting for a thread to adopt it. This thread holds its own
+	// shard first, not to adopt that one.
+	shard_sync();
+	pthread_create(&thread, NULL, orphan_alloc, ptrs);
+	pthread_join(thread, (void **)&shard);
+	ASSERT_EQ(shard->len, (uint32_t)N);
+	for (int i = 0; i < N; ++i)
+		FREE(ptrs[i]);
+	ASSERT_EQ(shard->len, 0u);
+	ASSERT_TRUE(__atomic_load_n(&shard->remote, __ATOMIC_ACQUIRE) == NULL);
+	ASSERT_EQ(shard->state, (uint32_t)__CERR_S_FREE);
+}
+
+static void *remote_realloc(void *arg) {
+	char *ptr = REALLOC(arg, 256);
+	int ok = strcmp(ptr, "remote") == 0 && __CERR_CACHE_FIND(ptr) != NULL;
+	
+	FREE(ptr);
+	return (void *)(uintptr_t)ok;
+}
+
+UTEST(shard, remote_realloc) {
+	t_cerr_cache *self = __CERR_CACHE_SELF();
+	uint32_t before = self->len;
+	char *ptr = MALLOC(16);
+	pthread_t thread;
+	void *ok;
+	
+	strcpy(ptr, "remote");
+	pthread_create(&thread, NULL, remote_realloc, ptr);
+	pthread_join(thread, &ok);
+	shard_sync();
+	ASSERT_TRUE((uintptr_t)ok);
+	ASSERT_EQ(self->len, before);
+}
+
+// A copy that cannot be made fails like realloc, the original stays with
+// its owner
+static void *remote_realloc_fail(void *arg) {
+	return __cerr_shard_realloc(arg, SIZE_MAX / 2, 0);
+}
+
+UTEST(shard, remote_realloc_fail) {
+	t_cerr_cache *self = __CERR_CACHE_SELF();
+	uint32_t before = self->len;
+	char *ptr = MALLOC(16);
+	pthread_t thread;
+	void *res;
+
+	strcpy(ptr, "remote");
+	pthread_create(&thread, NULL, remote_realloc_fail, ptr);
+	pthread_join(thread, &res);
+	shard_sync();
+	ASSERT_TRUE(res == NULL);
+	ASSERT_TRUE(__cerr_shard_owns(ptr));
+	ASSERT_STREQ(ptr, "remote");
+	ASSERT_EQ(self->len, before + 1);
+	FREE(ptr);
+	ASSERT_EQ(self->len, before);
+}
+
+static void *young_alloc(void *arg) {
+	void **ptrs = arg;
+
+	for (int i = 0; i < N; ++i)
+		ptrs[i] = MALLOC(16);
+	return NULL;
+}
+
+UTEST(shard, checkpoint) {
+	static void *ptrs[THREADS][N];
+	pthread_t threads[THREADS];
+	t_cerr_checkpoint cp = cerr_cache_checkpoint();
+
+	// Every shard is read, remote frees included
+	for (int t = 0; t < THREADS; ++t)
+		pthread_create(&threads[t], NULL, young_alloc, ptrs[t]);
+	for (int t = 0; t < THREADS; ++t)
+		pthread_join(threads[t], NULL);
+	ASSERT_EQ(cerr_cache_diff(cp, NULL, 0), (size_t)THREADS * N);
+	for (int i = 0; i < N; i += 2)
+		FREE(ptrs[0][i]);
+	ASSERT_EQ(cerr_cache_diff(cp, NULL, 0), (size_t)THREADS * N - N / 2);
+	for (int t = 0; t < THREADS; ++t)
+		for (int i = t ? 0 : 1; i < N; i += t ? 1 : 2)
+			FREE(ptrs[t][i]);
+	ASSERT_EQ(cerr_cache_diff(cp, NULL, 0), (size_t)0);
+}
+
+static void *old_alloc(void *arg) {
+	*(void **)arg = MALLOC(8);
+	return NULL;
+}
+
+UTEST(shard, realloc_keeps_epoch) {
+	pthread_t thread;
+	void *ptr;
+	t_cerr_checkpoint cp;
+
+	// Copied into this thread's shard, still older than the checkpoint
+	pthread_create(&thread, NULL, old_alloc, &ptr);
+	pthread_join(thread, NULL);
+	cp = cerr_cache_checkpoint();
+	ptr = REALLOC(ptr, 4096);
+	ASSERT_EQ(cerr_cache_diff(cp, NULL, 0), (size_t)0);
+	ptr = REALLOC(ptr, 64);
+	ASSERT_EQ(cerr_cache_diff(cp, NULL, 0), (size_t)0);
+	FREE(ptr);
+}
+
+static void *budget_alloc(void UNUSED *arg) {
+	void *ptr = NULL;
+	int caught = 0;
+
+	TRY {
+		ptr = MALLOC(2 * CERR_CACHE_GRAIN);
+	} CATCH(CERR_E_NOMEM) {
+		caught = 1;
+	}
+	FREE(ptr);
+	return (void *)(uintptr_t)caught;
+}
+
+UTEST(shard, bytes_and_budget) {
+	static void *ptrs[THREADS][N];
+	pthread_t threads[THREADS];
+	t_cerr_mem before;
+	t_cerr_mem m;
+	void *caught;
+
+	// Shards publish their bytes once they allocated a grain
+	cerr_cache_mem(&before);
+	for (int t = 0; t < THREADS; ++t)
+		pthread_create(&threads[t], NULL, young_alloc, ptrs[t]);
+	for (int t = 0; t < THREADS; ++t)
+		pthread_join(threads[t], NULL);
+	cerr_cache_mem(&m);
+	ASSERT_EQ(m.live, before.live + THREADS * N * 16);
+	ASSERT_EQ(m.sizes[5], before.sizes[5] + THREADS * N);
+	ASSERT_GE(g__cerr_live + THREADS * CERR_CACHE_GRAIN, m.live);
+	ASSERT_GE(m.peak, m.live);
+	cerr_cache_budget(m.live + CERR_CACHE_GRAIN);
+	pthread_create(&threads[0], NULL, budget_alloc, NULL);
+	pthread_join(threads[0], &caught);
+	ASSERT_TRUE((uintptr_t)caught);
+	cerr_cache_budget(0);
+	pthread_create(&threads[0], NULL, budget_alloc, NULL);
+	pthread_join(threads[0], &caught);
+	ASSERT_FALSE((uintptr_t)caught);
+	for (int t = 0; t < THREADS; ++t)
+		for (int i = 0; i < N; ++i)
+			FREE(ptrs[t][i]);
+	// The shards of the exited threads released them right away
+	cerr_cache_mem(&m);
+	ASSERT_EQ(m.live, before.live);
+}
+
+// Threads race on the first call of a site, they must all get the same id
+static void *site_race(void UNUSED *arg) {
+	void *ptr = MALLOC(32);
+	uint64_t meta = ((t_cerr_hdr *)ptr - 1)->meta;
+
+	FREE(ptr);
+	return (void *)(uintptr_t)__CERR_META_SITE(meta);
+}
+
+UTEST(shard, site_race) {
+	pthread_t threads[THREADS];
+	void *site[THREADS];
+
+	for (int t = 0; t < THREADS; ++t)
+		pthread_create(&threads[t], NULL, site_race, NULL);
+	for (int t = 0; t < THREADS; ++t)
+		pthread_join(threads[t], &site[t]);
+	ASSERT_NE((uintptr_t)site[0], 0u);
+	for (int t = 1; t < THREADS; ++t)
+		ASSERT_EQ((uintptr_t)site[t], (uintptr_t)site[0]);
+	ASSERT_STREQ(g__cerr_sites[(uintptr_t)site[0]]->file, __FILE__);
+}
+
+// Every thread allocates a batch and frees the batch of its neighbour
+static void *cross_free(void *arg) {
+	static pthread_barrier_t barrier;
+	static void *ptrs[THREADS][N];
+	int t = (int)(uintptr_t)arg;
+	
+	if (!arg) {
+		pthread_barrier_init(&barrier, NULL, THREADS);
+		return NULL;
+	}
+	--t;
+	for (int i = 0; i < N; ++i)
+		ptrs[t][i] = MALLOC(8 + i % 32);
+	pthread_barrier_wait(&barrier);
+	for (int i = 0; i < N; ++i)
+		FREE(ptrs[(t + 1) % THREADS][i]);
+	pthread_barrier_wait(&barrier);
+	shard_sync();
+	pthread_barrier_wait(&barrier);
+	return (void *)(uintptr_t)__CERR_CACHE_SELF()->len;
+}
+
+UTEST(shard, cross_free) {
+	pthread_t threads[THREADS];
+	void *len;
+	
+	cross_free(NULL);
+	for (int t = 0; t < THREADS; ++t)
+		pthread_create(&threads[t], NULL, cross_free, (void *)(uintptr_t)(t + 1));
+	for (int t = 0; t < THREADS; ++t) {
+		pthread_join(threads[t], &len);
+		ASSERT_EQ((uintptr_t)len, 0);
+	}
+}
+
+// ═══════════════════════════════[ ADOPTION TESTS ]═════════════════════════════
+
+UTEST(shard, adoption) {
+	pthread_t thread;
+	
+	// Threads started one after the other reuse the shards left behind
+	pthread_create(&thread, NULL, local_churn, NULL);
+	pthread_join(thread, NULL);
+	uint32_t count = shard_count();
+	for (int i = 0; i < 8; ++i) {
+		pthread_create(&thread, NULL, local_churn, NULL);
+		pthread_join(thread, NULL);
+	}
+	ASSERT_EQ(shard_count(), count);
+}
+
+UTEST_MAIN();
+
+// ═══════════════════════════════[ LOAD TESTS ]═════════════════════════════════
+
+// Last, the shards it leaves behind have bytes still unpublished
+# define SLOTS	256
+
+static void *g_slots[SLOTS];
+static int g_churn;
+
+// Swaps blocks in and out of slots shared by every worker, so a block is as
+// often freed by its own thread as by another one
+static void *slot_churn(void *arg) {
+	uint32_t seed = (uint32_t)(uintptr_t)arg;
+	void *ptr;
+
+	while (__atomic_load_n(&g_churn, __ATOMIC_RELAXED)) {
+		seed = seed * 1103515245 + 12345;
+		ptr = __atomic_exchange_n(&g_slots[seed >> 8 & (SLOTS - 1)], NULL,
+			__ATOMIC_ACQ_REL);
+		if (seed & 0x10000)
+			ptr = REALLOC(ptr, 16 + (seed >> 20 & 255));
+		else {
+			FREE(ptr);
+			ptr = MALLOC(16 + (seed >> 20 & 255));
+		}
+		FREE(__atomic_exchange_n(&g_slots[seed >> 12 & (SLOTS - 1)], ptr,
+			__ATOMIC_ACQ_REL));
+	}
+	return NULL;
+}
+
+UTEST(shard, diff_while_allocating) {
+	pthread_t threads[THREADS];
+	t_cerr_checkpoint cp = cerr_cache_checkpoint();
+	size_t most = 0;
+	size_t live = 0;
+
+	// Diffs, reports and live counts hold one shard at a time while the
+	// workers go on, the counts apply the remote frees of the shard held
+	g_churn = 1;
+	for (int t = 0; t < THREADS; ++t)
+		pthread_create(&threads[t], NULL, slot_churn, (void *)(uintptr_t)t);
+	for (int i = 0; i < 2000; ++i) {
+		live = cerr_cache_diff(cp, NULL, 0);
+		most = live > most ? live : most;
+		__cerr_cache_live();
+	}
+	LOG_INFO("Testing CERR_CACHE_REPORT while threads allocate:");
+	CERR_CACHE_REPORT();
+	__atomic_store_n(&g_churn, 0, __ATOMIC_RELAXED);
+	for (int t = 0; t < THREADS; ++t)
+		pthread_join(threads[t], NULL);
+	// A block moving to another shard meanwhile may be seen in both
+	ASSERT_LE(most, (size_t)shard_count() * (SLOTS + THREADS));
+	live = 0;
+	for (int i = 0; i < SLOTS; ++i)
+		live += g_slots[i] != NULL;
+	ASSERT_EQ(cerr_cache_diff(cp, NULL, 0), live);
+	for (int i = 0; i < SLOTS; ++i)
+		FREE(g_slots[i]);
+	ASSERT_EQ(cerr_cache_diff(cp, NULL, 0), (size_t)0);
+}
@@ -0,0 +1,124 @@
+# define _GNU_SOURCE
+# include <stdio.h>
+# include <stdlib.h>
+# include <unistd.h>
+
+# define CERR_IMPLEMENTATION
+# define CERR_STATS
+# define CERR_STATS_SIGNAL	SIGUSR1
+#include "tests.h"
+#include <pthread.h>
+#include <signal.h>
+#include <string.h>
+
+# define THREADS	4
+
+// Everything cerr_stats_dump writes, or the signal handler when sig is set
+static char *dump(int format, int sig) {
+	static char	buf[1 << 16];
+	FILE		*f = tmpfile();
+	int			saved = dup(STDERR_FILENO);
+	size_t		len;
+
+	if (sig) {
+		dup2(fileno(f), STDERR_FILENO);
+		raise(sig);
+		dup2(saved, STDERR_FILENO);
+	} else
+		cerr_stats_dump(fileno(f), format);
+	close(saved);
+	rewind(f);
+	len = fread(buf, 1, sizeof(buf) - 1, f);
+	buf[len] = '\0';
+	fclose(f);
+	return buf;
+}
+
+static t_cerr_code_stats *code(uint64_t c) {
+	return __cerr_stat_code(c);
+}
+
+// ════════════════════════════════[ STATS TESTS ]═══════════════════════════════
+
+UTEST(stats, throw_and_catch) {
+	uint64_t	thrown = code(7)->thrown;
+	uint64_t	caught = code(7)->caught;
+
+	for (int i = 0; i < 3; ++i) {
+		TRY { THROW(7); } CATCH(7) {}
+	}
+	TRY { THROW(7); } CATCH_ALL() {}
+	TRY { THROW(7); } CATCH(8) {}
+	ASSERT_EQ(code(7)->thrown, thrown + 5);
+	ASSERT_EQ(code(7)->caught, caught + 4);
+}
+
+UTEST(stats, depth) {
+	TRY {
+		TRY {
+			TRY_FAST {
+				ASSERT_EQ(g__cerr_stats->depth, 3u);
+			}
+		}
+	}
+	ASSERT_EQ(g__cerr_stats->depth, 0u);
+	ASSERT_GE(g__cerr_stats->depth_max, 3u);
+}
+
+UTEST(stats, bytes) {
+	t_cerr_stats	before = *__cerr_stats();
+	uint32_t		live = __cerr_cache_live();
+	void			*p = MALLOC(100);
+
+	p = REALLOC(p, 300);
+	ASSERT_EQ(__cerr_cache_live(), live + 1);
+	FREE(p);
+	ASSERT_EQ(__cerr_cache_live(), live);
+	ASSERT_EQ(g__cerr_stats->allocs, before.allocs + 2);
+	ASSERT_EQ(g__cerr_stats->alloc_bytes, before.alloc_bytes + 400);
+	ASSERT_EQ(g__cerr_stats->frees, before.frees + 2);
+	ASSERT_EQ(g__cerr_stats->free_bytes, before.free_bytes + 400);
+}
+
+UTEST(stats, codes_overflow) {
+	uint64_t	other = g__cerr_stats->codes[CERR_STATS_CODES].thrown;
+
+	for (int i = 0; i < 2 * CERR_STATS_CODES; ++i) {
+		TRY { THROW(1000 + i); } CATCH_ALL() {}
+	}
+	ASSERT_GE(g__cerr_stats->codes[CERR_STATS_CODES].thrown, other + 64);
+}
+
+static void *worker(void *arg) {
+	(void)arg;
+	for (int i = 0; i < 10; ++i) {
+		TRY { THROW(9); } CATCH(9) {}
+	}
+	return NULL;
+}
+
+UTEST(stats, threads_summed) {
+	pthread_t	threads[THREADS];
+	char		*json;
+
+	for (int t = 0; t < THREADS; ++t)
+		pthread_create(&threads[t], NULL, worker, NULL);
+	for (int t = 0; t < THREADS; ++t)
+		pthread_join(threads[t], NULL);
+	json = dump(CERR_STATS_JSON, 0);
+	ASSERT_TRUE(strstr(json, "{\"code\":9,\"thrown\":40,\"caught\":40}") != NULL);
+	ASSERT_TRUE(strncmp(json, "{\"threads\":", 11) == 0);
+	ASSERT_TRUE(strstr(json, "\"cache\":{\"len\":") != NULL);
+	ASSERT_EQ(json[strlen(json) - 2], '}');
+}
+
+UTEST(stats, text_on_signal) {
+	char	*text = dump(CERR_STATS_TEXT, SIGUSR1);
+
+	ASSERT_TRUE(strncmp(text, "libcerr stats: ", 15) == 0);
+	ASSERT_TRUE(strstr(text, "  code 9: 40 thrown, 40 caught\n") != NULL);
+	ASSERT_TRUE(strstr(text, "  allocs: ") != NULL);
+	ASSERT_TRUE(strstr(text, "  probes ") != NULL);
+}
+
+UTEST_MAIN();
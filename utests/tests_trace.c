@@ -0,0 +1,135 @@
+# define _GNU_SOURCE
+# include <stdio.h>
+# include <stdlib.h>
+# include <unistd.h>
+
+static char g_path[] = "/tmp/libcerr_trace_XXXXXX";
+
+# define CERR_IMPLEMENTATION
+# define CERR_CACHE_TRACE
+# define CERR_CACHE_TRACE_FILE	g_path
+# define CERR_CACHE_TRACE_CHUNK	128
+#include "tests.h"
+#include <pthread.h>
+#include <string.h>
+
+# define THREADS	4
+# define N			1000
+
+__attribute__((constructor))
+static void trace_open(void) {
+	close(mkstemp(g_path));
+}
+
+__attribute__((destructor))
+static void trace_close(void) {
+	unlink(g_path);
+}
+
+// Raw bytes of the trace file so far
+static char *trace_raw(size_t *len) {
+	static char buf[1 << 22];
+	FILE *f = fopen(g_path, "r");
+
+	*len = fread(buf, 1, sizeof(buf), f);
+	fclose(f);
+	return buf;
+}
+
+// What cerr-heap prints for the trace file so far
+static char *trace_text(void) {
+	static char *text = NULL;
+	size_t size = 0;
+	size_t len;
+	char *raw = trace_raw(&len);
+	FILE *out;
+
+	free(text);
+	out = open_memstream(&text, &size);
+	if (__cerr_trace_analyze(out, raw, len, 4))
+		fprintf(out, "not a trace");
+	fclose(out);
+	return text;
+}
+
+static void *churn(void UNUSED *arg) {
+	void *ptrs[16] = {0};
+
+	for (int i = 0; i < N; ++i) {
+		FREE(ptrs[i % 16]);
+		ptrs[i % 16] = MALLOC(i % 64 + 1);
+	}
+	for (int i = 0; i < 16; ++i)
+		FREE(ptrs[i]);
+	return NULL;
+}
+
+// ═══════════════════════════════[ EVENT TESTS ]════════════════════════════════
+
+UTEST(trace, events) {
+	t_cerr_trace h;
+	t_cerr_event e;
+	size_t len;
+	char *raw;
+	void *ptr = CALLOC(3, 100);
+	int seen = 0;
+
+	FREE(ptr);
+	raw = trace_raw(&len);
+	memcpy(&h, raw, sizeof(h));
+	ASSERT_EQ(memcmp(h.magic, __CERR_TRACE_MAGIC, 8), 0);
+	ASSERT_EQ(h.event, (uint32_t)sizeof(t_cerr_event));
+	for (size_t off = h.events; off + sizeof(e) <= len; off += sizeof(e)) {
+		memcpy(&e, raw + off, sizeof(e));
+		if (e.ptr != (uintptr_t)ptr)
+			continue;
+		ASSERT_EQ(e.op, (uint32_t)(seen ? __CERR_T_FREE : __CERR_T_ALLOC));
+		ASSERT_EQ(__CERR_META_SIZE(e.meta), 300u);
+		++seen;
+	}
+	ASSERT_EQ(seen, 2);
+}
+
+UTEST(trace, threads) {
+	pthread_t threads[THREADS];
+
+	// Every thread fills many chunks of its own
+	for (int t = 0; t < THREADS; ++t)
+		pthread_create(&threads[t], NULL, churn, NULL);
+	for (int t = 0; t < THREADS; ++t)
+		pthread_join(threads[t], NULL);
+	ASSERT_TRUE(strstr(trace_text(), "allocs: 4001, 128380 bytes, frees: 4001")
+		!= NULL);
+	ASSERT_TRUE(strstr(trace_text(), "leaks: 0 blocks") != NULL);
+}
+
+// ═══════════════════════════════[ ANALYSIS TESTS ]═════════════════════════════
+
+UTEST(trace, analyze) {
+	void *a = MALLOC(100000);
+	void *b = MALLOC(200000);
+	void *c;
+
+	FREE(a);
+	b = REALLOC(b, 5000);
+	c = CALLOC(10, 10);
+	LOG_INFO("Testing __cerr_trace_analyze on a trace not ended yet:");
+	printf("%s", trace_text());
+	ASSERT_TRUE(strstr(trace_text(), "not ended") != NULL);
+	ASSERT_TRUE(strstr(trace_text(), "leaks: 2 blocks, 5100 bytes") != NULL);
+	cerr_cache_trace_end();
+	FREE(MALLOC(1));
+	LOG_INFO("Testing __cerr_trace_analyze on the ended trace:");
+	printf("%s", trace_text());
+	ASSERT_TRUE(strstr(trace_text(), "times in ms") != NULL);
+	ASSERT_TRUE(strstr(trace_text(), "peak: 300000 bytes in 2 blocks") != NULL);
+	ASSERT_TRUE(strstr(trace_text(), "leaks: 2 blocks, 5100 bytes") != NULL);
+	ASSERT_TRUE(strstr(trace_text(), "tests_trace.c:") != NULL);
+	ASSERT_TRUE(strstr(trace_text(), " holds 1 blocks, 5000 bytes") != NULL);
+	ASSERT_TRUE(strstr(trace_text(), "allocs: 4005, 433480 bytes") != NULL);
+	FREE(b);
+	FREE(c);
+	ASSERT_NE(__cerr_trace_analyze(stdout, "CERRHEAD", 8, 4), 0);
+}
+
+UTEST_MAIN();
@@ -1,3 +1,4 @@
+# define CERR_BACKTRACE
 #include "tests.h"
 
 UTEST(try, no_return) {
@@ -34,3 +35,332 @@ UTEST(try, loop) {
 	}
 	ASSERT_EQ(count, N);
 }
+
+// A TRY in a CATCH body throwing its own reason leaves the caught one intact,
+// whether it was read before or not
+UTEST(try, nested_in_catch) {
+	volatile int caught = 0;
+
+	for (int read = 0; read < 2; ++read) {
+		TRY {
+			THROW_MSG(ERROR, "outer %d", read);
+		} CATCH(ERROR) {
+			if (read)
+				ASSERT_TRUE(strstr(CERR_WHY(), ": outer 1") != NULL);
+			TRY {
+				THROW_MSG(2, "inner");
+			} CATCH(2) {
+				ASSERT_TRUE(strstr(CERR_WHY(), ": inner") != NULL);
+			}
+			ASSERT_TRUE(strstr(CERR_WHY(), read ? ": outer 1" : ": outer 0")
+				!= NULL);
+			caught++;
+		}
+	}
+	ASSERT_EQ(caught, 2);
+	ASSERT_TRUE(g__cerr_ctx == NULL);
+}
+
+// ═══════════════════════════════[ FAST TESTS ]═════════════════════════════════
+
+static void fast_throw(int code) {
+	THROW_MSG(code, "fast %d", code);
+}
+
+UTEST(try_fast, same_function) {
+	volatile int caught = 0;
+
+	TRY_FAST {
+		THROW(ERROR);
+	} CATCH(ERROR) {
+		caught = 1;
+	}
+	ASSERT_EQ(caught, 1);
+	ASSERT_TRUE(g__cerr_ctx == NULL);
+}
+
+UTEST(try_fast, message_and_code) {
+	volatile int caught = 0;
+
+	TRY_FAST {
+		fast_throw(7);
+	} CATCH(ERROR) {
+		caught = 1;
+	} CATCH(7) {
+		caught = 7;
+		ASSERT_TRUE(strstr(CERR_WHY(), ": fast 7") != NULL);
+	}
+	ASSERT_EQ(caught, 7);
+	TRY_FAST {
+		fast_throw(0);
+	} CATCH(ERROR) {
+		caught = 0;
+	}
+	ASSERT_EQ(caught, 0);
+}
+
+UTEST(try_fast, nested) {
+	volatile int inner = 0;
+	volatile int outer = 0;
+
+	TRY_FAST {
+		TRY {
+			TRY_FAST {
+				fast_throw(3);
+			} CATCH(3) {
+				inner++;
+			}
+			fast_throw(4);
+		} CATCH(4) {
+			inner++;
+			ASSERT_FALSE(g__cerr_ctx->fast);
+		}
+		fast_throw(5);
+	} CATCH(5) {
+		outer++;
+		ASSERT_TRUE(g__cerr_ctx->fast);
+	}
+	ASSERT_EQ(inner, 2);
+	ASSERT_EQ(outer, 1);
+	ASSERT_TRUE(g__cerr_ctx == NULL);
+}
+
+UTEST(try_fast, loop) {
+	volatile int count = 0;
+
+	for (int i = 0; i < 1000; ++i) {
+		TRY_FAST {
+			if (i % 2)
+				fast_throw(ERROR);
+		} CATCH(ERROR) {
+			count++;
+		}
+	}
+	ASSERT_EQ(count, 500);
+}
+
+// ═════════════════════════════[ BACKTRACE TESTS ]══════════════════════════════
+
+__attribute__((noinline))
+static void trace_inner(int code) {
+	THROW_MSG(code, "traced");
+	__asm__ volatile("");
+}
+
+__attribute__((noinline))
+static void trace_outer(int code) {
+	trace_inner(code);
+	__asm__ volatile("");
+}
+
+// A return address inside the first bytes of a small function
+static int trace_in(void *ret, void (*fn)(int)) {
+	return (char *)ret > (char *)fn && (char *)ret < (char *)fn + 512;
+}
+
+UTEST(backtrace, captured) {
+	volatile int caught = 0;
+
+	TRY {
+		trace_outer(ERROR);
+	} CATCH(ERROR) {
+		caught = 1;
+		ASSERT_GE(g__cerr_throw.depth, 3u);
+		ASSERT_TRUE(trace_in(g__cerr_throw.frames[0], trace_inner));
+		ASSERT_TRUE(trace_in(g__cerr_throw.frames[1], trace_outer));
+		CERR_TRACE();
+	}
+	ASSERT_EQ(caught, 1);
+}
+
+__attribute__((noinline))
+static void trace_deep(int depth) {
+	if (!depth)
+		trace_outer(ERROR);
+	trace_deep(depth - 1);
+	__asm__ volatile("");
+}
+
+UTEST(backtrace, bounded) {
+	TRY {
+		trace_deep(2 * CERR_BACKTRACE_DEPTH);
+	} CATCH_LOG(ERROR) {
+		ASSERT_EQ(g__cerr_throw.depth, (uint32_t)CERR_BACKTRACE_DEPTH);
+	}
+}
+
+UTEST(backtrace, fast) {
+	TRY_FAST {
+		trace_inner(ERROR);
+	} CATCH(ERROR) {
+		ASSERT_TRUE(trace_in(g__cerr_throw.frames[0], trace_inner));
+	}
+}
+
+// ═══════════════════════════════[ DEFER TESTS ]════════════════════════════════
+
+// Each call appends its tag, the order of the cleanups
+static char g_order[16];
+
+static void defer_tag(void *tag) {
+	size_t len = strlen(g_order);
+
+	g_order[len] = *(char *)tag;
+	g_order[len + 1] = '\0';
+}
+
+static void defer_throw(void *tag) {
+	defer_tag(tag);
+	THROW(ERROR);
+}
+
+__attribute__((noinline))
+static void defer_and_throw(int code) {
+	DEFER(defer_tag, "b");
+	DEFER(defer_tag, "c");
+	THROW(code);
+}
+
+__attribute__((noinline))
+static int defer_and_return(void) {
+	TRY {
+		DEFER(defer_tag, "a");
+		return 1;
+	}
+	return 0;
+}
+
+UTEST(defer, lifo) {
+	g_order[0] = '\0';
+	TRY {
+		DEFER(defer_tag, "a");
+		DEFER(defer_tag, "b");
+		DEFER(defer_tag, "c");
+		ASSERT_STREQ(g_order, "");
+	}
+	ASSERT_STREQ(g_order, "cba");
+	ASSERT_EQ(g__cerr_ndefers, 0u);
+}
+
+UTEST(defer, before_catch) {
+	g_order[0] = '\0';
+	TRY {
+		DEFER(defer_tag, "x");
+		TRY {
+			DEFER(defer_tag, "a");
+			defer_and_throw(ERROR);
+		} CATCH(ERROR) {
+			ASSERT_STREQ(g_order, "cba");
+		}
+		ASSERT_STREQ(g_order, "cba");
+	}
+	ASSERT_STREQ(g_order, "cbax");
+}
+
+UTEST(defer, return) {
+	g_order[0] = '\0';
+	ASSERT_EQ(defer_and_return(), 1);
+	ASSERT_STREQ(g_order, "a");
+	ASSERT_EQ(g__cerr_ndefers, 0u);
+}
+
+UTEST(defer, finally) {
+	volatile int caught = 0;
+
+	g_order[0] = '\0';
+	TRY {
+		DEFER(defer_tag, "a");
+		THROW(ERROR);
+	} CATCH(ERROR) {
+		caught = 1;
+	} FINALLY {
+		defer_tag("f");
+	}
+	TRY {
+		DEFER(defer_tag, "b");
+	} FINALLY {
+		defer_tag("g");
+	}
+	ASSERT_EQ(caught, 1);
+	ASSERT_STREQ(g_order, "afbg");
+}
+
+// TRY, its catches and its FINALLY are a single statement
+UTEST(defer, finally_statement) {
+	volatile int skip = 0;
+
+	g_order[0] = '\0';
+	for (int run = 0; run < 2; ++run)
+		if (run)
+			TRY {
+				THROW(ERROR);
+			} CATCH(ERROR) {
+				defer_tag("c");
+			} FINALLY {
+				defer_tag("f");
+			}
+		else
+			skip++;
+	if (skip == 2)
+		TRY {
+			defer_tag("x");
+		} FINALLY {
+			defer_tag("y");
+		}
+	ASSERT_EQ(skip, 1);
+	ASSERT_STREQ(g_order, "cf");
+	ASSERT_TRUE(g__cerr_ctx == NULL);
+}
+
+UTEST(defer, fast) {
+	g_order[0] = '\0';
+	TRY_FAST {
+		defer_and_throw(ERROR);
+	} CATCH(ERROR) {
+		ASSERT_STREQ(g_order, "cb");
+	}
+	ASSERT_EQ(g__cerr_ndefers, 0u);
+}
+
+static void defer_catch(void *tag) {
+	defer_tag(tag);
+	TRY {
+		THROW_MSG(ERROR, "cleanup");
+	} CATCH(ERROR) {}
+}
+
+// A cleanup catching its own throw leaves the reason being thrown intact
+UTEST(defer, catching_cleanup) {
+	volatile int caught = 0;
+
+	g_order[0] = '\0';
+	TRY {
+		DEFER(defer_catch, "a");
+		THROW_MSG(ERROR, "thrown %d", 1);
+	} CATCH(ERROR) {
+		caught = 1;
+		ASSERT_TRUE(strstr(CERR_WHY(), ": thrown 1") != NULL);
+	}
+	ASSERT_EQ(caught, 1);
+	ASSERT_STREQ(g_order, "a");
+}
+
+// A cleanup throwing on the way out goes to the enclosing TRY, which still
+// runs the cleanups below it
+UTEST(defer, throwing_cleanup) {
+	volatile int caught = 0;
+
+	g_order[0] = '\0';
+	TRY {
+		TRY {
+			DEFER(defer_tag, "a");
+			DEFER(defer_throw, "b");
+			DEFER(defer_tag, "c");
+		}
+	} CATCH(ERROR) {
+		caught = 1;
+	}
+	ASSERT_EQ(caught, 1);
+	ASSERT_STREQ(g_order, "cba");
+	ASSERT_EQ(g__cerr_ndefers, 0u);
+}